@@ -0,0 +1,312 @@
+/*
+ * Replay analyzer: re-searches every recorded decision (game_record.h) deeper, or with a longer time
+ * budget, than it was played with, and ranks the moves where the played choice lost the most value
+ * against the deeper search's best move. Phase tables then show where that loss sits (empty cells, max
+ * tile), next to the live decision time, i.e. where a bigger search budget would pay off.
+ *
+ * Build: gcc -O3 -march=native -o analyze_2048 analyze_2048.c -lm -lpthread
+ * Run:   ./analyze_2048 [--depth 5 | --budget-ms 500] [--threads N] [--cache-bits 24] [--top 10]
+ *                       [--samples 10] [--weights eval_weights.json] [--eval heuristic|ntuple:PATH]
+ *                       [--out decisions.tsv] [--export PREFIX [--shard-records 4194304]]
+ *                       games.rec [more.rec ...]
+ *
+ * Positions of a game are spread over all threads, which share one lock-free transposition table
+ * (2^cache-bits entries; consecutive positions share most of their subtrees, so it is kept across
+ * positions and only cleared between batches once it is half full). --budget-ms deepens each position
+ * from depth 2 until an iteration ends past the budget and keeps the deepest finished iteration.
+ * Games are numbered across the files in order (game k of a single file is records_2048 --dump k).
+ *
+ * Output (stdout): TSV game rank step loss played best depth empties max_tile live_ms, the --top worst
+ * decisions per game (loss > 0 only; loss = best value - played value, in eval units); then the same
+ * decisions grouped by empty cells and by max tile. Summary on stderr. --out writes every decision:
+ * game step played best loss depth v_up v_right v_down v_left empties max_tile live_ms live_value.
+ * Decisions the engine's rules call illegal (a misread board in a bot record) are skipped and counted.
+ * --export streams every analyzed decision (board, the four deep root values, the move played, depth)
+ * to training-data shards PREFIX-NNNNN.td (train_data.h) as the workers finish them.
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "strategy_2048.c"
+#include "bench_common.h"
+#include "game_record.h"
+#include "train_data.h"
+
+#define ANALYZE_BATCH 64
+#define ANALYZE_MAX_DEPTH 20
+
+typedef struct {
+    int game;
+    uint32_t step;
+    board_t board;
+    int played;
+    float live_ms, live_value;
+    double values[4];   /* deep search, -1e300 = illegal */
+    int best, depth;
+    double loss;        /* < 0: played move illegal under the engine's rules, skipped */
+} decision_t;
+
+static decision_t *decisions;
+static size_t ndecisions;
+static int analyze_depth = 5, budget_ms = 0;
+static int next_decision; /* atomic, index into the running batch */
+static size_t batch_start, batch_end;
+static cache_entry_t *shared_cache;
+static unsigned long long nodes_since_clear; /* atomic */
+static td_writer_t *export_writer = NULL;
+static td_buf_t export_bufs[MAX_THREADS];   /* per worker slot, kept across batches */
+
+static void analyze_decision(decision_t *d) {
+    grid_t g;
+    unpack_grid(d->board, g);
+    if (budget_ms <= 0) {
+        search_move_values(g, analyze_depth, d->values);
+        d->depth = analyze_depth;
+    } else {
+        double t0 = now_sec(), values[4];
+        for (int depth = 2; depth <= ANALYZE_MAX_DEPTH; depth++) {
+            search_move_values(g, depth, values);
+            memcpy(d->values, values, sizeof values);
+            d->depth = depth;
+            if ((now_sec() - t0) * 1000.0 >= budget_ms) break;
+        }
+    }
+    d->best = -1;
+    for (int dir = 0; dir < 4; dir++)
+        if (d->values[dir] > -1e299 && (d->best < 0 || d->values[dir] > d->values[d->best]))
+            d->best = dir;
+    d->loss = d->values[d->played] > -1e299 ? d->values[d->best] - d->values[d->played] : -1;
+}
+
+static void *analyze_worker(void *arg) {
+    td_buf_t *export = &export_bufs[(int)(intptr_t)arg];
+    current_cache = shared_cache;
+    unsigned long long n0 = node_count;
+    for (;;) {
+        size_t i = batch_start + (size_t)__atomic_fetch_add(&next_decision, 1, __ATOMIC_RELAXED);
+        if (i >= batch_end) break;
+        decision_t *d = &decisions[i];
+        analyze_decision(d);
+        if (export_writer && d->loss >= 0) {
+            td_record_t r;
+            td_fill(&r, d->board, d->values, d->played, d->depth, TD_FROM_REPLAY, (uint32_t)d->game);
+            td_add(export_writer, export, &r);
+        }
+    }
+    __atomic_fetch_add(&nodes_since_clear, node_count - n0, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/* Replays every game of a record file into decisions[]; returns the number of games, -1 on error. */
+static int load_decisions(const char *path, int first_game, size_t *cap) {
+    gr_file_t f;
+    if (gr_open(path, &f) != 0) return -1;
+    size_t off = 0;
+    gr_game_t g;
+    int game = first_game;
+    while (gr_next_game(&f, &off, &g)) {
+        board_t b = g.h.initial;
+        for (uint32_t i = 0; i < g.h.nsteps; i++) {
+            if (ndecisions == *cap) {
+                *cap = *cap ? 2 * *cap : 65536;
+                decisions = (decision_t *)realloc(decisions, *cap * sizeof(decision_t));
+                if (!decisions) {
+                    fprintf(stderr, "analyze_2048: out of memory\n");
+                    exit(1);
+                }
+            }
+            unsigned int code = gr_step_code(&g, i);
+            decision_t *d = &decisions[ndecisions++];
+            memset(d, 0, sizeof *d);
+            d->game = game;
+            d->step = i;
+            d->board = b;
+            d->played = (int)(code & 3);
+            d->live_ms = gr_step_ms(&g, i);
+            d->live_value = gr_step_value(&g, i);
+            int gained;
+            b = gr_apply_step(b, code, &gained);
+        }
+        game++;
+    }
+    gr_close(&f);
+    return game - first_game;
+}
+
+static int cmp_loss_desc(const void *a, const void *b) {
+    const decision_t *x = *(decision_t *const *)a, *y = *(decision_t *const *)b;
+    return (x->loss < y->loss) - (x->loss > y->loss);
+}
+
+/* Phase buckets: by empty cells and by max tile. */
+#define NBUCKETS 6
+static const char *empties_names[NBUCKETS] = { "0-1", "2-3", "4-5", "6-8", "9-11", "12+" };
+static const char *tile_names[NBUCKETS] = { "<=256", "512", "1024", "2048", "4096", ">=8192" };
+
+static int empties_bucket(int e) {
+    return e <= 1 ? 0 : e <= 3 ? 1 : e <= 5 ? 2 : e <= 8 ? 3 : e <= 11 ? 4 : 5;
+}
+
+static int tile_bucket(int code) {
+    return code <= 8 ? 0 : code >= 13 ? 5 : code - 8;
+}
+
+typedef struct {
+    long positions, flips;
+    double loss, live_ms;
+} phase_stats_t;
+
+static void print_phase_table(const char *title, const char *const *names, const phase_stats_t *ps,
+                              double total_loss) {
+    printf("\n# by %s\n", title);
+    printf("%s\tpositions\tflips\tflip_rate\tmean_loss\tloss_share\tmean_live_ms\n", title);
+    for (int k = 0; k < NBUCKETS; k++) {
+        const phase_stats_t *p = &ps[k];
+        if (!p->positions) continue;
+        printf("%s\t%ld\t%ld\t%.4f\t%.3f\t%.4f\t%.3f\n", names[k], p->positions, p->flips,
+               (double)p->flips / p->positions, p->loss / p->positions, total_loss > 0 ? p->loss / total_loss : 0.0,
+               p->live_ms / p->positions);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: analyze_2048 [--depth D | --budget-ms MS] [--threads N] [--cache-bits B] [--top K]\n"
+            "                    [--samples N] [--weights PATH] [--eval heuristic|ntuple:PATH] [--out FILE]\n"
+            "                    [--export PREFIX [--shard-records N]]\n"
+            "                    FILE.rec [FILE.rec ...]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL, *export_prefix = NULL;
+    int cache_bits = 24, top = 10, i;
+    unsigned long long shard_records = 1ULL << 22;
+    for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 2; }
+        if (strcmp(a, "--depth") == 0) analyze_depth = atoi(v);
+        else if (strcmp(a, "--budget-ms") == 0) budget_ms = atoi(v);
+        else if (strcmp(a, "--threads") == 0) nthreads = atoi(v);
+        else if (strcmp(a, "--cache-bits") == 0) cache_bits = atoi(v);
+        else if (strcmp(a, "--top") == 0) top = atoi(v);
+        else if (strcmp(a, "--samples") == 0) max_empty_samples = atoi(v);
+        else if (strcmp(a, "--out") == 0) out_path = v;
+        else if (strcmp(a, "--export") == 0) export_prefix = v;
+        else if (strcmp(a, "--shard-records") == 0) shard_records = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--weights") == 0) { if (eval_weights_load(v, &eval_w) != 0) return 1; }
+        else if (strcmp(a, "--eval") == 0) { if (eval_select(v) != 0) return 1; }
+        else { usage(); return 2; }
+    }
+    if (i >= argc || analyze_depth < 1 || analyze_depth > ANALYZE_MAX_DEPTH || cache_bits < 10 || cache_bits > 30) {
+        usage();
+        return 2;
+    }
+    if (nthreads <= 0) nthreads = default_thread_count();
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+
+    init_move_tables();
+    size_t cap = 0;
+    int ngames = 0;
+    for (; i < argc; i++) {
+        int n = load_decisions(argv[i], ngames, &cap);
+        if (n < 0) return 1;
+        ngames += n;
+    }
+    if (export_prefix && !(export_writer = td_writer_open(export_prefix, shard_records))) return 1;
+    cache_size = 1ULL << cache_bits;
+    if (!(shared_cache = (cache_entry_t *)calloc(cache_size, sizeof(cache_entry_t)))) {
+        fprintf(stderr, "analyze_2048: failed to allocate cache\n");
+        return 1;
+    }
+    if (budget_ms > 0)
+        fprintf(stderr, "analyze_2048: %d games, %zu decisions, budget %d ms, %d threads\n", ngames, ndecisions,
+                budget_ms, nthreads);
+    else
+        fprintf(stderr, "analyze_2048: %d games, %zu decisions, depth %d, %d threads\n", ngames, ndecisions,
+                analyze_depth, nthreads);
+
+    double t0 = now_sec(), last_report = t0;
+    pthread_t threads[MAX_THREADS];
+    for (batch_start = 0; batch_start < ndecisions; batch_start = batch_end) {
+        batch_end = batch_start + ANALYZE_BATCH < ndecisions ? batch_start + ANALYZE_BATCH : ndecisions;
+        if (nodes_since_clear > cache_size / 2) {
+            current_cache = shared_cache;
+            cache_clear();
+            nodes_since_clear = 0;
+        }
+        next_decision = 0;
+        int nt = (size_t)nthreads < batch_end - batch_start ? nthreads : (int)(batch_end - batch_start);
+        for (int t = 0; t < nt; t++) pthread_create(&threads[t], NULL, analyze_worker, (void *)(intptr_t)t);
+        for (int t = 0; t < nt; t++) pthread_join(threads[t], NULL);
+        if (now_sec() - last_report >= 10) {
+            last_report = now_sec();
+            fprintf(stderr, "analyze_2048: %zu/%zu decisions, %.0f s\n", batch_end, ndecisions, last_report - t0);
+        }
+    }
+    double elapsed = now_sec() - t0;
+    if (export_writer) {
+        for (int t = 0; t < nthreads; t++) td_flush(export_writer, &export_bufs[t]);
+        long long n = td_writer_close(export_writer);
+        if (n < 0) return 1;
+        fprintf(stderr, "analyze_2048: exported %lld decisions to %s-*.td\n", n, export_prefix);
+    }
+
+    /* Per-game ranking, phase tables, --out. */
+    FILE *out = out_path ? fopen(out_path, "w") : NULL;
+    if (out_path && !out) fprintf(stderr, "analyze_2048: cannot write %s\n", out_path);
+    if (out) fprintf(out, "game\tstep\tplayed\tbest\tloss\tdepth\tv_up\tv_right\tv_down\tv_left\tempties\tmax_tile"
+                          "\tlive_ms\tlive_value\n");
+    phase_stats_t by_empties[NBUCKETS], by_tile[NBUCKETS];
+    memset(by_empties, 0, sizeof by_empties);
+    memset(by_tile, 0, sizeof by_tile);
+    decision_t **ranked = (decision_t **)malloc((ndecisions ? ndecisions : 1) * sizeof(decision_t *));
+    long analyzed = 0, flips = 0, skipped = 0;
+    double total_loss = 0;
+    printf("game\trank\tstep\tloss\tplayed\tbest\tdepth\tempties\tmax_tile\tlive_ms\n");
+    for (size_t lo = 0, hi; lo < ndecisions; lo = hi) {
+        int nr = 0;
+        for (hi = lo; hi < ndecisions && decisions[hi].game == decisions[lo].game; hi++) {
+            decision_t *d = &decisions[hi];
+            int empties = board_count_empty(d->board), tile = board_max_code(d->board);
+            if (out)
+                fprintf(out, "%d\t%u\t%s\t%s\t%.3f\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%d\t%d\t%.3f\t%.1f\n", d->game,
+                        d->step, dir_name(d->played), d->best >= 0 ? dir_name(d->best) : "none", d->loss, d->depth,
+                        d->values[0] > -1e299 ? d->values[0] : NAN, d->values[1] > -1e299 ? d->values[1] : NAN,
+                        d->values[2] > -1e299 ? d->values[2] : NAN, d->values[3] > -1e299 ? d->values[3] : NAN,
+                        empties, 1 << tile, d->live_ms, d->live_value);
+            if (d->loss < 0) {
+                skipped++;
+                continue;
+            }
+            phase_stats_t *pe = &by_empties[empties_bucket(empties)], *pt = &by_tile[tile_bucket(tile)];
+            int flip = d->best != d->played;
+            pe->positions++, pt->positions++;
+            pe->flips += flip, pt->flips += flip;
+            pe->loss += d->loss, pt->loss += d->loss;
+            pe->live_ms += d->live_ms, pt->live_ms += d->live_ms;
+            analyzed++;
+            flips += flip;
+            total_loss += d->loss;
+            if (d->loss > 0) ranked[nr++] = d;
+        }
+        qsort(ranked, nr, sizeof *ranked, cmp_loss_desc);
+        for (int k = 0; k < nr && k < top; k++) {
+            const decision_t *d = ranked[k];
+            printf("%d\t%d\t%u\t%.3f\t%s\t%s\t%d\t%d\t%d\t%.3f\n", d->game, k + 1, d->step, d->loss,
+                   dir_name(d->played), dir_name(d->best), d->depth, board_count_empty(d->board),
+                   1 << board_max_code(d->board), d->live_ms);
+        }
+    }
+    if (out) fclose(out);
+    print_phase_table("empties", empties_names, by_empties, total_loss);
+    print_phase_table("max_tile", tile_names, by_tile, total_loss);
+
+    fprintf(stderr, "analyze games=%d decisions=%zu analyzed=%ld skipped=%ld flips=%ld flip_rate=%.4f"
+                    " mean_loss=%.3f seconds=%.2f decisions_per_sec=%.1f\n",
+            ngames, ndecisions, analyzed, skipped, flips, analyzed ? (double)flips / analyzed : 0.0,
+            analyzed ? total_loss / analyzed : 0.0, elapsed, elapsed > 0 ? ndecisions / elapsed : 0.0);
+    free(ranked);
+    free(decisions);
+    free(shared_cache);
+    ntuple_unload(&eval_net);
+    return 0;
+}
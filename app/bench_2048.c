@@ -0,0 +1,325 @@
+/*
+ * Kernel microbenchmarks for the strategy_2048 engine.
+ * Times do_move, eval_grid, grid_to_key, cache_put and cache_get over a fixed board corpus
+ * (bench/kernel_boards.txt: early, mid and late game) and prints one TSV row per kernel and phase.
+ * With --ntuple PATH, ntuple_eval (pack_grid + n-tuple net lookup, as used by --eval ntuple) is timed too.
+ *
+ * Build: gcc -O3 -march=native -o bench_2048 bench_2048.c -lm -lpthread
+ * Run:   ./bench_2048 [--corpus bench/kernel_boards.txt] [--reps 15] [--warmup 3] [--kernel NAME]
+ *                     [--out FILE] [--baseline FILE] [--tolerance PCT] [--ntuple PATH]
+ *
+ * Output columns: kernel phase ops ns_per_op ops_per_sec [baseline_ns delta_pct]
+ * ns_per_op is the median over reps; each rep loops over the phase's boards until >= ~10 ms has passed.
+ * --out saves the table (same TSV) for later use as --baseline. With --tolerance, exits 1 if any
+ * kernel is more than PCT percent slower than the baseline.
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "strategy_2048.c"
+#include "bench_common.h"
+
+#define MAX_REPS 1000
+#define CACHE_KEYS_PER_BOARD 64 /* depths 0..31 x is_max 0/1 */
+
+static volatile double sink;
+
+typedef struct {
+    const char *phase;
+    grid_t *grids;
+    int n;
+} phase_set_t;
+
+typedef double (*kernel_fn)(const phase_set_t *ps, int iters, long *ops_out);
+
+static double k_do_move(const phase_set_t *ps, int iters, long *ops_out) {
+    double acc = 0;
+    double t0 = now_sec();
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < ps->n; i++)
+            for (int dir = 0; dir < 4; dir++) {
+                grid_t g;
+                grid_copy(g, ps->grids[i]);
+                int score;
+                acc += do_move(g, dir, &score) + score + g[0][0];
+            }
+    double t = now_sec() - t0;
+    sink = acc;
+    *ops_out = (long)iters * ps->n * 4;
+    return t;
+}
+
+static double k_eval_grid(const phase_set_t *ps, int iters, long *ops_out) {
+    double acc = 0;
+    double t0 = now_sec();
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < ps->n; i++)
+            acc += eval_grid(ps->grids[i]);
+    double t = now_sec() - t0;
+    sink = acc;
+    *ops_out = (long)iters * ps->n;
+    return t;
+}
+
+static double k_ntuple_eval(const phase_set_t *ps, int iters, long *ops_out) {
+    double acc = 0;
+    double t0 = now_sec();
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < ps->n; i++)
+            acc += eval_ntuple(ps->grids[i]);
+    double t = now_sec() - t0;
+    sink = acc;
+    *ops_out = (long)iters * ps->n;
+    return t;
+}
+
+static double k_grid_to_key(const phase_set_t *ps, int iters, long *ops_out) {
+    unsigned long long acc = 0;
+    double t0 = now_sec();
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < ps->n; i++) {
+            unsigned long long klo, khi;
+            grid_to_key(ps->grids[i], it & 15, it & 1, &klo, &khi);
+            acc += klo ^ khi;
+        }
+    double t = now_sec() - t0;
+    sink = (double)acc;
+    *ops_out = (long)iters * ps->n;
+    return t;
+}
+
+/* Keys for the TT kernels: every board at depths 0..31, both node types. Misses use depths 32..63. */
+static void cache_key(const grid_t g, int k, int miss, unsigned long long *klo, unsigned long long *khi) {
+    grid_to_key(g, (k >> 1) + (miss ? 32 : 0), k & 1, klo, khi);
+}
+
+static void cache_fill(const phase_set_t *ps) {
+    for (int i = 0; i < ps->n; i++)
+        for (int k = 0; k < CACHE_KEYS_PER_BOARD; k++) {
+            unsigned long long klo, khi;
+            cache_key(ps->grids[i], k, 0, &klo, &khi);
+            cache_put(klo, khi, i + k);
+        }
+}
+
+/* cache_put into a freshly cleared table (clearing is not timed; iters is ignored). */
+static double k_cache_put(const phase_set_t *ps, int iters, long *ops_out) {
+    (void)iters;
+    cache_clear();
+    double t0 = now_sec();
+    cache_fill(ps);
+    double t = now_sec() - t0;
+    *ops_out = (long)ps->n * CACHE_KEYS_PER_BOARD;
+    return t;
+}
+
+static double k_cache_get_common(const phase_set_t *ps, int iters, long *ops_out, int miss) {
+    static const phase_set_t *filled = NULL;
+    if (filled != ps) {
+        cache_clear();
+        cache_fill(ps);
+        filled = ps;
+    }
+    double acc = 0;
+    double t0 = now_sec();
+    for (int it = 0; it < iters; it++)
+        for (int i = 0; i < ps->n; i++)
+            for (int k = 0; k < CACHE_KEYS_PER_BOARD; k++) {
+                unsigned long long klo, khi;
+                cache_key(ps->grids[i], k, miss, &klo, &khi);
+                acc += cache_get(klo, khi);
+            }
+    double t = now_sec() - t0;
+    sink = acc;
+    *ops_out = (long)iters * ps->n * CACHE_KEYS_PER_BOARD;
+    return t;
+}
+
+static double k_cache_get(const phase_set_t *ps, int iters, long *ops_out) {
+    return k_cache_get_common(ps, iters, ops_out, 0);
+}
+
+static double k_cache_get_miss(const phase_set_t *ps, int iters, long *ops_out) {
+    return k_cache_get_common(ps, iters, ops_out, 1);
+}
+
+static const struct {
+    const char *name;
+    kernel_fn fn;
+    int fixed_iters; /* 1 => one pass per rep (state must be reset between reps) */
+} kernels[] = {
+    { "do_move",        k_do_move,        0 },
+    { "eval_grid",      k_eval_grid,      0 },
+    { "ntuple_eval",    k_ntuple_eval,    0 }, /* only with --ntuple */
+    { "grid_to_key",    k_grid_to_key,    0 },
+    { "cache_put",      k_cache_put,      1 },
+    { "cache_get",      k_cache_get,      0 },
+    { "cache_get_miss", k_cache_get_miss, 0 },
+};
+#define NKERNELS ((int)(sizeof kernels / sizeof kernels[0]))
+
+typedef struct {
+    char key[64];
+    double ns;
+} baseline_row_t;
+
+static baseline_row_t *baseline_load(const char *path, int *n_out) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open baseline %s\n", path);
+        return NULL;
+    }
+    int cap = 64, n = 0;
+    baseline_row_t *rows = (baseline_row_t *)malloc(cap * sizeof(baseline_row_t));
+    char line[256], kernel[32], phase[16];
+    long ops;
+    double ns;
+    while (rows && fgets(line, sizeof line, f)) {
+        if (sscanf(line, "%31s %15s %ld %lf", kernel, phase, &ops, &ns) != 4) continue; /* header */
+        if (n == cap) {
+            cap *= 2;
+            rows = (baseline_row_t *)realloc(rows, cap * sizeof(baseline_row_t));
+            if (!rows) break;
+        }
+        snprintf(rows[n].key, sizeof rows[n].key, "%s/%s", kernel, phase);
+        rows[n].ns = ns;
+        n++;
+    }
+    fclose(f);
+    *n_out = n;
+    return rows;
+}
+
+static double baseline_find(const baseline_row_t *rows, int n, const char *kernel, const char *phase) {
+    char key[64];
+    snprintf(key, sizeof key, "%s/%s", kernel, phase);
+    for (int i = 0; i < n; i++)
+        if (strcmp(rows[i].key, key) == 0) return rows[i].ns;
+    return -1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: bench_2048 [--corpus PATH] [--reps N] [--warmup N] [--kernel NAME]\n"
+            "                  [--out FILE] [--baseline FILE] [--tolerance PCT] [--ntuple PATH]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *corpus_path = "bench/kernel_boards.txt";
+    const char *only = NULL, *out_path = NULL, *baseline_path = NULL;
+    int reps = 15, warmup = 3;
+    double tolerance = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 2; }
+        if (strcmp(a, "--corpus") == 0) corpus_path = v;
+        else if (strcmp(a, "--reps") == 0) reps = atoi(v);
+        else if (strcmp(a, "--warmup") == 0) warmup = atoi(v);
+        else if (strcmp(a, "--kernel") == 0) only = v;
+        else if (strcmp(a, "--out") == 0) out_path = v;
+        else if (strcmp(a, "--baseline") == 0) baseline_path = v;
+        else if (strcmp(a, "--tolerance") == 0) tolerance = atof(v);
+        else if (strcmp(a, "--ntuple") == 0) { if (ntuple_load(v, &eval_net) != 0) return 1; }
+        else { usage(); return 2; }
+        i++;
+    }
+    if (reps < 1) reps = 1;
+    if (reps > MAX_REPS) reps = MAX_REPS;
+
+    int nboards = 0;
+    corpus_board_t *boards = corpus_load(corpus_path, &nboards);
+    if (!boards || nboards == 0) return 1;
+
+    /* Group boards by label, plus an "all" set. */
+    phase_set_t phases[8];
+    int nphases = 0;
+    grid_t *all = (grid_t *)malloc(nboards * sizeof(grid_t));
+    for (int i = 0; i < nboards; i++) {
+        grid_copy(all[i], boards[i].grid);
+        int p = 0;
+        while (p < nphases && strcmp(phases[p].phase, boards[i].label) != 0) p++;
+        if (p == nphases) {
+            if (nphases == 7) continue;
+            phases[p].phase = boards[i].label;
+            phases[p].grids = (grid_t *)malloc(nboards * sizeof(grid_t));
+            phases[p].n = 0;
+            nphases++;
+        }
+        grid_copy(phases[p].grids[phases[p].n++], boards[i].grid);
+    }
+    phases[nphases].phase = "all";
+    phases[nphases].grids = all;
+    phases[nphases].n = nboards;
+    nphases++;
+
+    baseline_row_t *base = NULL;
+    int nbase = 0;
+    if (baseline_path && !(base = baseline_load(baseline_path, &nbase))) return 1;
+
+    current_cache = (cache_entry_t *)calloc(CACHE_SIZE, sizeof(cache_entry_t));
+    if (!current_cache) {
+        fprintf(stderr, "bench_2048: failed to allocate cache\n");
+        return 1;
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : NULL;
+    if (out_path && !out) {
+        fprintf(stderr, "cannot write %s\n", out_path);
+        return 1;
+    }
+    fprintf(stderr, "bench_2048: %d boards from %s, %d warmup + %d reps\n", nboards, corpus_path, warmup, reps);
+    const char *header = "kernel\tphase\tops\tns_per_op\tops_per_sec";
+    printf("%s%s\n", header, base ? "\tbaseline_ns\tdelta_pct" : "");
+    if (out) fprintf(out, "%s\n", header);
+
+    int regressions = 0;
+    double samples[MAX_REPS];
+    for (int k = 0; k < NKERNELS; k++) {
+        if (only && strcmp(only, kernels[k].name) != 0) continue;
+        if (kernels[k].fn == k_ntuple_eval && !eval_net.ntuples) continue;
+        for (int p = 0; p < nphases; p++) {
+            const phase_set_t *ps = &phases[p];
+            /* Warmup also calibrates iterations so one rep takes >= ~10 ms. */
+            int iters = 1;
+            long ops;
+            for (int w = 0; w < warmup || w == 0; w++) {
+                double t = kernels[k].fn(ps, iters, &ops);
+                while (!kernels[k].fixed_iters && t < 0.01 && iters < (1 << 24)) {
+                    iters *= 2;
+                    t = kernels[k].fn(ps, iters, &ops);
+                }
+            }
+            for (int r = 0; r < reps; r++) {
+                double t = kernels[k].fn(ps, iters, &ops);
+                samples[r] = t * 1e9 / ops;
+            }
+            double ns = percentile(samples, reps, 50);
+            char row[256];
+            snprintf(row, sizeof row, "%s\t%s\t%ld\t%.3f\t%.0f",
+                     kernels[k].name, ps->phase, ops, ns, ns > 0 ? 1e9 / ns : 0);
+            if (out) fprintf(out, "%s\n", row);
+            double b = base ? baseline_find(base, nbase, kernels[k].name, ps->phase) : -1;
+            if (b > 0) {
+                double delta = (ns - b) / b * 100.0;
+                printf("%s\t%.3f\t%+.1f\n", row, b, delta);
+                if (tolerance > 0 && delta > tolerance) regressions++;
+            } else if (base) {
+                printf("%s\t-\t-\n", row);
+            } else {
+                printf("%s\n", row);
+            }
+            fflush(stdout);
+        }
+    }
+
+    if (out) fclose(out);
+    free(current_cache);
+    for (int p = 0; p < nphases; p++) free(phases[p].grids);
+    free(boards);
+    free(base);
+    if (regressions) {
+        fprintf(stderr, "bench_2048: %d kernel/phase rows slower than baseline by > %.1f%%\n", regressions, tolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Shared helpers for the benchmark tools (bench_2048.c, ...).
+ * Include after strategy_2048.c (needs grid_t, N and now_sec).
+ *
+ * Corpus files: one board per line, "<label> v0 v1 ... v15 [extra...]", row-major tile values.
+ * Lines starting with '#' and blank lines are ignored; anything after the 16 values is kept in `extra`.
+ */
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+typedef struct {
+    char label[32];
+    grid_t grid;
+    char extra[128];
+} corpus_board_t;
+
+/* Returns malloc'd boards (caller frees) and count in *n_out, or NULL on error. */
+static inline corpus_board_t *corpus_load(const char *path, int *n_out) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open corpus %s\n", path);
+        return NULL;
+    }
+    int cap = 256, n = 0;
+    corpus_board_t *boards = (corpus_board_t *)malloc(cap * sizeof(corpus_board_t));
+    char line[512];
+    int lineno = 0;
+    while (boards && fgets(line, sizeof line, f)) {
+        lineno++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+        if (n == cap) {
+            cap *= 2;
+            corpus_board_t *grown = (corpus_board_t *)realloc(boards, cap * sizeof(corpus_board_t));
+            if (!grown) { free(boards); boards = NULL; break; }
+            boards = grown;
+        }
+        corpus_board_t *b = &boards[n];
+        int used = 0;
+        if (sscanf(p, "%31s%n", b->label, &used) != 1) continue;
+        p += used;
+        int ok = 1;
+        for (int i = 0; i < N * N && ok; i++) {
+            if (sscanf(p, "%d%n", &b->grid[i / N][i % N], &used) != 1) ok = 0;
+            p += used;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%d: expected label and 16 tile values\n", path, lineno);
+            continue;
+        }
+        while (*p == ' ' || *p == '\t') p++;
+        snprintf(b->extra, sizeof b->extra, "%s", p);
+        b->extra[strcspn(b->extra, "\r\n")] = '\0';
+        n++;
+    }
+    fclose(f);
+    if (!boards) {
+        fprintf(stderr, "out of memory loading %s\n", path);
+        return NULL;
+    }
+    *n_out = n;
+    return boards;
+}
+
+static inline int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of v[0..n); sorts v in place. */
+static inline double percentile(double *v, int n, double pct) {
+    if (n <= 0) return 0;
+    qsort(v, n, sizeof(double), cmp_double);
+    int idx = (int)ceil(pct / 100.0 * n) - 1;
+    if (idx < 0) idx = 0;
+    if (idx >= n) idx = n - 1;
+    return v[idx];
+}
+
+#endif /* BENCH_COMMON_H */
@@ -0,0 +1,306 @@
+/*
+ * End-to-end decision latency benchmark: runs the full root decision (search_root) on every board
+ * of bench/decision_boards.txt and reports, per empty-count / max-tile bucket, latency percentiles,
+ * nodes/sec and the depth reached, and checks the chosen moves against the recorded reference.
+ *
+ * Build: gcc -O3 -march=native -o bench_decision bench_decision.c -lm -lpthread
+ * Run:   ./bench_decision [--corpus bench/decision_boards.txt] [--limit N] [--out FILE]
+ *                         [--policy depth_low depth_high serious_empty serious_max_tile max_empty_samples timeout_sec]
+ *                         [--threads N] [--sweep-threads MAX] [--eval heuristic|ntuple:PATH] [--perf]
+ *                         [--weights eval_weights.json]
+ *        ./bench_decision --record OUT   (re-record the reference moves under the current policy)
+ *
+ * The default policy is the corpus' "# policy:" line, i.e. what the reference moves were recorded with.
+ * The reference moves were recorded with the default heuristic weights; under --eval ntuple or --weights
+ * they are informational.
+ * With a timeout the search depth depends on wall time, so move mismatches are reported but not fatal;
+ * with timeout 0 any mismatch makes the exit code 1.
+ * Latency is in-process search time: it includes clearing the caches but not spawning the binary.
+ *
+ * Output (TSV): bucket n p50_ms p90_ms p99_ms max_ms nodes_per_sec depth_min depth_mean depth_max mismatches
+ * With --perf, per-node hardware counter rates follow (see print_perf_report in strategy_2048.c):
+ * cycles_per_node ipc llc_misses_per_node dtlb_misses_per_node branch_misses_per_node task_clock_ns_per_node
+ * ("-" where the host has no such counter).
+ *
+ * --sweep-threads MAX runs the corpus once per thread count 1..MAX (0 = the engine default) and prints
+ * threads total_s p50_ms p99_ms nodes_per_sec speedup efficiency move_diffs, where speedup is
+ * total time at 1 thread over total time at T threads, efficiency = speedup / T, and move_diffs counts
+ * boards whose move differs from the 1-thread run (always 0 without a timeout).
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "strategy_2048.c"
+#include "bench_common.h"
+
+typedef struct {
+    const char *bucket;
+    int n;
+    double *lat_ms;
+    double seconds;
+    unsigned long long nodes;
+    int depth_min, depth_max;
+    long depth_sum;
+    int mismatches, checked;
+    perf_counts_t perf;
+} bucket_stats_t;
+
+static int dir_from_name(const char *s) {
+    for (int d = 0; d < 4; d++)
+        if (strcmp(s, dir_name(d)) == 0) return d;
+    return -1;
+}
+
+/* Reads the "# policy: a b c d e f" line recorded in the corpus, if any. */
+static int corpus_policy(const char *path, int pol[6]) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[256];
+    int found = 0;
+    while (!found && fgets(line, sizeof line, f))
+        found = sscanf(line, "# policy: %d %d %d %d %d %d",
+                       &pol[0], &pol[1], &pol[2], &pol[3], &pol[4], &pol[5]) == 6;
+    fclose(f);
+    return found;
+}
+
+static void print_perf_columns(FILE *f, const bucket_stats_t *b) {
+    static const int cols[] = { PC_CYCLES, -1, PC_LLC_MISSES, PC_DTLB_MISSES, PC_BRANCH_MISSES, PC_TASK_CLOCK };
+    for (int k = 0; k < (int)(sizeof cols / sizeof cols[0]); k++) {
+        int c = cols[k];
+        if (c < 0) {
+            if (perf_available[PC_CYCLES] && perf_available[PC_INSTRUCTIONS] && b->perf.v[PC_CYCLES] > 0)
+                fprintf(f, "\t%.2f", b->perf.v[PC_INSTRUCTIONS] / b->perf.v[PC_CYCLES]);
+            else
+                fprintf(f, "\t-");
+        } else if (perf_available[c] && b->nodes > 0) {
+            fprintf(f, "\t%.3f", b->perf.v[c] / b->nodes);
+        } else {
+            fprintf(f, "\t-");
+        }
+    }
+}
+
+static void print_row(FILE *f, bucket_stats_t *b) {
+    double p50 = percentile(b->lat_ms, b->n, 50);
+    double p90 = percentile(b->lat_ms, b->n, 90);
+    double p99 = percentile(b->lat_ms, b->n, 99);
+    double mx = percentile(b->lat_ms, b->n, 100);
+    fprintf(f, "%s\t%d\t%.2f\t%.2f\t%.2f\t%.2f\t%.0f\t%d\t%.2f\t%d\t%d/%d",
+            b->bucket, b->n, p50, p90, p99, mx,
+            b->seconds > 0 ? b->nodes / b->seconds : 0,
+            b->depth_min, b->n ? (double)b->depth_sum / b->n : 0, b->depth_max,
+            b->mismatches, b->checked);
+    if (perf_enabled)
+        print_perf_columns(f, b);
+    fprintf(f, "\n");
+}
+
+
+static int sweep_threads(corpus_board_t *boards, int nboards, int timeout_sec, int max_threads, FILE *out) {
+    if (max_threads <= 0) max_threads = default_thread_count();
+    int *moves1 = (int *)malloc(nboards * sizeof(int));
+    double *lat_ms = (double *)malloc(nboards * sizeof(double));
+    double total1 = 0;
+    const char *header = "threads\ttotal_s\tp50_ms\tp99_ms\tnodes_per_sec\tspeedup\tefficiency\tmove_diffs";
+    printf("%s\n", header);
+    if (out) fprintf(out, "%s\n", header);
+    for (int t = 1; t <= max_threads; t++) {
+        caches_free();
+        nthreads = t;
+        if (caches_alloc() != 0) {
+            fprintf(stderr, "bench_decision: failed to allocate cache for %d threads\n", t);
+            break;
+        }
+        double total = 0;
+        unsigned long long nodes = 0;
+        int diffs = 0;
+        for (int i = 0; i < nboards; i++) {
+            double t0 = now_sec();
+            search_result_t res = search_root(boards[i].grid, timeout_sec * 1000);
+            double dt = now_sec() - t0;
+            lat_ms[i] = dt * 1000.0;
+            total += dt;
+            nodes += res.nodes;
+            if (t == 1) moves1[i] = res.dir;
+            else diffs += res.dir != moves1[i];
+        }
+        if (t == 1) total1 = total;
+        double speedup = total > 0 ? total1 / total : 0;
+        char row[256];
+        snprintf(row, sizeof row, "%d\t%.3f\t%.2f\t%.2f\t%.0f\t%.2f\t%.2f\t%d",
+                 t, total, percentile(lat_ms, nboards, 50), percentile(lat_ms, nboards, 99),
+                 total > 0 ? nodes / total : 0, speedup, speedup / t, diffs);
+        printf("%s\n", row);
+        if (out) fprintf(out, "%s\n", row);
+        fflush(stdout);
+    }
+    free(moves1);
+    free(lat_ms);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: bench_decision [--corpus PATH] [--limit N] [--out FILE] [--record OUT]\n"
+            "                      [--threads N] [--sweep-threads MAX] [--eval heuristic|ntuple:PATH] [--perf]\n"
+            "                      [--weights PATH]\n"
+            "                      [--policy depth_low depth_high serious_empty serious_max_tile max_empty_samples timeout_sec]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *corpus_path = "bench/decision_boards.txt";
+    const char *out_path = NULL, *record_path = NULL;
+    int limit = 0, have_policy = 0, sweep = -1, custom_weights = 0;
+    int pol[6] = { 4, 9, 5, 512, MAX_EMPTY_SAMPLES, 0 };
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--policy") == 0 && i + 6 < argc) {
+            for (int k = 0; k < 6; k++) pol[k] = atoi(argv[++i]);
+            have_policy = 1;
+            continue;
+        }
+        if (strcmp(a, "--perf") == 0) {
+            perf_enabled = 1;
+            continue;
+        }
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 2; }
+        if (strcmp(a, "--corpus") == 0) corpus_path = v;
+        else if (strcmp(a, "--limit") == 0) limit = atoi(v);
+        else if (strcmp(a, "--out") == 0) out_path = v;
+        else if (strcmp(a, "--record") == 0) record_path = v;
+        else if (strcmp(a, "--threads") == 0) nthreads = atoi(v);
+        else if (strcmp(a, "--sweep-threads") == 0) sweep = atoi(v);
+        else if (strcmp(a, "--eval") == 0) { if (eval_select(v) != 0) return 1; }
+        else if (strcmp(a, "--weights") == 0) {
+            if (eval_weights_load(v, &eval_w) != 0) return 1;
+            custom_weights = 1;
+        }
+        else { usage(); return 2; }
+        i++;
+    }
+
+    int ref_pol[6];
+    int have_ref_pol = corpus_policy(corpus_path, ref_pol);
+    if (!have_policy && have_ref_pol)
+        memcpy(pol, ref_pol, sizeof pol);
+    depth_low = pol[0];
+    depth_high = pol[1];
+    serious_empty = pol[2];
+    serious_max_tile = pol[3];
+    max_empty_samples = pol[4];
+    int timeout_sec = pol[5];
+    int same_policy = have_ref_pol && memcmp(pol, ref_pol, sizeof pol) == 0 &&
+                      leaf_eval == eval_grid && !custom_weights;
+
+    int nboards = 0;
+    corpus_board_t *boards = corpus_load(corpus_path, &nboards);
+    if (!boards || nboards == 0) return 1;
+    if (limit > 0 && limit < nboards) nboards = limit;
+
+    if (caches_alloc() != 0) {
+        fprintf(stderr, "bench_decision: failed to allocate cache\n");
+        return 1;
+    }
+    if (perf_enabled)
+        perf_probe();
+
+    if (sweep >= 0) {
+        fprintf(stderr, "bench_decision: thread sweep over %d boards, policy %d %d %d %d %d %d\n", nboards,
+                pol[0], pol[1], pol[2], pol[3], pol[4], pol[5]);
+        FILE *out = out_path ? fopen(out_path, "w") : NULL;
+        sweep_threads(boards, nboards, timeout_sec, sweep, out);
+        if (out) fclose(out);
+        caches_free();
+        free(boards);
+        return 0;
+    }
+
+    FILE *rec = NULL;
+    if (record_path) {
+        rec = fopen(record_path, "w");
+        if (!rec) {
+            fprintf(stderr, "cannot write %s\n", record_path);
+            return 1;
+        }
+        fprintf(rec, "# Decision benchmark corpus for bench_decision.\n"
+                     "# Format: <bucket> followed by 16 tile values (row-major) and the reference move.\n"
+                     "# Buckets: empties e0-2/e3-5/e6-9/e10+ x max tile m128 (<=128)/m256/m512/m1024 (>=1024).\n"
+                     "# policy: %d %d %d %d %d %d\n",
+                pol[0], pol[1], pol[2], pol[3], pol[4], pol[5]);
+    }
+
+    bucket_stats_t buckets[32];
+    int nbuckets = 0;
+    bucket_stats_t all = { .bucket = "all", .lat_ms = (double *)malloc(nboards * sizeof(double)), .depth_min = 1 << 30 };
+
+    fprintf(stderr, "bench_decision: %d boards, %d threads, policy %d %d %d %d %d %d%s\n", nboards, nthreads,
+            pol[0], pol[1], pol[2], pol[3], pol[4], pol[5],
+            same_policy ? " (reference policy)" : " (differs from reference; mismatches are informational)");
+    for (int i = 0; i < nboards; i++) {
+        corpus_board_t *cb = &boards[i];
+        int b = 0;
+        while (b < nbuckets && strcmp(buckets[b].bucket, cb->label) != 0) b++;
+        if (b == nbuckets) {
+            if (nbuckets == 32) continue;
+            bucket_stats_t fresh = { .bucket = cb->label, .lat_ms = (double *)malloc(nboards * sizeof(double)),
+                                     .depth_min = 1 << 30 };
+            buckets[nbuckets++] = fresh;
+        }
+
+        double t0 = now_sec();
+        search_result_t res = search_root(cb->grid, timeout_sec * 1000);
+        double dt = now_sec() - t0;
+
+        char ref[16] = "";
+        sscanf(cb->extra, "%15s", ref);
+        int ref_dir = ref[0] ? dir_from_name(ref) : -2;
+        int mismatch = ref_dir != -2 && !(ref_dir == res.dir || (ref_dir < 0 && res.dir < 0));
+
+        bucket_stats_t *targets[2] = { &buckets[b], &all };
+        for (int t = 0; t < 2; t++) {
+            bucket_stats_t *s = targets[t];
+            s->lat_ms[s->n++] = dt * 1000.0;
+            s->seconds += dt;
+            s->nodes += res.nodes;
+            perf_add(&s->perf, &res.perf);
+            s->depth_sum += res.depth;
+            if (res.depth < s->depth_min) s->depth_min = res.depth;
+            if (res.depth > s->depth_max) s->depth_max = res.depth;
+            if (ref_dir != -2) s->checked++;
+            s->mismatches += mismatch;
+        }
+        if (mismatch)
+            fprintf(stderr, "mismatch: board %d (%s) played %s, reference %s\n",
+                    i, cb->label, res.dir < 0 ? "none" : dir_name(res.dir), ref);
+        if (rec) {
+            fprintf(rec, "%s", cb->label);
+            for (int k = 0; k < N * N; k++) fprintf(rec, " %d", cb->grid[k / N][k % N]);
+            fprintf(rec, " %s\n", res.dir < 0 ? "none" : dir_name(res.dir));
+        }
+    }
+    if (rec) fclose(rec);
+
+    FILE *out = out_path ? fopen(out_path, "w") : NULL;
+    const char *header = "bucket\tn\tp50_ms\tp90_ms\tp99_ms\tmax_ms\tnodes_per_sec\tdepth_min\tdepth_mean\tdepth_max\tmismatches";
+    const char *perf_header = perf_enabled ? "\tcycles_per_node\tipc\tllc_misses_per_node\tdtlb_misses_per_node"
+                                             "\tbranch_misses_per_node\ttask_clock_ns_per_node" : "";
+    printf("%s%s\n", header, perf_header);
+    if (out) fprintf(out, "%s%s\n", header, perf_header);
+    for (int b = 0; b < nbuckets; b++) {
+        print_row(stdout, &buckets[b]);
+        if (out) print_row(out, &buckets[b]);
+        free(buckets[b].lat_ms);
+    }
+    print_row(stdout, &all);
+    if (out) {
+        print_row(out, &all);
+        fclose(out);
+    }
+
+    int failed = all.mismatches > 0 && same_policy && timeout_sec == 0 && !record_path;
+    free(all.lat_ms);
+    caches_free();
+    free(boards);
+    return failed ? 1 : 0;
+}
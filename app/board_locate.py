@@ -0,0 +1,169 @@
+"""
+Automatic board calibration: find the 4x4 grid in a full-screen capture, keep the result as a
+calibration profile per screen geometry, and check a saved profile on the next start instead of
+asking the operator to hover over four points.
+
+detect_board(rgb) marks every pixel whose color is a known tile color (the empty tile (180,162,142)
+and the rest of TILE_COLORS, through the color cube) and scans each screen row for four runs of the
+same length separated by three equal gaps: a row through a row of tiles, above or below the numbers.
+The most common (left edge, pitch) among those rows fixes the columns; the rows holding it fall into
+four bands one pitch apart, whose centers fix the rows. Sample offsets are put in the upper left of
+each tile, away from the number.
+
+verify_region(region) grabs just the board: every sample patch must be a known tile color and the
+gap between neighbouring tiles must not be.
+
+Profiles live in calibration_profiles.json next to this file, keyed by screen size ("1920x1080").
+"""
+
+import json
+import os
+from typing import List, Optional, Tuple
+
+import numpy as np
+import pyautogui
+
+import board_vision
+from board_vision import BOARD_SIZE, BoardRegion
+
+PROFILES_PATH = os.path.join(os.path.dirname(__file__), "calibration_profiles.json")
+MIN_TILE = 20  # px; smaller runs are not tiles
+
+
+def _row_hits(row_mask: np.ndarray, tol: float) -> List[Tuple[int, float, float]]:
+    # (first run start, run length, gap) of every 4 equal runs with 3 equal gaps in one row.
+    padded = np.concatenate(([False], row_mask, [False]))
+    edges = np.flatnonzero(padded[1:] != padded[:-1])
+    starts, ends = edges[0::2], edges[1::2]
+    lens = ends - starts
+    hits = []
+    for i in range(len(starts) - BOARD_SIZE + 1):
+        tiles = lens[i : i + BOARD_SIZE]
+        gaps = starts[i + 1 : i + BOARD_SIZE] - ends[i : i + BOARD_SIZE - 1]
+        s, g = tiles.mean(), gaps.mean()
+        if s < MIN_TILE or not 0 < g < s:
+            continue
+        if (np.abs(tiles - s) <= tol * s).all() and (np.abs(gaps - g) <= max(2.0, tol * s)).all():
+            hits.append((int(starts[i]), float(s), float(g)))
+    return hits
+
+
+def detect_board(rgb: np.ndarray, tol: float = 0.06) -> Optional[BoardRegion]:
+    """Board region in an (h, w, 3) RGB screen image (pixel coordinates), or None."""
+    h, w, _ = rgb.shape
+    _, dists = board_vision.closest_tile_values(rgb.reshape(-1, 3))
+    mask = (dists <= board_vision.COLOR_DIST_THRESHOLD).reshape(h, w)
+
+    hits = []  # (y, x0, tile, gap)
+    for y in range(h):
+        if mask[y].sum() >= BOARD_SIZE * MIN_TILE:
+            hits += [(y, x0, s, g) for x0, s, g in _row_hits(mask[y], tol)]
+    if not hits:
+        return None
+
+    # Columns: the (left edge, pitch) most rows agree on, within 2 px.
+    keys = np.array([(x0, s + g) for _, x0, s, g in hits])
+    support = [int(((np.abs(keys[:, 0] - x0) <= 2) & (np.abs(keys[:, 1] - p) <= 2)).sum()) for x0, p in keys]
+    x0, pitch = keys[int(np.argmax(support))]
+    rows = [(y, s) for y, hx, s, g in hits if abs(hx - x0) <= 2 and abs(s + g - pitch) <= 2]
+    tile = float(np.median([s for _, s in rows]))
+    ys = np.array([y for y, _ in rows])
+
+    # Rows: four bands one pitch apart; each band's center is the middle of its first and last hit.
+    top = ys.min() - (pitch - tile) / 2.0
+    centers = []
+    for k in range(BOARD_SIZE):
+        band = ys[(ys >= top + k * pitch) & (ys < top + (k + 1) * pitch)]
+        if not len(band):
+            return None
+        centers.append((band.min() + band.max()) / 2.0)
+    spacing = np.diff(centers)
+    if (np.abs(spacing - pitch) > max(3.0, tol * pitch)).any():
+        return None
+
+    cx0 = x0 + tile / 2.0
+    cy0 = float(np.mean([c - k * pitch for k, c in enumerate(centers)]))
+    box = int(max(4, min(24, 0.3 * tile)))
+    return BoardRegion(
+        left=int(round(cx0 - pitch / 2.0)),
+        top=int(round(cy0 - pitch / 2.0)),
+        width=int(round(pitch * BOARD_SIZE)),
+        height=int(round(pitch * BOARD_SIZE)),
+        sample_dx=round(-0.25 * tile, 1),
+        sample_dy=round(-0.25 * tile, 1),
+        sample_box=box,
+    )
+
+
+def verify_region(region: BoardRegion, img=None) -> bool:
+    """True if every sample patch in the region is a known tile color and the gaps between tiles are
+    not (a region shifted by half a tile or more fails the second test)."""
+    if img is None:
+        img = board_vision.grab_board_image(region)
+    _, dists = board_vision.closest_tile_values(board_vision.patch_means(img, region))
+    if (dists > board_vision.COLOR_DIST_THRESHOLD).any():
+        return False
+    gaps = []
+    for r in range(BOARD_SIZE):
+        y = int(round((r + 0.5) * region.cell_h + region.sample_dy))
+        for c in range(1, BOARD_SIZE):
+            gaps.append(board_vision.sample_patch_mean_rgb(img, int(round(c * region.cell_w)), y, 2))
+    _, dists = board_vision.closest_tile_values(np.array(gaps))
+    return bool((dists > board_vision.COLOR_DIST_THRESHOLD).all())
+
+
+def screen_key() -> str:
+    width, height = pyautogui.size()
+    return f"{width}x{height}"
+
+
+def load_profile(key: str, path: str = PROFILES_PATH) -> Optional[BoardRegion]:
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            entry = json.load(f).get(key)
+        return BoardRegion(**entry) if entry else None
+    except (OSError, ValueError, TypeError, AttributeError):
+        return None
+
+
+def save_profile(key: str, region: BoardRegion, path: str = PROFILES_PATH) -> None:
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            data = json.load(f)
+        if not isinstance(data, dict):
+            data = {}
+    except (OSError, ValueError):
+        data = {}
+    data[key] = {
+        "left": region.left,
+        "top": region.top,
+        "width": region.width,
+        "height": region.height,
+        "sample_dx": region.sample_dx,
+        "sample_dy": region.sample_dy,
+        "sample_box": region.sample_box,
+    }
+    try:
+        with open(path, "w", encoding="utf-8") as f:
+            json.dump(data, f, indent=2)
+    except OSError as e:
+        print(f"Warning: could not save {path}: {e}")
+
+
+def locate_board() -> Optional[BoardRegion]:
+    """The saved profile for this screen if the board is still there, else a fresh detection on a
+    full-screen capture (saved as the new profile), else None."""
+    key = screen_key()
+    region = load_profile(key)
+    if region is not None:
+        if verify_region(region):
+            print(f"Using calibration profile for {key}: {region}")
+            return region
+        print(f"Calibration profile for {key} does not match the screen; detecting the board again.")
+    region = detect_board(np.array(pyautogui.screenshot())[:, :, :3])
+    if region is None or not verify_region(region):
+        print("Could not find the board on screen.")
+        return None
+    print(f"Found the board: {region}")
+    save_profile(key, region)
+    return region
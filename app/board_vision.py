@@ -8,16 +8,20 @@ import json
 import os
 import time
 from dataclasses import dataclass
-from typing import List, Tuple
+from functools import lru_cache
+from typing import Callable, List, Optional, Sequence, Tuple
 
 import numpy as np
 import pyautogui
 
+from color_cube import ColorCube
+from stage_trace import TRACE
+
 
 BOARD_SIZE = 4
 
 
-@dataclass
+@dataclass(frozen=True)
 class BoardRegion:
     left: int
     top: int
@@ -47,6 +51,11 @@ COLORS_JSON_PATH = os.path.join(os.path.dirname(__file__), "2048_colors.json")
 # Squared RGB distance: higher = accept more variation (2 tile often has gradient/text)
 COLOR_DIST_THRESHOLD = 35 ** 2
 JUST_LEARNED_COLOR = False
+# TILE_COLORS as a 64³ RGB lookup table; re-synced whenever the palette changes.
+COLOR_CUBE = ColorCube(bits=6)
+# classify_board_incremental outcomes: boards confirmed from the spawn cells, and fallbacks to a full read.
+INCREMENTAL_STATS = {"hit": 0, "fallback": 0}
+_spot_cursor = 0
 
 
 def load_saved_colors() -> None:
@@ -57,6 +66,7 @@ def load_saved_colors() -> None:
             data = json.load(f)
         loaded = {int(k): tuple(map(int, v)) for k, v in data.items()}
         TILE_COLORS.update(loaded)
+        COLOR_CUBE.sync(TILE_COLORS)
         if loaded:
             print(f"Loaded {len(loaded)} saved tile colors from 2048_colors.json")
     except FileNotFoundError:
@@ -66,7 +76,8 @@ def load_saved_colors() -> None:
 
 
 def save_colors() -> None:
-    """Persist current TILE_COLORS to JSON."""
+    """Persist current TILE_COLORS to JSON (and bring the color cube up to date with it)."""
+    COLOR_CUBE.sync(TILE_COLORS)
     try:
         serializable = {str(k): list(v) for k, v in TILE_COLORS.items()}
         with open(COLORS_JSON_PATH, "w", encoding="utf-8") as f:
@@ -139,14 +150,26 @@ def calibrate_board() -> BoardRegion:
     return region
 
 
+def parse_region(spec: str) -> BoardRegion:
+    """BoardRegion from "left,top,width,height[,sample_dx,sample_dy[,sample_box]]"."""
+    parts = [float(x) for x in spec.replace(" ", "").split(",")]
+    if len(parts) < 4:
+        raise ValueError(f"board region needs left,top,width,height: {spec!r}")
+    left, top, width, height = (int(round(x)) for x in parts[:4])
+    dx, dy = (parts[4], parts[5]) if len(parts) >= 6 else (0.0, 0.0)
+    box = int(parts[6]) if len(parts) >= 7 else BoardRegion.sample_box
+    return BoardRegion(left, top, width, height, dx, dy, box)
+
+
 def grab_board_image(region: BoardRegion):
-    shot = pyautogui.screenshot(
-        region=(region.left, region.top, region.width, region.height)
-    )
-    img = np.array(shot)
-    if img.shape[2] == 4:
-        img = img[:, :, :3]
-    img = img[:, :, ::-1]
+    with TRACE.span("grab"):
+        shot = pyautogui.screenshot(
+            region=(region.left, region.top, region.width, region.height)
+        )
+        img = np.array(shot)
+        if img.shape[2] == 4:
+            img = img[:, :, :3]
+        img = img[:, :, ::-1]
     return img
 
 
@@ -175,19 +198,15 @@ def sample_patch_mean_rgb(board_bgr, cx: int, cy: int, box: int) -> Tuple[float,
     return float(mean[0]), float(mean[1]), float(mean[2])
 
 
+def closest_tile_values(rgb) -> Tuple[np.ndarray, np.ndarray]:
+    """Nearest tile values and squared RGB distances for an (N, 3) array of colors (color cube)."""
+    COLOR_CUBE.sync(TILE_COLORS)
+    return COLOR_CUBE.lookup(rgb)
+
+
 def closest_tile_value(rgb: Tuple[float, float, float]) -> Tuple[int, float]:
-    r, g, b = rgb
-    best_val = 0
-    best_dist = float("inf")
-    for val, (tr, tg, tb) in TILE_COLORS.items():
-        dr = r - tr
-        dg = g - tg
-        db = b - tb
-        dist = dr * dr + dg * dg + db * db
-        if dist < best_dist:
-            best_dist = dist
-            best_val = val
-    return best_val, best_dist
+    vals, dists = closest_tile_values(rgb)
+    return int(vals[0]), float(dists[0])
 
 
 def classify_or_learn_tile(
@@ -229,21 +248,165 @@ def classify_or_learn_tile(
 
 
 def read_board(region: BoardRegion) -> List[List[int]]:
-    img = grab_board_image(region)
+    return classify_board(grab_board_image(region), region)
+
+
+def sample_point(region: BoardRegion, r: int, c: int) -> Tuple[int, int]:
+    """Center of cell (r, c)'s sample patch, in board-region pixels."""
+    cell_cx = int(round((c + 0.5) * region.cell_w))
+    cell_cy = int(round((r + 0.5) * region.cell_h))
+    return int(round(cell_cx + region.sample_dx)), int(round(cell_cy + region.sample_dy))
+
+
+def cell_rgb(img, region: BoardRegion, r: int, c: int) -> Tuple[float, float, float]:
+    """Mean RGB of the sample patch of cell (r, c) in a board image from grab_board_image."""
+    sample_x, sample_y = sample_point(region, r, c)
+    return sample_patch_mean_rgb(img, sample_x, sample_y, region.sample_box)
+
+
+ALL_CELLS = tuple((r, c) for r in range(BOARD_SIZE) for c in range(BOARD_SIZE))
+
+
+@lru_cache(maxsize=8)
+def _patch_index(region: BoardRegion, shape, cells):
+    # Pixel indices (into the image flattened to (h * w, 3)) of every cell's sample patch, one row
+    # per cell, and the (patch * 3, 3) matrix that turns a row of BGR bytes into its mean RGB.
+    # None if a patch is clipped by the image border (then patches are cut one by one).
+    h, w = shape[:2]
+    half = max(1, region.sample_box // 2)
+    rows = []
+    for r, c in cells:
+        cx, cy = sample_point(region, r, c)
+        if cx - half < 0 or cy - half < 0 or cx + half > w or cy + half > h:
+            return None
+        ys, xs = np.mgrid[cy - half : cy + half, cx - half : cx + half]
+        rows.append((ys * w + xs).ravel())
+    n = (2 * half) ** 2
+    to_rgb = np.tile(np.eye(3, dtype=np.float32)[::-1], (n, 1)) / n
+    return np.array(rows), to_rgb
+
+
+def patch_means(img, region: BoardRegion, cells: Sequence[Tuple[int, int]] = ALL_CELLS) -> np.ndarray:
+    """(len(cells), 3) mean RGB of the cells' sample patches (cell_rgb for all of them in one pass)."""
+    index = _patch_index(region, img.shape, tuple(cells))
+    if index is None:
+        return np.array([cell_rgb(img, region, r, c) for r, c in cells], dtype=np.float64).reshape(-1, 3)
+    pixels, to_rgb = index
+    patches = img.reshape(-1, 3)[pixels]  # (cells, patch, 3) BGR
+    return patches.reshape(len(pixels), -1).astype(np.float32) @ to_rgb
+
+
+def classify_board(img, region: BoardRegion) -> List[List[int]]:
+    """Tile values of a board image from grab_board_image (may ask about unknown colors)."""
+    return classify_means(patch_means(img, region))
+
+
+def classify_means(means: np.ndarray) -> List[List[int]]:
+    """Tile values from the 16 patch means (ALL_CELLS order, RGB) (may ask about unknown colors)."""
     grid: List[List[int]] = [[0] * BOARD_SIZE for _ in range(BOARD_SIZE)]
 
-    for r in range(BOARD_SIZE):
-        for c in range(BOARD_SIZE):
-            cell_cx = int(round((c + 0.5) * region.cell_w))
-            cell_cy = int(round((r + 0.5) * region.cell_h))
-            sample_x = int(round(cell_cx + region.sample_dx))
-            sample_y = int(round(cell_cy + region.sample_dy))
-            rgb = sample_patch_mean_rgb(img, sample_x, sample_y, region.sample_box)
-            val = classify_or_learn_tile(rgb, r, c)
-            grid[r][c] = val
+    with TRACE.span("classify"):
+        vals, dists = closest_tile_values(means)
+        for i, (r, c) in enumerate(ALL_CELLS):
+            if dists[i] <= COLOR_DIST_THRESHOLD:
+                grid[r][c] = int(vals[i])
+            else:
+                grid[r][c] = classify_or_learn_tile(tuple(float(x) for x in means[i]), r, c)
+    return grid
+
+
+def classify_means_known(means: np.ndarray) -> Optional[List[List[int]]]:
+    """classify_means without the prompt: None when any cell's color is not a known tile (a frame taken
+    mid-slide, the bare board background, a color not learned yet)."""
+    with TRACE.span("classify"):
+        vals, dists = closest_tile_values(means)
+        if (dists > COLOR_DIST_THRESHOLD).any():
+            return None
+        return [[int(v) for v in vals[r * BOARD_SIZE : (r + 1) * BOARD_SIZE]] for r in range(BOARD_SIZE)]
+
+
+def _read_spawn(means_of, expected: List[List[int]]) -> Optional[List[List[int]]]:
+    # `expected` plus the one 2 or 4 read from its empty cells, or None.
+    empty = [(r, c) for r, c in ALL_CELLS if expected[r][c] == 0]
+    if not empty:
+        return None
+    vals, dists = closest_tile_values(means_of(empty))
+    if (dists > COLOR_DIST_THRESHOLD).any():
+        return None
+    new = np.flatnonzero(vals)
+    if len(new) != 1 or vals[new[0]] not in (2, 4):
+        return None
+    grid = [row[:] for row in expected]
+    r, c = empty[new[0]]
+    grid[r][c] = int(vals[new[0]])
     return grid
 
 
+def classify_board_incremental(
+    means_of: Callable[[Sequence[Tuple[int, int]]], np.ndarray],
+    expected: List[List[int]],
+    spot_checks: int = 3,
+) -> Optional[List[List[int]]]:
+    """
+    The board after a move, read from the cells that can have changed (means_of(cells) gives their
+    patch means, e.g. Capture.means on a frame): `expected` is the board the
+    move must produce (before the spawn), so only its empty cells are classified, one of them must
+    hold a new 2 or 4 and the rest must be empty. `spot_checks` occupied cells, taken in turn so
+    every cell is checked every few steps, must also match. None when anything disagrees (a misread,
+    a frame mid-animation, an unknown color, a different game), in which case the caller does a full
+    classify_board; this never asks about colors.
+    """
+    global _spot_cursor
+
+    with TRACE.span("classify.incremental"):
+        grid = _read_spawn(means_of, expected)
+        occupied = [(r, c) for r in range(BOARD_SIZE) for c in range(BOARD_SIZE) if expected[r][c]]
+        if grid is not None and occupied:
+            n = min(spot_checks, len(occupied))
+            cells = [occupied[(_spot_cursor + i) % len(occupied)] for i in range(n)]
+            vals, dists = closest_tile_values(means_of(cells))
+            want = [expected[r][c] for r, c in cells]
+            if (vals != want).any() or (dists > COLOR_DIST_THRESHOLD).any():
+                grid = None
+            _spot_cursor += spot_checks
+
+    INCREMENTAL_STATS["hit" if grid is not None else "fallback"] += 1
+    return grid
+
+
+class ScreenCapture:
+    """pyautogui screenshot of the board region; frames are BGR images (grab_board_image)."""
+
+    name = "pyautogui"
+
+    def __init__(self, region: BoardRegion):
+        self.region = region
+
+    def grab(self):
+        return grab_board_image(self.region)
+
+    def means(self, frame, cells: Sequence[Tuple[int, int]] = ALL_CELLS) -> np.ndarray:
+        return patch_means(frame, self.region, cells)
+
+    def close(self) -> None:
+        pass
+
+
+def open_capture(region: BoardRegion, backend: str = "auto"):
+    """Board capture for the play loop: grab() -> frame, means(frame, cells) -> (len(cells), 3) RGB.
+    "x11" = capture_x11 (X connection kept open, patch means in C), "pyautogui" = ScreenCapture,
+    "auto" = x11 when the library and a display are there, else pyautogui."""
+    if backend in ("auto", "x11"):
+        try:
+            from capture_x11 import X11Capture
+
+            return X11Capture(region)
+        except OSError as e:
+            if backend == "x11":
+                print(f"Warning: X11 capture unavailable ({e}); using pyautogui.")
+    return ScreenCapture(region)
+
+
 def print_board(grid: List[List[int]]) -> None:
     print("\nBoard:")
     for row in grid:
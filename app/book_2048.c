@@ -0,0 +1,243 @@
+/*
+ * Position book builder for strategy_2048 --book: creates a book, fills it offline with deep searches of
+ * the positions that recur in game records (openings and repeated boards), and reports its contents and
+ * lookup speed.
+ *
+ * Build: gcc -O3 -march=native -o book_2048 book_2048.c -lm -lpthread
+ * Run:   ./book_2048 --create book.bin [--bits 20]
+ *        ./book_2048 --fill book.bin [--bits 20] [--depth 8] [--opening 40] [--min-count 2] [--threads N]
+ *                    [--cache-bits 22] [--samples 10] [--weights eval_weights.json]
+ *                    [--eval heuristic|ntuple:PATH] games.rec [more.rec ...]
+ *        ./book_2048 --stats book.bin
+ *
+ * The evaluator options must match the ones strategy_2048 runs with, or the engine ignores the book.
+ * --fill takes every position of the records up to move --opening, plus any position that occurs at
+ * least --min-count times (up to symmetry), drops those the book already has at --depth or deeper, and
+ * searches the rest on their canonical board at --depth, most frequent first, one position per thread
+ * (search_fixed_depth on a per-thread table of 2^cache-bits entries). Results are stored as they finish,
+ * so an interrupted fill keeps what it has. A missing book is created with 2^bits slots.
+ *
+ * Output (stdout, one line): --fill: book_fill candidates= searched= stored= full= seconds=
+ * positions_per_sec=; --stats: book slots= entries= load= min_depth= max_depth= mean_depth= probe_ns=.
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "strategy_2048.c"
+#include "bench_common.h"
+#include "game_record.h"
+
+typedef struct {
+    board_t key;       /* canonical board */
+    uint32_t step;     /* earliest move number it was seen at */
+    uint32_t count;
+} book_candidate_t;
+
+static book_t book;
+static book_candidate_t *todo;
+static size_t ntodo;
+static int fill_depth = 8;
+static int next_todo; /* atomic */
+static long stored, full;
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int cmp_key(const void *a, const void *b) {
+    board_t x = ((const book_candidate_t *)a)->key, y = ((const book_candidate_t *)b)->key;
+    return (x > y) - (x < y);
+}
+
+static int cmp_count_desc(const void *a, const void *b) {
+    uint32_t x = ((const book_candidate_t *)a)->count, y = ((const book_candidate_t *)b)->count;
+    return (x < y) - (x > y);
+}
+
+/* Every position of a record file, canonicalized, appended to *c. Returns 0 or -1. */
+static int collect_positions(const char *path, book_candidate_t **c, size_t *n, size_t *cap) {
+    gr_file_t f;
+    if (gr_open(path, &f) != 0) return -1;
+    size_t off = 0;
+    gr_game_t g;
+    while (gr_next_game(&f, &off, &g)) {
+        board_t b = g.h.initial;
+        for (uint32_t i = 0; i <= g.h.nsteps; i++) {
+            if (*n == *cap) {
+                *cap = *cap ? 2 * *cap : 65536;
+                if (!(*c = (book_candidate_t *)realloc(*c, *cap * sizeof **c))) {
+                    fprintf(stderr, "book_2048: out of memory\n");
+                    exit(1);
+                }
+            }
+            int k;
+            (*c)[(*n)++] = (book_candidate_t){ book_canonical(b, &k), i, 1 };
+            if (i < g.h.nsteps) {
+                int gained;
+                b = gr_apply_step(b, gr_step_code(&g, i), &gained);
+            }
+        }
+    }
+    gr_close(&f);
+    return 0;
+}
+
+static void *fill_worker(void *arg) {
+    current_cache = (cache_entry_t *)arg;
+    for (;;) {
+        size_t i = (size_t)__atomic_fetch_add(&next_todo, 1, __ATOMIC_RELAXED);
+        if (i >= ntodo) break;
+        grid_t g;
+        unpack_grid(todo[i].key, g);
+        double value;
+        int dir = search_fixed_depth(g, fill_depth, &value);
+        if (dir < 0) continue;
+        pthread_mutex_lock(&store_lock);
+        if (book_store(&book, todo[i].key, dir, value, fill_depth) == 0) stored++;
+        else full++;
+        pthread_mutex_unlock(&store_lock);
+    }
+    return NULL;
+}
+
+static int do_fill(const char *path, int slot_bits, int opening, int min_count, int cache_bits, char **files,
+                   int nfiles) {
+    if (access(path, F_OK) != 0 && book_create(path, slot_bits) != 0) return 1;
+    if (book_open(path, 1, &book) != 0) return 1;
+
+    book_candidate_t *c = NULL;
+    size_t n = 0, cap = 0;
+    for (int i = 0; i < nfiles; i++)
+        if (collect_positions(files[i], &c, &n, &cap) != 0) return 1;
+    qsort(c, n, sizeof *c, cmp_key);
+    size_t m = 0;
+    for (size_t i = 0; i < n;) {
+        book_candidate_t agg = c[i];
+        size_t j = i + 1;
+        for (; j < n && c[j].key == agg.key; j++) {
+            agg.count++;
+            if (c[j].step < agg.step) agg.step = c[j].step;
+        }
+        i = j;
+        int dir, depth;
+        double value;
+        if (!agg.key || ((int)agg.step >= opening && (int)agg.count < min_count)) continue;
+        if (book_probe(&book, agg.key, &dir, &value, &depth) && depth >= fill_depth) continue;
+        c[m++] = agg;
+    }
+    qsort(c, m, sizeof *c, cmp_count_desc);
+    todo = c;
+    ntodo = m;
+    fprintf(stderr, "book_2048: %zu positions in the records, %zu to search at depth %d, %d threads\n", n, m,
+            fill_depth, nthreads);
+
+    cache_size = 1ULL << cache_bits;
+    double t0 = now_sec();
+    pthread_t threads[MAX_THREADS];
+    int nt = (size_t)nthreads < m ? nthreads : (int)m;
+    for (int t = 0; t < nt; t++) {
+        if (!(caches[t] = (cache_entry_t *)calloc(cache_size, sizeof(cache_entry_t)))) {
+            fprintf(stderr, "book_2048: failed to allocate cache\n");
+            return 1;
+        }
+        pthread_create(&threads[t], NULL, fill_worker, caches[t]);
+    }
+    for (int t = 0; t < nt; t++) {
+        pthread_join(threads[t], NULL);
+        free(caches[t]);
+    }
+    double elapsed = now_sec() - t0;
+    msync(book.h, book.size, MS_SYNC);
+    printf("book_fill candidates=%zu searched=%zu stored=%ld full=%ld seconds=%.2f positions_per_sec=%.2f\n", n, m,
+           stored, full, elapsed, elapsed > 0 ? m / elapsed : 0.0);
+    book_close(&book);
+    free(c);
+    return 0;
+}
+
+static int do_stats(const char *path) {
+    if (book_open(path, 0, &book) != 0) return 1;
+    unsigned long long slots = book.mask + 1, entries = 0, depth_sum = 0;
+    int min_depth = 255, max_depth = 0;
+    board_t *keys = (board_t *)malloc(4096 * sizeof(board_t));
+    int nkeys = 0;
+    for (unsigned long long i = 0; i < slots; i++) {
+        const book_entry_t *e = &book.slots[i];
+        if (!e->key) continue;
+        entries++;
+        depth_sum += e->depth;
+        if (e->depth < min_depth) min_depth = e->depth;
+        if (e->depth > max_depth) max_depth = e->depth;
+        if (nkeys < 4096) keys[nkeys++] = e->key;
+    }
+    /* Lookup time of stored boards, asked in a random orientation (hits, warm). */
+    double probe_ns = 0;
+    if (nkeys) {
+        int iters = 1 << 20, hits = 0, dir, depth;
+        double value;
+        unsigned long long rng = 1;
+        double t0 = now_sec();
+        for (int i = 0; i < iters; i++) {
+            rng = mix64(rng + (unsigned long long)i);
+            hits += book_probe(&book, book_sym(keys[rng % nkeys], (int)(rng >> 61)), &dir, &value, &depth);
+        }
+        probe_ns = (now_sec() - t0) * 1e9 / iters;
+        if (hits != iters) fprintf(stderr, "book_2048: %d of %d probes missed\n", iters - hits, iters);
+    }
+    printf("book slots=%llu entries=%llu load=%.4f min_depth=%d max_depth=%d mean_depth=%.2f probe_ns=%.1f\n",
+           slots, entries, (double)entries / slots, entries ? min_depth : 0, max_depth,
+           entries ? (double)depth_sum / entries : 0.0, probe_ns);
+    free(keys);
+    book_close(&book);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: book_2048 --create PATH [--bits B]\n"
+            "       book_2048 --fill PATH [--bits B] [--depth D] [--opening N] [--min-count N] [--threads N]\n"
+            "                 [--cache-bits B] [--samples N] [--weights PATH] [--eval heuristic|ntuple:PATH]\n"
+            "                 FILE.rec [FILE.rec ...]\n"
+            "       book_2048 --stats PATH\n");
+}
+
+int main(int argc, char **argv) {
+    const char *mode = NULL, *path = NULL;
+    int slot_bits = 20, opening = 40, min_count = 2, cache_bits = 22, i;
+    for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 2; }
+        if (strcmp(a, "--create") == 0 || strcmp(a, "--fill") == 0 || strcmp(a, "--stats") == 0) {
+            mode = a + 2;
+            path = v;
+        }
+        else if (strcmp(a, "--bits") == 0) slot_bits = atoi(v);
+        else if (strcmp(a, "--depth") == 0) fill_depth = atoi(v);
+        else if (strcmp(a, "--opening") == 0) opening = atoi(v);
+        else if (strcmp(a, "--min-count") == 0) min_count = atoi(v);
+        else if (strcmp(a, "--threads") == 0) nthreads = atoi(v);
+        else if (strcmp(a, "--cache-bits") == 0) cache_bits = atoi(v);
+        else if (strcmp(a, "--samples") == 0) max_empty_samples = atoi(v);
+        else if (strcmp(a, "--weights") == 0) { if (eval_weights_load(v, &eval_w) != 0) return 1; }
+        else if (strcmp(a, "--eval") == 0) { if (eval_select(v) != 0) return 1; }
+        else { usage(); return 2; }
+    }
+    if (!mode || slot_bits < 10 || slot_bits > 32 || fill_depth < 1 || fill_depth > 255 || cache_bits < 10 ||
+        cache_bits > 28) {
+        usage();
+        return 2;
+    }
+    if (nthreads <= 0) nthreads = default_thread_count();
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    init_move_tables();
+
+    int rc;
+    if (strcmp(mode, "create") == 0)
+        rc = book_create(path, slot_bits) == 0 ? 0 : 1;
+    else if (strcmp(mode, "stats") == 0)
+        rc = do_stats(path);
+    else if (i < argc)
+        rc = do_fill(path, slot_bits, opening, min_count, cache_bits, argv + i, argc - i);
+    else {
+        usage();
+        rc = 2;
+    }
+    ntuple_unload(&eval_net);
+    return rc;
+}
@@ -4,24 +4,31 @@ Uses board_vision for calibration and reading the board (CV + color matching).
 Orchestrates: read board → get move (Python strategy or spawn C binary) → press key.
 """
 
+import json
 import os
+import select
 import subprocess
 import threading
 import time
-from typing import List, Optional, Tuple
+from typing import Dict, List, Optional, Tuple
 import abc
 
+import numpy as np
 import pyautogui
 from pynput import keyboard
 
+import board_locate
 import board_vision
+import key_input
+from game_record import LiveGameRecorder
+from play_pipeline import CaptureStage, FrameRing, InputStage, SettleModel, wait_for_stable_frame
+from stage_trace import TRACE
 from board_vision import (
     BOARD_SIZE,
     BoardRegion,
     calibrate_board,
     load_saved_colors,
     print_board,
-    read_board,
     wait_for_focus,
 )
 
@@ -38,22 +45,16 @@ def move_left(grid: Grid):
         row = grid[r]
         compressed = [v for v in row if v != 0]
         merged_row: List[int] = []
-        skip = False
         i = 0
         while i < len(compressed):
-            if not skip and i + 1 < len(compressed) and compressed[i] == compressed[i + 1]:
+            if i + 1 < len(compressed) and compressed[i] == compressed[i + 1]:
                 merged_val = compressed[i] * 2
                 total_score += merged_val
                 merged_row.append(merged_val)
-                skip = True
+                i += 2  # the second tile is used up by the merge
             else:
-                if not skip:
-                    merged_row.append(compressed[i])
-                skip = False
-            i += 1
-            if skip:
-                skip = False
-                i += 0
+                merged_row.append(compressed[i])
+                i += 1
         merged_row += [0] * (BOARD_SIZE - len(merged_row))
         new_grid[r] = merged_row
         if merged_row != row:
@@ -94,6 +95,12 @@ class Strategy(abc.ABC):
     def choose_move(self, grid: Grid) -> Optional[str]:
         raise NotImplementedError
 
+    def speculate(self, grid: Grid, direction: str) -> None:
+        """Called right after `direction` was pressed on `grid`, while the move animates."""
+
+    def close(self) -> None:
+        pass
+
 
 class HeuristicStrategy(Strategy):
     def _count_empty(self, grid: Grid) -> int:
@@ -187,6 +194,36 @@ class LookaheadStrategy(HeuristicStrategy):
         return best_dir
 
 
+EVAL_WEIGHTS_PATH = os.path.join(os.path.dirname(__file__), "eval_weights.json")
+RECORD_PATH = os.path.join(os.path.dirname(__file__), "records", "bot.rec")
+BOOK_PATH = os.path.join(os.path.dirname(__file__), "book.bin")
+# Same defaults as eval_w in strategy_2048.c; eval_weights.json overrides them for both engines.
+DEFAULT_EVAL_WEIGHTS = {
+    "empties": 15.0,
+    "corner": 2.5,
+    "mono": 4.0,
+    "smooth": 0.1,
+    "max_tile": 0.01,
+    "gamma": 0.95,
+}
+
+
+def load_eval_weights(path: str = EVAL_WEIGHTS_PATH) -> dict:
+    """Heuristic weights and gamma from eval_weights.json (missing file or keys => defaults)."""
+    weights = dict(DEFAULT_EVAL_WEIGHTS)
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            data = json.load(f)
+    except (OSError, ValueError):
+        return weights
+    if not isinstance(data, dict):
+        return weights
+    for key in weights:
+        if isinstance(data.get(key), (int, float)):
+            weights[key] = float(data[key])
+    return weights
+
+
 def _grid_key(grid: Grid):
     return tuple(tuple(row) for row in grid)
 
@@ -196,14 +233,16 @@ class ExpectimaxStrategy(HeuristicStrategy):
         self,
         depth_low: int = 4,
         depth_high: int = 8,
-        gamma: float = 0.95,
+        gamma: Optional[float] = None,
         max_empty_samples: int = 10,
         serious_empty_threshold: int = 5,
         serious_max_tile: int = 1024,
+        weights: Optional[dict] = None,
     ):
         self.depth_low = depth_low
         self.depth_high = depth_high
-        self.gamma = gamma
+        self.weights = {**DEFAULT_EVAL_WEIGHTS, **(weights or {})}
+        self.gamma = self.weights["gamma"] if gamma is None else gamma
         self.max_empty_samples = max_empty_samples
         self.serious_empty_threshold = serious_empty_threshold
         self.serious_max_tile = serious_max_tile
@@ -235,12 +274,13 @@ class ExpectimaxStrategy(HeuristicStrategy):
         mono = self._monotonicity_score(grid)
         smooth = self._smoothness_score(grid)
         max_val = self._max_tile(grid)
+        w = self.weights
         return (
-            empties * 15.0
-            + corner * 2.5
-            + mono * 4.0
-            + smooth * 0.1
-            + max_val * 0.01
+            empties * w["empties"]
+            + corner * w["corner"]
+            + mono * w["mono"]
+            + smooth * w["smooth"]
+            + max_val * w["max_tile"]
         )
 
     def _expectimax(self, grid: Grid, depth: int, is_max: bool) -> float:
@@ -323,7 +363,8 @@ class ExpectimaxStrategy(HeuristicStrategy):
 
 
 class CStrategy(Strategy):
-    """Spawns compiled strategy_2048 binary; passes grid via stdin, reads move from stdout."""
+    """Runs the compiled strategy_2048 binary: a persistent `--serve` process (serve=True) that searches
+    the possible spawns while the move animates, or one process per move, grid on stdin, move on stdout."""
 
     def __init__(
         self,
@@ -335,6 +376,13 @@ class CStrategy(Strategy):
         max_empty_samples: int = 10,
         timeout_seconds: float = 30.0,
         search_timeout_sec: int = 4,
+        threads: int = 0,
+        eval_spec: str = "",
+        weights_path: Optional[str] = None,
+        book_path: Optional[str] = None,
+        book_append: bool = False,
+        search: str = "",
+        serve: bool = False,
     ):
         if binary_path is None:
             binary_path = os.path.join(os.path.dirname(__file__), "strategy_2048")
@@ -346,14 +394,18 @@ class CStrategy(Strategy):
         self.max_empty_samples = max_empty_samples
         self.timeout_seconds = timeout_seconds
         self.search_timeout_sec = search_timeout_sec
-
-    def choose_move(self, grid: Grid) -> Optional[str]:
-        if not os.path.isfile(self.binary_path):
-            return None
-        grid_str = "\n".join(
-            " ".join(str(grid[r][c]) for c in range(BOARD_SIZE))
-            for r in range(BOARD_SIZE)
-        )
+        self.threads = threads  # 0 = engine default (CPUs in affinity mask / cgroup quota)
+        self.eval_spec = eval_spec  # "" = engine default (heuristic), or "ntuple:PATH"
+        self.weights_path = weights_path  # eval_weights.json for the heuristic; None = built-in defaults
+        self.book_path = book_path  # position book (book_2048.c); None = always search
+        self.book_append = book_append  # store every search result in the book
+        self.search = search  # "" = engine default (expectimax), or "mcts"
+        self.serve = serve  # keep one engine running and let it speculate (falls back to one-shot runs)
+        self._proc: Optional[subprocess.Popen] = None
+        self._last_source: Optional[str] = None  # --serve: hit / wait / partial / search / book
+        self.sources: Dict[str, int] = {}  # --serve answers per _last_source
+
+    def _argv(self) -> List[str]:
         argv = [
             self.binary_path,
             str(self.depth_low),
@@ -363,9 +415,79 @@ class CStrategy(Strategy):
             str(self.max_empty_samples),
             str(self.search_timeout_sec),
         ]
+        if self.threads > 0:
+            argv += ["--threads", str(self.threads)]
+        if self.eval_spec:
+            argv += ["--eval", self.eval_spec]
+        if self.weights_path:
+            argv += ["--weights", self.weights_path]
+        if self.search:
+            argv += ["--search", self.search]
+        if self.book_path:
+            argv += ["--book", self.book_path]
+            if self.book_append:
+                argv.append("--book-append")
+        return argv
+
+    def _served(self) -> Optional[subprocess.Popen]:
+        if self._proc is not None and self._proc.poll() is None:
+            return self._proc
+        try:
+            self._proc = subprocess.Popen(
+                self._argv() + ["--serve"],
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                text=True,
+                bufsize=1,
+                cwd=os.path.dirname(self.binary_path) or ".",
+            )
+        except OSError:
+            self._proc = None
+        return self._proc
+
+    def _request(self, line: str, reply: bool) -> Optional[str]:
+        proc = self._served()
+        if proc is None:
+            return None
+        try:
+            proc.stdin.write(line + "\n")
+            proc.stdin.flush()
+            if not reply:
+                return ""
+            ready, _, _ = select.select([proc.stdout], [], [], self.timeout_seconds)
+            out = proc.stdout.readline() if ready else ""
+        except OSError:
+            out = ""
+        if reply and not out:
+            self.close()  # hung or died: the next request starts a fresh engine
+            return None
+        return out
+
+    def speculate(self, grid: Grid, direction: str) -> None:
+        if self.serve and self._proc is not None:
+            cells = " ".join(str(grid[r][c]) for r in range(BOARD_SIZE) for c in range(BOARD_SIZE))
+            with TRACE.span("engine.speculate"):
+                self._request(f"speculate {cells} {direction}", reply=False)
+
+    def close(self) -> None:
+        proc, self._proc = self._proc, None
+        if proc is None:
+            return
+        try:
+            proc.stdin.write("quit\n")
+            proc.stdin.close()
+            proc.wait(timeout=2)
+        except (OSError, subprocess.TimeoutExpired):
+            proc.kill()
+
+    def _choose_one_shot(self, grid: Grid) -> str:
+        grid_str = "\n".join(
+            " ".join(str(grid[r][c]) for c in range(BOARD_SIZE))
+            for r in range(BOARD_SIZE)
+        )
         try:
             result = subprocess.run(
-                argv,
+                self._argv(),
                 input=grid_str,
                 capture_output=True,
                 text=True,
@@ -373,8 +495,26 @@ class CStrategy(Strategy):
                 cwd=os.path.dirname(self.binary_path) or ".",
             )
         except (subprocess.TimeoutExpired, FileNotFoundError, OSError):
+            return ""
+        return result.stdout or ""
+
+    def choose_move(self, grid: Grid) -> Optional[str]:
+        if not os.path.isfile(self.binary_path):
             return None
-        out = (result.stdout or "").strip().lower()
+        out = None
+        self._last_source = None
+        if self.serve:
+            cells = " ".join(str(grid[r][c]) for r in range(BOARD_SIZE) for c in range(BOARD_SIZE))
+            with TRACE.span("engine.search"):
+                out = self._request(f"search {cells}", reply=True)
+        if out is None:
+            with TRACE.span("engine.one_shot"):
+                out = self._choose_one_shot(grid)
+        words = out.strip().lower().split()
+        out = words[0] if words else ""
+        if len(words) > 1:
+            self._last_source = words[1]
+            self.sources[words[1]] = self.sources.get(words[1], 0) + 1
         empties = sum(1 for r in range(BOARD_SIZE) for c in range(BOARD_SIZE) if grid[r][c] == 0)
         max_tile = max(max(row) for row in grid)
         serious = empties <= self.serious_empty_threshold or max_tile >= self.serious_max_tile
@@ -402,8 +542,53 @@ def _on_key_press(key):
         pass
 
 
-def play_loop(region: BoardRegion, strategy: Strategy, delay: float = 0.08) -> None:
+def _press(direction: str, keys=None) -> None:
+    with TRACE.span("press"):
+        if keys is None:
+            pyautogui.press(direction)
+        else:
+            keys.press(direction)
+    TRACE.move_sent(time.perf_counter_ns())
+
+
+def _read_after_move(screen, frame, expected: Optional[Grid], learn: bool = True) -> Optional[Grid]:
+    """Board in a frame from screen.grab(): only the spawn cells (and a few spot checks) when the board
+    after our move is known, the full 16-cell read when it is not or the cheap read disagrees. Unknown
+    colors are asked about only with `learn`; otherwise such a frame reads as None."""
+    if expected is not None:
+        grid = board_vision.classify_board_incremental(lambda cells: screen.means(frame, cells), expected)
+        if grid is not None:
+            return grid
+    if learn:
+        return board_vision.classify_means(screen.means(frame))
+    return board_vision.classify_means_known(screen.means(frame))
+
+
+def _expected_after(grid: Grid, direction: str) -> Optional[Grid]:
+    after, _, changed = move(grid, direction)
+    return after if changed else None
+
+
+def play_loop(
+    region: BoardRegion,
+    strategy: Strategy,
+    delay: Optional[float] = None,
+    recorder: Optional[LiveGameRecorder] = None,
+    report_every: int = 100,
+    incremental: bool = True,
+    screen=None,
+    settle: Optional[SettleModel] = None,
+    keys=None,
+) -> None:
+    """Read, search, press, wait. After a key press the loop polls frames until the board is still
+    (wait_for_stable_frame, timings learned by `settle`) and reads the board from the last of them;
+    a `delay` sleeps that fixed time and grabs afresh instead. Keys go through `keys`
+    (key_input.open_keys), pyautogui.press by default."""
     global _recalibrate_requested
+    if screen is None:
+        screen = board_vision.ScreenCapture(region)
+    if settle is None:
+        settle = SettleModel()
 
     # Start keyboard listener in background thread
     listener = keyboard.Listener(on_press=_on_key_press)
@@ -411,11 +596,15 @@ def play_loop(region: BoardRegion, strategy: Strategy, delay: float = 0.08) -> N
     play_loop._listener = listener  # Store for cleanup
 
     last_grid = None
+    expected: Optional[Grid] = None  # board our last move must produce, before its spawn
+    frame = None  # still frame from the settle wait, read at the top of the next step
+    settled: Dict[str, int] = {"stable": 0, "unchanged": 0, "timeout": 0}
     stagnant_steps = 0
     max_stagnant = 8
     step = 0
 
     while True:
+        step_start = time.perf_counter_ns()
         # Check for pause-and-recalibrate trigger (key 'p' pressed)
         with _recalibrate_lock:
             if _recalibrate_requested:
@@ -429,8 +618,12 @@ def play_loop(region: BoardRegion, strategy: Strategy, delay: float = 0.08) -> N
                 for i in range(3, 0, -1):
                     print(f"{i}...")
                     time.sleep(1)
+                expected = None
+                frame = None
 
-        grid = read_board(region)
+        if frame is None:
+            frame = screen.grab()
+        grid = _read_after_move(screen, frame, expected)
 
         if board_vision.JUST_LEARNED_COLOR:
             board_vision.JUST_LEARNED_COLOR = False
@@ -441,8 +634,12 @@ def play_loop(region: BoardRegion, strategy: Strategy, delay: float = 0.08) -> N
             for i in range(3, 0, -1):
                 print(f"Resuming in {i}...")
                 time.sleep(1)
+            step_start = time.perf_counter_ns()
 
-        print_board(grid)
+        with TRACE.span("print"):
+            print_board(grid)
+        if recorder is not None:
+            recorder.observe(grid)
 
         if last_grid is not None and grid == last_grid:
             stagnant_steps += 1
@@ -454,19 +651,43 @@ def play_loop(region: BoardRegion, strategy: Strategy, delay: float = 0.08) -> N
             print("Board not changing for several moves. Stopping.")
             break
 
-        direction = strategy.choose_move(grid)
+        t0 = time.perf_counter()
+        with TRACE.span("search"):
+            direction = strategy.choose_move(grid)
+        decision_ms = (time.perf_counter() - t0) * 1000.0
         if direction is None:
             print("No valid moves found. Stopping.")
             break
 
         depth = getattr(strategy, "_last_depth", None)
-        if depth is not None:
-            print(f"Step {step}: depth = {depth}, pressing {direction.upper()}")
-        else:
-            print(f"Step {step}: pressing {direction.upper()}")
-        pyautogui.press(direction)
+        source = getattr(strategy, "_last_source", None)
+        how = f" ({source}, {decision_ms:.0f} ms)" if source else ""
+        with TRACE.span("print"):
+            if depth is not None:
+                print(f"Step {step}: depth = {depth}{how}, pressing {direction.upper()}")
+            else:
+                print(f"Step {step}: pressing {direction.upper()}")
+        _press(direction, keys)
+        with TRACE.span("speculate"):
+            strategy.speculate(grid, direction)
+        if recorder is not None:
+            recorder.moved(direction, decision_ms)
+        expected = _expected_after(grid, direction) if incremental else None
         step += 1
-        time.sleep(delay)
+        if delay is not None:
+            with TRACE.span("sleep"):
+                time.sleep(delay)
+            frame = None
+        else:
+            pressed_at = time.perf_counter()
+            with TRACE.span("settle"):
+                frame, how = wait_for_stable_frame(screen.grab, screen.means, screen.means(frame), pressed_at, settle)
+            settled[how] += 1
+        TRACE.add("step", step_start, time.perf_counter_ns())
+        if step % report_every == 0:
+            print(TRACE.report())
+            if delay is None:
+                print(f"settle: typical {settle.typical() * 1000:.0f} ms, {settled}")
 
     # Cleanup: stop keyboard listener when loop exits
     try:
@@ -475,25 +696,210 @@ def play_loop(region: BoardRegion, strategy: Strategy, delay: float = 0.08) -> N
         pass
 
 
+def pipelined_play_loop(
+    region: BoardRegion,
+    strategy: Strategy,
+    recorder: Optional[LiveGameRecorder] = None,
+    settle: Optional[SettleModel] = None,
+    stable_frames: int = 2,
+    stale_after: float = 0.5,
+    tolerance: float = 3.0,
+    report_every: int = 100,
+    incremental: bool = True,
+    screen=None,
+    keys=None,
+) -> None:
+    """play_loop with capture, search and key presses overlapped (stages in play_pipeline.py) instead of
+    a fixed sleep after each key. As in wait_for_stable_frame, a frame is only classified once
+    `stable_frames` frames in a row, captured at least settle.first_poll() s after the last key press,
+    have the same patch means (no channel more than `tolerance` apart); the time to the first of them
+    trains `settle`. A read with a color that is not a known tile, or one that differs from the last
+    read of the same still frames, is not settled yet. A read equal to the board the last move
+    was chosen on is only taken after `stale_after` s (the animation may not have started yet); after
+    several of those in a row the bot stops, as play_loop does. The user is asked about an unknown color
+    only once the frames have stayed the same for `stale_after` s, so mid-slide frames and the bare
+    board are never learned. With `incremental`, frames after a move are read from the spawn cells only
+    while they agree with the board the move must produce."""
+    global _recalibrate_requested
+    if screen is None:
+        screen = board_vision.ScreenCapture(region)
+    if settle is None:
+        settle = SettleModel()
+
+    listener = keyboard.Listener(on_press=_on_key_press)
+    listener.start()
+    play_loop._listener = listener  # Store for cleanup
+
+    ring = FrameRing(capacity=2)
+    acted_on: Optional[Grid] = None  # board the last move was chosen on
+    expected: Optional[Grid] = None  # board that move must produce, before its spawn
+    sent_at = 0.0
+
+    def after_press(direction: str, t: float) -> None:
+        nonlocal sent_at
+        strategy.speculate(acted_on, direction)  # before release: the next search must come after it
+        sent_at = t
+        ring.release(t + settle.first_poll())
+
+    capture = CaptureStage(screen.grab, ring)
+    inputs = InputStage(lambda direction: _press(direction, keys), after_press)
+    capture.start()
+    inputs.start()
+
+    candidate: Optional[Grid] = None  # last read of the current run of still frames
+    still_sig: Optional[np.ndarray] = None  # patch means of the first frame of that run
+    still_since = 0.0  # its capture start
+    streak = 0
+    stagnant_steps = 0
+    max_stagnant = 8
+    step = 0
+    try:
+        while True:
+            with _recalibrate_lock:
+                if _recalibrate_requested:
+                    _recalibrate_requested = False
+                    capture.pause()
+                    print("\n[PAUSE] 'P' key pressed. Pausing for manual color correction...")
+                    board_vision.manual_color_correction(region)
+                    print("Resuming bot in 3 seconds...")
+                    for i in range(3, 0, -1):
+                        print(f"{i}...")
+                        time.sleep(1)
+                    capture.resume()
+                    ring.release(time.perf_counter())
+                    still_sig = None
+                    expected = None
+
+            frame = ring.take(timeout=1.0)
+            if frame is None:
+                error = capture.error or inputs.error
+                if error is not None:
+                    raise error
+                continue
+
+            sig = screen.means(frame.image)
+            if still_sig is not None and np.abs(sig - still_sig).max() <= tolerance:
+                streak += 1
+            else:
+                still_sig, still_since, streak, candidate = sig, frame.t_start, 1, None
+            if streak < stable_frames:
+                continue
+            learn = frame.t_start - still_since >= stale_after
+            grid = _read_after_move(screen, frame.image, expected, learn)
+            if grid is None:
+                continue
+
+            if board_vision.JUST_LEARNED_COLOR:
+                board_vision.JUST_LEARNED_COLOR = False
+                print(
+                    "\nNew tile color learned. You now have a moment to click/focus "
+                    "the 2048 window again before the bot resumes."
+                )
+                for i in range(3, 0, -1):
+                    print(f"Resuming in {i}...")
+                    time.sleep(1)
+                ring.release(time.perf_counter())
+                still_sig = None
+                continue
+
+            if candidate is not None and grid != candidate:
+                still_sig = None
+                continue
+            candidate = grid
+            if grid == acted_on and frame.t_start - sent_at < stale_after:
+                continue
+
+            ring.hold()
+            still_sig = None
+            if acted_on is not None:
+                TRACE.add("settle", int(sent_at * 1e9), int(frame.t_done * 1e9))
+                if grid != acted_on:
+                    settle.observe(still_since - sent_at)
+            with TRACE.span("print"):
+                print_board(grid)
+            if recorder is not None:
+                recorder.observe(grid)
+
+            if grid == acted_on:
+                stagnant_steps += 1
+            else:
+                stagnant_steps = 0
+            if stagnant_steps >= max_stagnant:
+                print("Board not changing for several moves. Stopping.")
+                break
+
+            t0 = time.perf_counter()
+            with TRACE.span("search"):
+                direction = strategy.choose_move(grid)
+            decision_ms = (time.perf_counter() - t0) * 1000.0
+            if direction is None:
+                print("No valid moves found. Stopping.")
+                break
+
+            depth = getattr(strategy, "_last_depth", None)
+            source = getattr(strategy, "_last_source", None)
+            how = f" ({source}, {decision_ms:.0f} ms)" if source else ""
+            if depth is not None:
+                print(f"Step {step}: depth = {depth}{how}, pressing {direction.upper()}")
+            else:
+                print(f"Step {step}: pressing {direction.upper()}")
+            acted_on = grid
+            expected = _expected_after(grid, direction) if incremental else None
+            inputs.send(direction)
+            if recorder is not None:
+                recorder.moved(direction, decision_ms)
+            step += 1
+            if step % report_every == 0:
+                print(TRACE.report(dropped=ring.dropped))
+    finally:
+        ring.close()
+        inputs.stop()
+        capture.resume()
+        try:
+            listener.stop()
+        except:
+            pass
+        print(f"Frames dropped unread: {ring.dropped}")
+
+
 def main() -> None:
     load_saved_colors()
-    wait_for_focus()
-    region = calibrate_board()
-    input(
-        "\nCalibration complete.\n"
-        "When you press Enter here, you will get a short countdown.\n"
-        "Use that time to click/focus the 2048 window.\n"
-        "Press Enter to arm the countdown..."
-    )
-
-    countdown = 5
-    for i in range(countdown, 0, -1):
-        print(f"Starting in {i}... (click the 2048 window now)")
-        time.sleep(1)
+    # STRATEGY_2048_REGION="left,top,width,height,dx,dy" (e.g. from utilities/local_2048.py) skips the
+    # calibration and the prompts, for unattended runs. With STRATEGY_2048_LOCATE=1 the board is looked up
+    # on screen (saved profile for this screen size, then detection). Otherwise, or if that fails, it is
+    # calibrated by hand.
+    region_spec = os.environ.get("STRATEGY_2048_REGION", "")
+    region = None
+    if region_spec:
+        region = board_vision.parse_region(region_spec)
+        print(f"Board region from STRATEGY_2048_REGION: {region}")
+    locate = os.environ.get("STRATEGY_2048_LOCATE", "") == "1"
+    if region is None and locate:
+        region = board_locate.locate_board()
+        if region is not None:
+            # Focus the game window by clicking the board itself (a click on a tile does nothing).
+            pyautogui.click(region.left + region.width // 2, region.top + region.height // 2)
+    if region is None:
+        wait_for_focus()
+        region = calibrate_board()
+        if locate:
+            board_locate.save_profile(board_locate.screen_key(), region)
+        input(
+            "\nCalibration complete.\n"
+            "When you press Enter here, you will get a short countdown.\n"
+            "Use that time to click/focus the 2048 window.\n"
+            "Press Enter to arm the countdown..."
+        )
+
+        countdown = 5
+        for i in range(countdown, 0, -1):
+            print(f"Starting in {i}... (click the 2048 window now)")
+            time.sleep(1)
 
     print("\nStarting 2048 bot. Press Ctrl+C in this terminal to stop.")
     print("Press 'P' key at any time to pause and correct tile colors.\n")
     c_binary = os.path.join(os.path.dirname(__file__), "strategy_2048")
+    book_path = os.environ.get("STRATEGY_2048_BOOK", BOOK_PATH)
     if os.path.isfile(c_binary):
         strategy: Strategy = CStrategy(
             binary_path=c_binary,
@@ -503,23 +909,73 @@ def main() -> None:
             serious_max_tile=512,
             max_empty_samples=10,
             search_timeout_sec=4,
+            threads=int(os.environ.get("STRATEGY_2048_THREADS", "0")),
+            eval_spec=os.environ.get("STRATEGY_2048_EVAL", ""),
+            weights_path=EVAL_WEIGHTS_PATH if os.path.isfile(EVAL_WEIGHTS_PATH) else None,
+            # Position book (build with book_2048 --fill); STRATEGY_2048_BOOK_APPEND=1 adds live searches to it.
+            book_path=book_path if os.path.isfile(book_path) else None,
+            book_append=os.environ.get("STRATEGY_2048_BOOK_APPEND", "") == "1",
+            search=os.environ.get("STRATEGY_2048_SEARCH", ""),
+            # STRATEGY_2048_SERVE=1: one persistent engine that searches the spawns during the animation.
+            serve=os.environ.get("STRATEGY_2048_SERVE", "") == "1",
         )
         print("Using C strategy (strategy_2048, depth up to 9, 4s search budget).")
     else:
         strategy = ExpectimaxStrategy(
             depth_low=4,
             depth_high=8,
-            gamma=0.95,
             max_empty_samples=10,
             serious_empty_threshold=6,
             serious_max_tile=512,
+            weights=load_eval_weights(),
         )
         print("Using Python expectimax strategy (C binary not found).")
+    # STRATEGY_2048_RECORD=path appends the games to a game record file (game_record.py); =1 to RECORD_PATH.
+    record_path = os.environ.get("STRATEGY_2048_RECORD", "")
+    if record_path == "1":
+        record_path = RECORD_PATH
+    recorder = LiveGameRecorder(record_path) if record_path else None
+    if recorder is not None:
+        print(f"Recording games to {record_path}")
+    # Board capture: STRATEGY_2048_CAPTURE=pyautogui (default), x11 (libcapture_x11.so) or auto (x11 if available).
+    screen = board_vision.open_capture(region, os.environ.get("STRATEGY_2048_CAPTURE", "pyautogui"))
+    print(f"Capturing the board with {screen.name}.")
+    # Key presses: STRATEGY_2048_INPUT=xtest (libinput_x11.so), uinput, auto, or pyautogui (default).
+    keys = key_input.open_keys(os.environ.get("STRATEGY_2048_INPUT", "pyautogui"))
+    print(f"Pressing keys with {keys.name}.")
+    # Press-to-still-board times of this host, learned across runs (play_pipeline.SettleModel).
+    settle = SettleModel()
+    print(f"Typical settle time after a move: {settle.typical() * 1000:.0f} ms")
     try:
-        play_loop(region, strategy)
+        # Read, search, press, wait for the board; STRATEGY_2048_PIPELINE=1 overlaps capture, search and key
+        # presses. STRATEGY_2048_INCREMENTAL=1 reads boards after a move from the spawn cells only.
+        incremental = os.environ.get("STRATEGY_2048_INCREMENTAL", "") == "1"
+        if os.environ.get("STRATEGY_2048_PIPELINE", "") == "1":
+            pipelined_play_loop(region, strategy, recorder=recorder, incremental=incremental, screen=screen,
+                                settle=settle, keys=keys)
+        else:
+            play_loop(region, strategy, recorder=recorder, incremental=incremental, screen=screen, settle=settle,
+                      keys=keys)
     except KeyboardInterrupt:
         print("\nStopped by user.")
     finally:
+        if recorder is not None:
+            recorder.close()
+        strategy.close()
+        sources = getattr(strategy, "sources", None)
+        if sources:
+            print("Engine answers: " + ", ".join(f"{n} {how}" for how, n in sorted(sources.items())))
+        screen.close()
+        keys.close()
+        settle.save()
+        print("\n" + TRACE.report(everything=True))
+        reads = board_vision.INCREMENTAL_STATS
+        print(f"Board reads after a move: {reads['hit']} from the spawn cells, {reads['fallback']} full reads")
+        # STRATEGY_2048_TRACE=trace.json writes the newest stage spans for chrome://tracing / Perfetto.
+        trace_path = os.environ.get("STRATEGY_2048_TRACE", "")
+        if trace_path:
+            n = TRACE.export_chrome(trace_path)
+            print(f"Wrote {n} trace spans to {trace_path}")
         # Cleanup: stop keyboard listener if it exists
         if hasattr(play_loop, '_listener'):
             try:
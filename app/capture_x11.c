@@ -0,0 +1,178 @@
+/*
+ * Board capture for the bot on Linux/X11 (also under Xvfb), loaded from Python by capture_x11.py.
+ *
+ * Build: gcc -O3 -march=native -shared -fPIC -o libcapture_x11.so capture_x11.c -lX11 -lXext
+ *
+ * cap_open() keeps one X connection and one image of the board region for the life of the bot. With
+ * the MIT-SHM extension the image lives in shared memory and XShmGetImage has the server write the
+ * region straight into it, so a grab is one round trip and no copy on our side. Without it (a remote
+ * display) XGetSubImage fills the same image. cap_patch_means() grabs the region and averages each
+ * sample patch in one pass over the image, writing mean R, G, B per patch. Patches are clipped to the
+ * region the same way as board_vision.sample_patch_mean_rgb; an empty patch is (0, 0, 0).
+ *
+ * Only 24/32-bit TrueColor displays (8 bits per channel in a 32-bit pixel) are handled; cap_open
+ * returns NULL for anything else, or when the display cannot be opened, and the bot falls back to
+ * pyautogui. X errors of our own requests are caught, never fatal: the handler is installed around the
+ * SHM attach probe and each grab and the previous one restored after, so the rest of the process (Xlib
+ * under pyautogui, input_x11.c) keeps its own error handling.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+typedef struct {
+    Display *dpy;
+    Window root;
+    XImage *img;
+    XShmSegmentInfo shm;
+    int use_shm;
+    int left, top, width, height;
+    int shift[3]; /* bit offset of R, G, B in a pixel */
+} cap_t;
+
+static int x_error;
+
+static int on_x_error(Display *dpy, XErrorEvent *e) {
+    (void)dpy;
+    x_error = e->error_code;
+    return 0;
+}
+
+static int mask_shift(unsigned long mask) {
+    if (mask != 0xffUL && mask != 0xff00UL && mask != 0xff0000UL && mask != 0xff000000UL) return -1;
+    return __builtin_ctzl(mask);
+}
+
+static int attach_shm(cap_t *c, Visual *visual, int depth) {
+    if (!XShmQueryExtension(c->dpy)) return -1;
+    c->img = XShmCreateImage(c->dpy, visual, depth, ZPixmap, NULL, &c->shm, c->width, c->height);
+    if (!c->img) return -1;
+    c->shm.shmid = shmget(IPC_PRIVATE, (size_t)c->img->bytes_per_line * c->height, IPC_CREAT | 0600);
+    if (c->shm.shmid < 0) goto fail_image;
+    c->shm.shmaddr = c->img->data = shmat(c->shm.shmid, NULL, 0);
+    shmctl(c->shm.shmid, IPC_RMID, NULL); /* freed once both sides detach */
+    if (c->shm.shmaddr == (char *)-1) goto fail_image;
+    c->shm.readOnly = False;
+    x_error = 0;
+    XErrorHandler prev = XSetErrorHandler(on_x_error);
+    Bool attached = XShmAttach(c->dpy, &c->shm);
+    XSync(c->dpy, False);
+    XSetErrorHandler(prev);
+    if (!attached || x_error) goto fail_attach; /* e.g. a display on another host */
+    c->use_shm = 1;
+    return 0;
+fail_attach:
+    shmdt(c->shm.shmaddr);
+fail_image:
+    c->img->data = NULL;
+    XDestroyImage(c->img);
+    c->img = NULL;
+    return -1;
+}
+
+void cap_close(cap_t *c) {
+    if (!c) return;
+    if (c->img) {
+        if (c->use_shm) {
+            XShmDetach(c->dpy, &c->shm);
+            XSync(c->dpy, False);
+            shmdt(c->shm.shmaddr);
+            c->img->data = NULL;
+        }
+        XDestroyImage(c->img);
+    }
+    if (c->dpy) XCloseDisplay(c->dpy);
+    free(c);
+}
+
+/* NULL display name = $DISPLAY. */
+cap_t *cap_open(const char *display_name, int left, int top, int width, int height) {
+    if (width <= 0 || height <= 0) return NULL;
+    cap_t *c = calloc(1, sizeof *c);
+    if (!c) return NULL;
+    c->left = left;
+    c->top = top;
+    c->width = width;
+    c->height = height;
+    c->dpy = XOpenDisplay(display_name);
+    if (!c->dpy) goto fail;
+    int screen = DefaultScreen(c->dpy);
+    c->root = RootWindow(c->dpy, screen);
+    Visual *visual = DefaultVisual(c->dpy, screen);
+    int depth = DefaultDepth(c->dpy, screen);
+    if (visual->class != TrueColor || (depth != 24 && depth != 32)) goto fail;
+    c->shift[0] = mask_shift(visual->red_mask);
+    c->shift[1] = mask_shift(visual->green_mask);
+    c->shift[2] = mask_shift(visual->blue_mask);
+    if (c->shift[0] < 0 || c->shift[1] < 0 || c->shift[2] < 0) goto fail;
+
+    if (attach_shm(c, visual, depth) != 0) {
+        char *data = malloc((size_t)width * height * 4);
+        if (!data) goto fail;
+        c->img = XCreateImage(c->dpy, visual, depth, ZPixmap, 0, data, width, height, 32, 0);
+        if (!c->img) {
+            free(data);
+            goto fail;
+        }
+    }
+    if (c->img->bits_per_pixel != 32) goto fail;
+    return c;
+fail:
+    cap_close(c);
+    return NULL;
+}
+
+/* 1 = shared memory, 0 = XGetSubImage. */
+int cap_uses_shm(const cap_t *c) { return c->use_shm; }
+
+/* Both requests wait for their reply, so an error they cause has been handled when they return. */
+static int grab(cap_t *c) {
+    x_error = 0;
+    XErrorHandler prev = XSetErrorHandler(on_x_error);
+    int ok;
+    if (c->use_shm)
+        ok = XShmGetImage(c->dpy, c->root, c->img, c->left, c->top, AllPlanes) != 0;
+    else
+        ok = XGetSubImage(c->dpy, c->root, c->left, c->top, c->width, c->height, AllPlanes, ZPixmap, c->img,
+                          0, 0) != NULL;
+    XSetErrorHandler(prev);
+    return ok && !x_error ? 0 : -1;
+}
+
+/* Grabs the region and writes the mean RGB of the n patches centered at (cx[i], cy[i]) (region
+ * coordinates, `half` pixels each way) to out[3 * i ...]. Returns 0, or -1 if the grab failed. */
+int cap_patch_means(cap_t *c, int n, const int *cx, const int *cy, int half, float *out) {
+    if (grab(c) != 0) return -1;
+    const char *data = c->img->data;
+    const int stride = c->img->bytes_per_line;
+    const int sr = c->shift[0], sg = c->shift[1], sb = c->shift[2];
+    for (int i = 0; i < n; i++) {
+        int x1 = cx[i] - half, x2 = cx[i] + half, y1 = cy[i] - half, y2 = cy[i] + half;
+        if (x1 < 0) x1 = 0;
+        if (y1 < 0) y1 = 0;
+        if (x2 > c->width) x2 = c->width;
+        if (y2 > c->height) y2 = c->height;
+        uint64_t r = 0, g = 0, b = 0;
+        for (int y = y1; y < y2; y++) {
+            const uint32_t *row = (const uint32_t *)(data + (size_t)y * stride);
+            for (int x = x1; x < x2; x++) {
+                uint32_t p = row[x];
+                r += (p >> sr) & 0xff;
+                g += (p >> sg) & 0xff;
+                b += (p >> sb) & 0xff;
+            }
+        }
+        long count = (x2 > x1 && y2 > y1) ? (long)(x2 - x1) * (y2 - y1) : 0;
+        out[3 * i + 0] = count ? (float)r / count : 0.0f;
+        out[3 * i + 1] = count ? (float)g / count : 0.0f;
+        out[3 * i + 2] = count ? (float)b / count : 0.0f;
+    }
+    return 0;
+}
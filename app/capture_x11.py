@@ -0,0 +1,77 @@
+"""
+X11 board capture for the play loop (board_vision.open_capture, STRATEGY_2048_CAPTURE=x11): ctypes
+wrapper around libcapture_x11.so (capture_x11.c, build line there).
+
+A grab is one XShmGetImage of the board region into shared memory the library keeps for the life of
+the bot, followed by one C pass that averages the 16 sample patches. The frame it returns is that
+(16, 3) array of mean RGB in board_vision.ALL_CELLS order, so nothing image-sized crosses into Python
+and no screenshot is converted, cropped or channel-flipped. Works under Xvfb.
+"""
+
+import ctypes
+import os
+from typing import Optional, Sequence, Tuple
+
+import numpy as np
+
+from board_vision import ALL_CELLS, BOARD_SIZE, BoardRegion, sample_point
+from stage_trace import TRACE
+
+LIB_PATH = os.path.join(os.path.dirname(__file__), "libcapture_x11.so")
+
+_lib: Optional[ctypes.CDLL] = None
+
+
+def _load(path: str) -> ctypes.CDLL:
+    global _lib
+    if _lib is None:
+        lib = ctypes.CDLL(path)
+        lib.cap_open.restype = ctypes.c_void_p
+        lib.cap_open.argtypes = [ctypes.c_char_p] + [ctypes.c_int] * 4
+        lib.cap_close.restype = None
+        lib.cap_close.argtypes = [ctypes.c_void_p]
+        lib.cap_uses_shm.restype = ctypes.c_int
+        lib.cap_uses_shm.argtypes = [ctypes.c_void_p]
+        lib.cap_patch_means.restype = ctypes.c_int
+        lib.cap_patch_means.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_void_p, ctypes.c_void_p,
+                                        ctypes.c_int, ctypes.c_void_p]
+        _lib = lib
+    return _lib
+
+
+class X11Capture:
+    """Same interface as board_vision.ScreenCapture; frames are (16, 3) float32 mean RGB arrays."""
+
+    name = "x11"
+
+    def __init__(self, region: BoardRegion, display: Optional[str] = None, lib_path: str = LIB_PATH):
+        if not os.environ.get("DISPLAY") and display is None:
+            raise OSError("no DISPLAY")
+        self.lib = _load(lib_path)  # OSError if it was not built
+        self.region = region
+        self.handle = self.lib.cap_open(display.encode() if display else None,
+                                        region.left, region.top, region.width, region.height)
+        if not self.handle:
+            raise OSError("cannot capture from this display")
+        points = [sample_point(region, r, c) for r, c in ALL_CELLS]
+        self.cx = np.array([p[0] for p in points], dtype=np.int32)
+        self.cy = np.array([p[1] for p in points], dtype=np.int32)
+        self.half = max(1, region.sample_box // 2)
+        self.shm = bool(self.lib.cap_uses_shm(self.handle))
+
+    def grab(self) -> np.ndarray:
+        out = np.empty((len(ALL_CELLS), 3), dtype=np.float32)
+        with TRACE.span("grab"):
+            ok = self.lib.cap_patch_means(self.handle, len(ALL_CELLS), self.cx.ctypes.data,
+                                          self.cy.ctypes.data, self.half, out.ctypes.data)
+        if ok != 0:
+            raise OSError("X11 capture failed")
+        return out
+
+    def means(self, frame: np.ndarray, cells: Sequence[Tuple[int, int]] = ALL_CELLS) -> np.ndarray:
+        return frame[[r * BOARD_SIZE + c for r, c in cells]]
+
+    def close(self) -> None:
+        if self.handle:
+            self.lib.cap_close(self.handle)
+            self.handle = None
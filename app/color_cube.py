@@ -0,0 +1,113 @@
+"""
+RGB → tile value lookup for board_vision: the learned palette (TILE_COLORS, 2048_colors.json)
+compiled into a quantized color cube, so classifying a patch color is a table lookup instead of a
+loop over every palette entry.
+
+The cube has (2**bits)**3 bins (64³ by default, 4 levels per channel per bin). Each bin stores the
+palette entry nearest to the bin's center, and the distances from the center to the nearest and
+second-nearest entries. A color lies within RADIUS of its bin's center, so when the second entry is
+more than 2 * RADIUS further away than the first, the first is the nearest entry for every color in
+the bin. Only the remaining bins (the thin slabs around the boundaries between two palette colors)
+are searched exhaustively. lookup() therefore returns exactly what a loop over the palette would,
+including the squared distance that COLOR_DIST_THRESHOLD is compared against.
+
+sync(palette) brings the cube up to date with the palette dict. A new color only updates the bins it
+is nearer to than their first or second entry. A moved color also re-resolves the bins that had it
+as first or second entry. A removed one rebuilds everything.
+"""
+
+from typing import Dict, Tuple
+
+import numpy as np
+
+Palette = Dict[int, Tuple[int, int, int]]
+
+
+class ColorCube:
+    def __init__(self, bits: int = 6):
+        self.bits = bits
+        self.shift = 8 - bits
+        n = 1 << bits
+        width = float(1 << self.shift)
+        levels = np.arange(n, dtype=np.float32) * width + width / 2.0
+        r, g, b = np.meshgrid(levels, levels, levels, indexing="ij")
+        self.centers = np.stack([r.ravel(), g.ravel(), b.ravel()], axis=1)
+        self.margin = np.sqrt(3.0) * width + 1e-3  # 2 * RADIUS (center to farthest corner), + float32 slack
+        self.palette: Palette = {}
+        self.values = np.zeros(0, dtype=np.int64)  # palette slot → tile value, in palette order
+        self.colors = np.zeros((0, 3), dtype=np.float32)  # palette slot → RGB
+        self.first = np.full(n ** 3, -1, dtype=np.int16)  # bin → nearest palette slot
+        self.second = np.full(n ** 3, -1, dtype=np.int16)  # bin → second-nearest palette slot
+        self.d1 = np.full(n ** 3, np.inf, dtype=np.float32)  # bin center → first / second entry
+        self.d2 = np.full(n ** 3, np.inf, dtype=np.float32)
+
+    def _claim(self, slot: int, bins=None) -> None:
+        # Offers palette slot `slot` to every bin (or the given bin indices) as first or second entry.
+        if bins is None:
+            bins = np.arange(len(self.first))
+        d = np.sqrt(((self.centers[bins] - self.colors[slot]) ** 2).sum(axis=1))
+        d1, d2 = self.d1[bins], self.d2[bins]
+        f, s = self.first[bins], self.second[bins]
+        nearest = d < d1
+        runner_up = ~nearest & (d < d2)
+        self.second[bins] = np.where(nearest, f, np.where(runner_up, slot, s))
+        self.d2[bins] = np.where(nearest, d1, np.where(runner_up, d, d2))
+        self.first[bins] = np.where(nearest, slot, f)
+        self.d1[bins] = np.where(nearest, d, d1)
+
+    def _reset(self, bins=None) -> None:
+        bins = slice(None) if bins is None else bins
+        self.first[bins] = -1
+        self.second[bins] = -1
+        self.d1[bins] = np.inf
+        self.d2[bins] = np.inf
+
+    def rebuild(self, palette: Palette) -> None:
+        self.palette = {v: tuple(rgb) for v, rgb in palette.items()}
+        self.values = np.array(list(self.palette), dtype=np.int64)
+        self.colors = np.array(list(self.palette.values()), dtype=np.float32).reshape(-1, 3)
+        self._reset()
+        for slot in range(len(self.values)):
+            self._claim(slot)
+
+    def sync(self, palette: Palette) -> None:
+        """Updates the cube for whatever changed in `palette` since the last sync."""
+        if palette == self.palette:
+            return
+        if any(v not in palette for v in self.palette):
+            self.rebuild(palette)
+            return
+        for value, rgb in palette.items():
+            rgb = tuple(rgb)
+            if self.palette.get(value) == rgb:
+                continue
+            if value in self.palette:
+                slot = int(np.flatnonzero(self.values == value)[0])
+                self.colors[slot] = rgb
+                stale = np.flatnonzero((self.first == slot) | (self.second == slot))
+                self._reset(stale)
+                for other in range(len(self.values)):
+                    if other != slot:
+                        self._claim(other, stale)
+            else:
+                slot = len(self.values)
+                self.values = np.append(self.values, value)
+                self.colors = np.vstack([self.colors, np.array(rgb, dtype=np.float32)])
+            self._claim(slot)
+            self.palette[value] = rgb
+
+    def lookup(self, rgb) -> Tuple[np.ndarray, np.ndarray]:
+        """Nearest tile values and squared RGB distances to their palette colors for (N, 3) colors."""
+        rgb = np.asarray(rgb, dtype=np.float64).reshape(-1, 3)
+        if not len(self.values):
+            return np.zeros(len(rgb), dtype=np.int64), np.full(len(rgb), np.inf)
+        q = np.clip(rgb, 0, 255).astype(np.int64) >> self.shift
+        bins = (q[:, 0] << (2 * self.bits)) | (q[:, 1] << self.bits) | q[:, 2]
+        slots = self.first[bins].astype(np.int64)
+        outside = ((rgb < 0) | (rgb >= 256)).any(axis=1)  # farther than RADIUS from the clipped bin
+        close = np.flatnonzero((self.d2[bins] - self.d1[bins] <= self.margin) | outside)
+        if len(close):
+            d = ((rgb[close, None, :] - self.colors[None, :, :]) ** 2).sum(axis=2)
+            slots[close] = d.argmin(axis=1)
+        dist = ((rgb - self.colors[slots]) ** 2).sum(axis=1)
+        return self.values[slots], dist
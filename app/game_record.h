@@ -0,0 +1,233 @@
+/*
+ * Binary game records: the format, an mmap reader and a whole-game appender (game_record.py has the
+ * streaming writer the bot uses, and a Python reader). Include after strategy_2048.c (needs board_t,
+ * board_move).
+ *
+ * File: gr_file_header_t, then games back to back. A game is gr_game_header_t followed by nsteps
+ * fixed-size steps of step_size bytes:
+ *   u16 code    bits 0-1 move (0=up 1=right 2=down 3=left), bits 2-5 spawn cell (r * 4 + c),
+ *               bit 6 spawn is a 4, bit 7 no spawn recorded (last move of a game, or unknown)
+ *   f32 value   engine's value of the chosen move       (if flags & GR_HAS_VALUE)
+ *   f32 ms      decision time in milliseconds            (if flags & GR_HAS_TIME)
+ * little-endian, unaligned. Board k+1 = board k, moved, plus the spawn; the initial board is packed
+ * (see pack_grid). A writer that streams steps writes nsteps = GR_OPEN and patches it when the game ends;
+ * readers treat a game still GR_OPEN (crashed writer) as running to the end of the file.
+ */
+
+#ifndef GAME_RECORD_H
+#define GAME_RECORD_H
+
+#include <stdint.h>
+
+#define GR_FILE_MAGIC "T2048REC"
+#define GR_GAME_MAGIC 0x454d4147u   /* "GAME" */
+#define GR_OPEN 0xffffffffu
+
+enum {
+    GR_HAS_VALUE = 1,
+    GR_HAS_TIME = 2,
+    GR_CONTINUED = 4,   /* starts where the previous game lost sync (live bot misread), not a new game */
+};
+
+enum {
+    GR_SPAWN_FOUR = 1 << 6,
+    GR_NO_SPAWN = 1 << 7,
+};
+
+typedef struct {
+    char magic[8];
+    uint16_t version;      /* 1 */
+    uint16_t reserved0;
+    uint32_t reserved1;
+} gr_file_header_t;
+
+typedef struct {
+    uint32_t magic;        /* GR_GAME_MAGIC */
+    uint16_t flags;
+    uint16_t step_size;    /* 2, + 4 with GR_HAS_VALUE, + 4 with GR_HAS_TIME */
+    uint32_t nsteps;       /* GR_OPEN while a streaming writer has the game open */
+    uint32_t final_score;
+    uint64_t initial;      /* packed board */
+    uint64_t seed;         /* spawn seed for self-play games, 0 when unknown */
+} gr_game_header_t;
+
+static inline int gr_step_size(int flags) {
+    return 2 + ((flags & GR_HAS_VALUE) ? 4 : 0) + ((flags & GR_HAS_TIME) ? 4 : 0);
+}
+
+static inline unsigned int gr_encode_step(int dir, int spawn_cell, int spawn_value) {
+    if (spawn_cell < 0) return (unsigned int)dir | GR_NO_SPAWN;
+    return (unsigned int)dir | (unsigned int)spawn_cell << 2 | (spawn_value == 4 ? GR_SPAWN_FOUR : 0);
+}
+
+/* Applies one step code; *score_out gets the merge score of the move. */
+static inline board_t gr_apply_step(board_t b, unsigned int code, int *score_out) {
+    b = board_move(b, (int)(code & 3), score_out);
+    if (!(code & GR_NO_SPAWN)) {
+        int cell = (int)(code >> 2) & 15;
+        b |= (board_t)((code & GR_SPAWN_FOUR) ? 2 : 1) << (4 * (N * N - 1 - cell));
+    }
+    return b;
+}
+
+/* The spawn between an afterstate and the next board: returns the cell (r * 4 + c) and sets *value_out,
+ * or -1 when next is not after plus one new 2 or 4. */
+static inline int gr_find_spawn(board_t after, board_t next, int *value_out) {
+    board_t diff = after ^ next;
+    for (int cell = 0; cell < N * N; cell++) {
+        int shift = 4 * (N * N - 1 - cell);
+        board_t nib = (diff >> shift) & 15;
+        if (!nib) continue;
+        if (((after >> shift) & 15) || (nib != 1 && nib != 2) || (diff & ~((board_t)15 << shift))) return -1;
+        *value_out = nib == 1 ? 2 : 4;
+        return cell;
+    }
+    return -1;
+}
+
+/* ---- reader ---- */
+
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+} gr_file_t;
+
+typedef struct {
+    gr_game_header_t h;    /* copy; nsteps resolved for open games */
+    const unsigned char *steps;
+    size_t offset;         /* of the game header in the file */
+} gr_game_t;
+
+/* Maps a record file read-only. Returns 0, or -1 with a message on stderr. */
+static inline int gr_open(const char *path, gr_file_t *f) {
+    memset(f, 0, sizeof *f);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open game records %s\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(gr_file_header_t)) {
+        fprintf(stderr, "%s: not a game record file\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return -1;
+    }
+    if (memcmp(map, GR_FILE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not a game record file\n", path);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    f->base = (const unsigned char *)map;
+    f->size = (size_t)st.st_size;
+    return 0;
+}
+
+static inline void gr_close(gr_file_t *f) {
+    if (f->base) munmap((void *)f->base, f->size);
+    memset(f, 0, sizeof *f);
+}
+
+/*
+ * Iterates games: start with *offset = 0, returns 1 per game and 0 at the end (or at a damaged header).
+ *   size_t off = 0; gr_game_t g; while (gr_next_game(&f, &off, &g)) { ... }
+ */
+static inline int gr_next_game(const gr_file_t *f, size_t *offset, gr_game_t *g) {
+    size_t off = *offset ? *offset : sizeof(gr_file_header_t);
+    if (off + sizeof(gr_game_header_t) > f->size) return 0;
+    memcpy(&g->h, f->base + off, sizeof g->h);
+    if (g->h.magic != GR_GAME_MAGIC || g->h.step_size != gr_step_size(g->h.flags)) return 0;
+    size_t avail = (f->size - off - sizeof g->h) / g->h.step_size;
+    if (g->h.nsteps == GR_OPEN || g->h.nsteps > avail) g->h.nsteps = (uint32_t)avail;
+    g->steps = f->base + off + sizeof g->h;
+    g->offset = off;
+    *offset = off + sizeof g->h + (size_t)g->h.nsteps * g->h.step_size;
+    return 1;
+}
+
+static inline unsigned int gr_step_code(const gr_game_t *g, uint32_t i) {
+    const unsigned char *p = g->steps + (size_t)i * g->h.step_size;
+    return (unsigned int)p[0] | (unsigned int)p[1] << 8;
+}
+
+static inline float gr_step_value(const gr_game_t *g, uint32_t i) {
+    float v = 0;
+    if (g->h.flags & GR_HAS_VALUE) memcpy(&v, g->steps + (size_t)i * g->h.step_size + 2, 4);
+    return v;
+}
+
+static inline float gr_step_ms(const gr_game_t *g, uint32_t i) {
+    float v = 0;
+    if (g->h.flags & GR_HAS_TIME)
+        memcpy(&v, g->steps + (size_t)i * g->h.step_size + 2 + ((g->h.flags & GR_HAS_VALUE) ? 4 : 0), 4);
+    return v;
+}
+
+/* ---- appender (whole games; callers writing from several threads hold their own lock) ---- */
+
+/* Opens PATH for appending, writing the file header if it is new. Returns NULL (message on stderr) on error. */
+static inline FILE *gr_append_open(const char *path) {
+    FILE *f = fopen(path, "ab");
+    if (!f) {
+        fprintf(stderr, "cannot write game records %s\n", path);
+        return NULL;
+    }
+    if (ftell(f) == 0) {
+        gr_file_header_t fh;
+        memset(&fh, 0, sizeof fh);
+        memcpy(fh.magic, GR_FILE_MAGIC, 8);
+        fh.version = 1;
+        fwrite(&fh, sizeof fh, 1, f);
+    }
+    return f;
+}
+
+/* In-memory game being played; gr_append_game writes it out in one piece. */
+typedef struct {
+    gr_game_header_t h;
+    unsigned char *steps;
+    size_t cap;
+} gr_game_buf_t;
+
+static inline void gr_buf_begin(gr_game_buf_t *gb, board_t initial, uint64_t seed, int flags) {
+    memset(&gb->h, 0, sizeof gb->h);
+    gb->h.magic = GR_GAME_MAGIC;
+    gb->h.flags = (uint16_t)flags;
+    gb->h.step_size = (uint16_t)gr_step_size(flags);
+    gb->h.initial = initial;
+    gb->h.seed = seed;
+}
+
+static inline void gr_buf_step(gr_game_buf_t *gb, unsigned int code, float value, float ms) {
+    size_t need = ((size_t)gb->h.nsteps + 1) * gb->h.step_size;
+    if (need > gb->cap) {
+        gb->cap = gb->cap ? 2 * gb->cap : 16384;
+        gb->steps = (unsigned char *)realloc(gb->steps, gb->cap);
+        if (!gb->steps) {
+            fprintf(stderr, "game record: out of memory\n");
+            exit(1);
+        }
+    }
+    unsigned char *p = gb->steps + (size_t)gb->h.nsteps * gb->h.step_size;
+    p[0] = (unsigned char)(code & 0xff);
+    p[1] = (unsigned char)(code >> 8);
+    p += 2;
+    if (gb->h.flags & GR_HAS_VALUE) { memcpy(p, &value, 4); p += 4; }
+    if (gb->h.flags & GR_HAS_TIME) memcpy(p, &ms, 4);
+    gb->h.nsteps++;
+}
+
+static inline int gr_append_game(FILE *f, gr_game_buf_t *gb, uint32_t final_score) {
+    gb->h.final_score = final_score;
+    size_t n = (size_t)gb->h.nsteps * gb->h.step_size;
+    int ok = fwrite(&gb->h, sizeof gb->h, 1, f) == 1 && (n == 0 || fwrite(gb->steps, 1, n, f) == n);
+    return (fflush(f) == 0 && ok) ? 0 : -1;
+}
+
+#endif /* GAME_RECORD_H */
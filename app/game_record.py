@@ -0,0 +1,304 @@
+"""
+Game records from Python: the format is described in game_record.h (the C side, used by
+selfplay_2048 --record and records_2048).
+
+GameRecordWriter streams a game one step at a time (the header is written with nsteps = OPEN and
+patched when the game ends, so a crash loses nothing but the final score). LiveGameRecorder sits on
+top of it for the bot: it is fed the boards the bot reads and the moves it presses, and infers each
+spawn from the difference between the board it expected and the one it saw. GameRecords maps a file
+and hands out each game's steps as a zero-copy numpy view, so millions of positions can be walked
+without parsing.
+
+Replay uses the engine's move rules (engine_move, a port of board_move), so Python and C replay the
+same boards. When the board the bot reads is not the engine's afterstate plus one spawn (a misread,
+a frame taken mid-animation, a new game) the current game is closed and a new one is started from
+the observed board with CONTINUED set.
+"""
+
+import mmap
+import os
+import struct
+from typing import Iterator, List, NamedTuple, Optional, Tuple
+
+import numpy as np
+
+Grid = List[List[int]]
+
+FILE_MAGIC = b"T2048REC"
+GAME_MAGIC = 0x454D4147
+OPEN = 0xFFFFFFFF
+
+HAS_VALUE = 1
+HAS_TIME = 2
+CONTINUED = 4
+
+SPAWN_FOUR = 1 << 6
+NO_SPAWN = 1 << 7
+
+DIRS = ["up", "right", "down", "left"]
+
+FILE_HEADER = struct.Struct("<8sHHI")
+GAME_HEADER = struct.Struct("<IHHIIQQ")  # magic flags step_size nsteps final_score initial seed
+NSTEPS_OFFSET = 8
+
+
+def step_size(flags: int) -> int:
+    return 2 + (4 if flags & HAS_VALUE else 0) + (4 if flags & HAS_TIME else 0)
+
+
+def step_dtype(flags: int) -> np.dtype:
+    fields = [("code", "<u2")]
+    if flags & HAS_VALUE:
+        fields.append(("value", "<f4"))
+    if flags & HAS_TIME:
+        fields.append(("ms", "<f4"))
+    return np.dtype(fields)
+
+
+# ---- boards ----
+
+def pack_grid(grid: Grid) -> int:
+    b = 0
+    for row in grid:
+        for v in row:
+            b = (b << 4) | (v.bit_length() - 1 if v else 0)
+    return b
+
+
+def unpack_board(b: int) -> Grid:
+    cells = [(b >> (4 * (15 - i))) & 15 for i in range(16)]
+    return [[1 << c if c else 0 for c in cells[r * 4:r * 4 + 4]] for r in range(4)]
+
+
+def _engine_row_left(row: List[int]) -> Tuple[List[int], int]:
+    # strategy_2048's move_row_left: a tile merges with the next tile in the row, across empty cells,
+    # at most once per move.
+    tiles = [v for v in row if v]
+    out: List[int] = []
+    score = 0
+    i = 0
+    while i < len(tiles):
+        v = tiles[i]
+        if i + 1 < len(tiles) and tiles[i + 1] == v:
+            out.append(2 * v)
+            score += 2 * v
+            i += 2
+        else:
+            out.append(v)
+            i += 1
+    return out + [0] * (4 - len(out)), score
+
+
+def engine_move(grid: Grid, direction: str) -> Tuple[Grid, int, bool]:
+    """The engine's move (board_move / do_move): (new grid, merge score, changed)."""
+    if direction in ("left", "right"):
+        lines = [row[:] for row in grid]
+    else:
+        lines = [[grid[r][c] for r in range(4)] for c in range(4)]
+    reverse = direction in ("right", "down")
+    moved, score = [], 0
+    for line in lines:
+        out, s = _engine_row_left(line[::-1] if reverse else line)
+        moved.append(out[::-1] if reverse else out)
+        score += s
+    if direction in ("up", "down"):
+        moved = [[moved[c][r] for c in range(4)] for r in range(4)]
+    return moved, score, moved != grid
+
+
+def find_spawn(after: Grid, observed: Grid) -> Optional[Tuple[int, int]]:
+    """(cell r * 4 + c, 2 or 4) if observed is after plus one new tile, else None."""
+    spawn = None
+    for r in range(4):
+        for c in range(4):
+            if after[r][c] == observed[r][c]:
+                continue
+            if spawn is not None or after[r][c] != 0 or observed[r][c] not in (2, 4):
+                return None
+            spawn = (r * 4 + c, observed[r][c])
+    return spawn
+
+
+def encode_step(direction: str, spawn: Optional[Tuple[int, int]]) -> int:
+    d = DIRS.index(direction)
+    if spawn is None:
+        return d | NO_SPAWN
+    cell, value = spawn
+    return d | cell << 2 | (SPAWN_FOUR if value == 4 else 0)
+
+
+def apply_step(grid: Grid, code: int) -> Tuple[Grid, int]:
+    moved, score, _ = engine_move(grid, DIRS[code & 3])
+    if not code & NO_SPAWN:
+        cell = (code >> 2) & 15
+        moved[cell // 4][cell % 4] = 4 if code & SPAWN_FOUR else 2
+    return moved, score
+
+
+# ---- writing ----
+
+class GameRecordWriter:
+    """Appends games to a record file, one flushed step at a time."""
+
+    def __init__(self, path: str):
+        os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+        self.f = open(path, "r+b" if os.path.exists(path) else "w+b")
+        size = self.f.seek(0, os.SEEK_END)
+        if size == 0:
+            self.f.write(FILE_HEADER.pack(FILE_MAGIC, 1, 0, 0))
+            self.f.flush()
+        else:
+            self.f.seek(0)
+            if self.f.read(8) != FILE_MAGIC:
+                self.f.close()
+                raise ValueError(f"{path}: not a game record file")
+            self._seal_open_game(size)
+        self.game_offset: Optional[int] = None
+
+    def _seal_open_game(self, size: int) -> None:
+        # A writer that died mid-game leaves nsteps = OPEN; pin it to the complete steps on disk (and drop a
+        # torn step) so games appended after it stay readable.
+        off = FILE_HEADER.size
+        while off + GAME_HEADER.size <= size:
+            self.f.seek(off)
+            magic, flags, ssize, nsteps, *_ = GAME_HEADER.unpack(self.f.read(GAME_HEADER.size))
+            if magic != GAME_MAGIC or ssize != step_size(flags):
+                break
+            avail = (size - off - GAME_HEADER.size) // ssize
+            if nsteps == OPEN or nsteps > avail:
+                self.f.seek(off + NSTEPS_OFFSET)
+                self.f.write(struct.pack("<I", avail))
+                self.f.truncate(off + GAME_HEADER.size + avail * ssize)
+                break
+            off += GAME_HEADER.size + nsteps * ssize
+        self.f.seek(0, os.SEEK_END)
+        self.f.flush()
+
+    def begin_game(self, initial: Grid, flags: int = 0, seed: int = 0) -> None:
+        if self.game_offset is not None:
+            self.end_game(0)
+        self.flags = flags
+        self.nsteps = 0
+        self.game_offset = self.f.seek(0, os.SEEK_END)
+        self.f.write(GAME_HEADER.pack(GAME_MAGIC, flags, step_size(flags), OPEN, 0, pack_grid(initial), seed))
+        self.f.flush()
+
+    def add_step(self, code: int, value: float = 0.0, ms: float = 0.0) -> None:
+        step = struct.pack("<H", code)
+        if self.flags & HAS_VALUE:
+            step += struct.pack("<f", value)
+        if self.flags & HAS_TIME:
+            step += struct.pack("<f", ms)
+        self.f.write(step)
+        self.f.flush()
+        self.nsteps += 1
+
+    def end_game(self, final_score: int) -> None:
+        if self.game_offset is None:
+            return
+        self.f.seek(self.game_offset + NSTEPS_OFFSET)
+        self.f.write(struct.pack("<II", self.nsteps, final_score))
+        self.f.seek(0, os.SEEK_END)
+        self.f.flush()
+        self.game_offset = None
+
+    def close(self) -> None:
+        self.f.close()
+
+
+class LiveGameRecorder:
+    """Records what the bot sees and does: observe(grid) after every board read, moved(direction, ms)
+    after every key press. Steps carry the decision time in ms."""
+
+    def __init__(self, path: str):
+        self.writer = GameRecordWriter(path)
+        self.last: Optional[Grid] = None
+        self.pending: Optional[Tuple[str, float]] = None
+        self.score = 0
+
+    def _begin(self, grid: Grid, flags: int) -> None:
+        self.writer.begin_game(grid, HAS_TIME | flags)
+        self.last = [row[:] for row in grid]
+        self.score = 0
+
+    def observe(self, grid: Grid) -> None:
+        if self.last is None:
+            self._begin(grid, 0)
+            return
+        if self.pending is None or grid == self.last:
+            self.pending = None  # the key press did not take; the next decision replaces it
+            return
+        direction, ms = self.pending
+        self.pending = None
+        after, gained, _ = engine_move(self.last, direction)
+        spawn = find_spawn(after, grid)
+        self.writer.add_step(encode_step(direction, spawn), ms=ms)
+        self.score += gained
+        if spawn is None:
+            self.writer.end_game(self.score)
+            self._begin(grid, CONTINUED)
+        else:
+            self.last = [row[:] for row in grid]
+
+    def moved(self, direction: str, ms: float) -> None:
+        self.pending = (direction, ms)
+
+    def close(self) -> None:
+        if self.pending is not None:
+            self.writer.add_step(encode_step(self.pending[0], None), ms=self.pending[1])
+            self.score += engine_move(self.last, self.pending[0])[1]
+            self.pending = None
+        self.writer.end_game(self.score)
+        self.writer.close()
+
+
+# ---- reading ----
+
+class Game(NamedTuple):
+    offset: int
+    flags: int
+    nsteps: int
+    final_score: int
+    initial: int
+    seed: int
+    open: bool              # never closed by its writer; nsteps is what is on disk
+    steps: np.ndarray       # structured view (code, [value], [ms]) into the mapping
+
+    def codes(self) -> np.ndarray:
+        return self.steps["code"]
+
+
+class GameRecords:
+    """Read-only mapping of a record file; iterate it for Game tuples."""
+
+    def __init__(self, path: str):
+        with open(path, "rb") as f:
+            self.mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        if len(self.mm) < FILE_HEADER.size or self.mm[:8] != FILE_MAGIC:
+            self.mm.close()
+            raise ValueError(f"{path}: not a game record file")
+
+    def __iter__(self) -> Iterator[Game]:
+        off, size = FILE_HEADER.size, len(self.mm)
+        while off + GAME_HEADER.size <= size:
+            magic, flags, ssize, nsteps, final_score, initial, seed = GAME_HEADER.unpack_from(self.mm, off)
+            if magic != GAME_MAGIC or ssize != step_size(flags):
+                break
+            avail = (size - off - GAME_HEADER.size) // ssize
+            is_open = nsteps == OPEN
+            if is_open or nsteps > avail:
+                nsteps = avail
+            steps = np.frombuffer(self.mm, dtype=step_dtype(flags), count=nsteps, offset=off + GAME_HEADER.size)
+            yield Game(off, flags, nsteps, final_score, initial, seed, is_open, steps)
+            off += GAME_HEADER.size + nsteps * ssize
+
+    def close(self) -> None:
+        self.mm.close()
+
+
+def replay(game: Game) -> Iterator[Tuple[Grid, int]]:
+    """(board, step code) for every recorded decision of a game, in order."""
+    grid = unpack_board(game.initial)
+    for code in game.codes().tolist():
+        yield grid, code
+        grid, _ = apply_step(grid, code)
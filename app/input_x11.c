@@ -0,0 +1,61 @@
+/*
+ * Key presses for the bot on Linux/X11 (also under Xvfb) through the XTEST extension, loaded from
+ * Python by key_input.py.
+ *
+ * Build: gcc -O3 -shared -fPIC -o libinput_x11.so input_x11.c -lX11 -lXtst
+ *
+ * keys_open() keeps one X connection for the life of the bot. keys_tap() sends a fake key press and
+ * release for a keycode (looked up once with keys_keycode()) and waits for the server to have
+ * processed both (XSync), so when it returns the key is in the focused window's queue: one round trip,
+ * no per-key pause, no fail-safe check and no new connection per key.
+ *
+ * No X error handler is installed here (Xlib keeps one per process); the only request that could fail
+ * is a fake event for a keycode outside the server's range, and keys_tap() refuses those itself.
+ */
+
+#include <stdlib.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XTest.h>
+
+typedef struct {
+    Display *dpy;
+    int min_keycode, max_keycode;
+} keys_t;
+
+void keys_close(keys_t *k) {
+    if (!k) return;
+    if (k->dpy) XCloseDisplay(k->dpy);
+    free(k);
+}
+
+/* NULL display name = $DISPLAY. NULL when the display cannot be opened or has no XTEST. */
+keys_t *keys_open(const char *display_name) {
+    keys_t *k = calloc(1, sizeof *k);
+    if (!k) return NULL;
+    k->dpy = XOpenDisplay(display_name);
+    if (!k->dpy) goto fail;
+    int event_base, error_base, major, minor;
+    if (!XTestQueryExtension(k->dpy, &event_base, &error_base, &major, &minor)) goto fail;
+    XDisplayKeycodes(k->dpy, &k->min_keycode, &k->max_keycode);
+    return k;
+fail:
+    keys_close(k);
+    return NULL;
+}
+
+/* Keycode of a keysym name ("Left", "Up", ...), or 0 if the keyboard map has none. */
+int keys_keycode(keys_t *k, const char *keysym_name) {
+    KeySym sym = XStringToKeysym(keysym_name);
+    if (sym == NoSymbol) return 0;
+    return XKeysymToKeycode(k->dpy, sym);
+}
+
+/* Press and release one key. Returns 0, or -1 for a keycode the server does not have. */
+int keys_tap(keys_t *k, int keycode) {
+    if (keycode < k->min_keycode || keycode > k->max_keycode) return -1;
+    XTestFakeKeyEvent(k->dpy, (unsigned)keycode, True, CurrentTime);
+    XTestFakeKeyEvent(k->dpy, (unsigned)keycode, False, CurrentTime);
+    XSync(k->dpy, False);
+    return 0;
+}
@@ -0,0 +1,173 @@
+"""
+Key press backends for the play loop (open_keys, STRATEGY_2048_INPUT). Each has press(direction) for
+"left"/"right"/"up"/"down", a name and close().
+
+  pyautogui  pyautogui.press: portable, but every call checks the fail-safe corner and then sleeps
+             pyautogui.PAUSE (0.1 s by default) after the key.
+  xtest      libinput_x11.so (input_x11.c, build line there): fake key events over one X connection
+             kept open for the life of the bot; press() returns once the server has the key. X11 and
+             Xvfb.
+  uinput     a virtual keyboard on /dev/uinput (needs write access to it, e.g. the input group). The
+             key goes through the kernel like a real keyboard, so it works under Wayland as well, but
+             not into Xvfb, which reads no input devices.
+
+measure_press_to_frame() times a key press to the first frame that shows the board changing; that is
+the input path's share of the settle time (utilities/input_latency.py compares the backends).
+"""
+
+import ctypes
+import fcntl
+import os
+import struct
+import time
+from typing import Callable, List, Optional
+
+import numpy as np
+import pyautogui
+
+LIB_PATH = os.path.join(os.path.dirname(__file__), "libinput_x11.so")
+DIRECTIONS = ("left", "right", "up", "down")
+
+_lib: Optional[ctypes.CDLL] = None
+
+
+def _load(path: str) -> ctypes.CDLL:
+    global _lib
+    if _lib is None:
+        lib = ctypes.CDLL(path)
+        lib.keys_open.restype = ctypes.c_void_p
+        lib.keys_open.argtypes = [ctypes.c_char_p]
+        lib.keys_close.restype = None
+        lib.keys_close.argtypes = [ctypes.c_void_p]
+        lib.keys_keycode.restype = ctypes.c_int
+        lib.keys_keycode.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        lib.keys_tap.restype = ctypes.c_int
+        lib.keys_tap.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        _lib = lib
+    return _lib
+
+
+class PyautoguiKeys:
+    name = "pyautogui"
+
+    def press(self, direction: str) -> None:
+        pyautogui.press(direction)
+
+    def close(self) -> None:
+        pass
+
+
+class XTestKeys:
+    name = "xtest"
+
+    def __init__(self, display: Optional[str] = None, lib_path: str = LIB_PATH):
+        if not os.environ.get("DISPLAY") and display is None:
+            raise OSError("no DISPLAY")
+        self.lib = _load(lib_path)  # OSError if it was not built
+        self.handle = self.lib.keys_open(display.encode() if display else None)
+        if not self.handle:
+            raise OSError("cannot open the display or it has no XTEST extension")
+        self.keycodes = {}
+        for d in DIRECTIONS:
+            code = self.lib.keys_keycode(self.handle, d.capitalize().encode())
+            if not code:
+                self.close()
+                raise OSError(f"no keycode for {d}")
+            self.keycodes[d] = code
+
+    def press(self, direction: str) -> None:
+        if self.lib.keys_tap(self.handle, self.keycodes[direction]) != 0:
+            raise OSError("XTEST key press failed")
+
+    def close(self) -> None:
+        if self.handle:
+            self.lib.keys_close(self.handle)
+            self.handle = None
+
+
+class UinputKeys:
+    """Virtual keyboard with the four arrow keys (linux/uinput.h, 64-bit struct layouts)."""
+
+    name = "uinput"
+
+    UI_DEV_CREATE = 0x5501
+    UI_DEV_DESTROY = 0x5502
+    UI_DEV_SETUP = 0x405C5503  # _IOW('U', 3, struct uinput_setup), 92 bytes
+    UI_SET_EVBIT = 0x40045564
+    UI_SET_KEYBIT = 0x40045565
+    EV_SYN, EV_KEY, SYN_REPORT = 0, 1, 0
+    BUS_VIRTUAL = 0x06
+    KEYS = {"up": 103, "left": 105, "right": 106, "down": 108}
+
+    def __init__(self, path: str = "/dev/uinput", settle: float = 0.5):
+        self.fd = os.open(path, os.O_WRONLY | os.O_NONBLOCK)  # OSError without access
+        try:
+            fcntl.ioctl(self.fd, self.UI_SET_EVBIT, self.EV_KEY)
+            for code in self.KEYS.values():
+                fcntl.ioctl(self.fd, self.UI_SET_KEYBIT, code)
+            setup = struct.pack("HHHH80sI", self.BUS_VIRTUAL, 0x2048, 0x2048, 1, b"2048 bot keyboard", 0)
+            fcntl.ioctl(self.fd, self.UI_DEV_SETUP, setup)
+            fcntl.ioctl(self.fd, self.UI_DEV_CREATE)
+        except OSError:
+            os.close(self.fd)
+            raise
+        time.sleep(settle)  # the display server picks the new device up asynchronously
+
+    def _event(self, kind: int, code: int, value: int) -> bytes:
+        return struct.pack("llHHi", 0, 0, kind, code, value)
+
+    def press(self, direction: str) -> None:
+        code = self.KEYS[direction]
+        os.write(self.fd, self._event(self.EV_KEY, code, 1) + self._event(self.EV_SYN, self.SYN_REPORT, 0)
+                 + self._event(self.EV_KEY, code, 0) + self._event(self.EV_SYN, self.SYN_REPORT, 0))
+
+    def close(self) -> None:
+        if self.fd is not None:
+            try:
+                fcntl.ioctl(self.fd, self.UI_DEV_DESTROY)
+            finally:
+                os.close(self.fd)
+                self.fd = None
+
+
+def open_keys(backend: str = "pyautogui"):
+    """Key press backend for the play loop. "xtest", "uinput" or "pyautogui"; "auto" = the first of
+    xtest, uinput, pyautogui that opens. A named backend that cannot open falls back to pyautogui."""
+    makers = {"xtest": XTestKeys, "uinput": UinputKeys}
+    for name in (("xtest", "uinput") if backend == "auto" else (backend,) if backend in makers else ()):
+        try:
+            return makers[name]()
+        except OSError as e:
+            if backend != "auto":
+                print(f"Warning: {name} input unavailable ({e}); using pyautogui.")
+    return PyautoguiKeys()
+
+
+def measure_press_to_frame(
+    press: Callable[[str], None],
+    grab: Callable[[], object],
+    signature: Callable[[object], np.ndarray],
+    direction: str,
+    tolerance: float = 3.0,
+    timeout: float = 1.0,
+) -> Optional[float]:
+    """Seconds from calling press(direction) to the capture start of the first frame whose signature
+    differs from the frame before the press, grabbing back to back; None if the board did not change
+    within `timeout` (the move was not possible, or the key went nowhere)."""
+    before = signature(grab())
+    t0 = time.perf_counter()
+    press(direction)
+    while True:
+        t = time.perf_counter()
+        if np.abs(signature(grab()) - before).max() > tolerance:
+            return t - t0
+        if t - t0 > timeout:
+            return None
+
+
+def latency_summary(samples: List[float]) -> str:
+    if not samples:
+        return "n=0"
+    ms = sorted(s * 1000.0 for s in samples)
+    return (f"n={len(ms)} mean={sum(ms) / len(ms):.1f} p50={ms[len(ms) // 2]:.1f} "
+            f"p99={ms[min(len(ms) - 1, int(len(ms) * 0.99))]:.1f} max={ms[-1]:.1f} ms")
@@ -0,0 +1,248 @@
+/*
+ * Perft for the 2048 move generator: enumerates the full expectimax tree from a board to a given
+ * depth (every legal move, every empty cell, both spawn values) with no sampling cap, pruning or
+ * caching, and prints exact node counts per ply.
+ *
+ * Build: gcc -O3 -march=native -o perft_2048 perft_2048.c -lm -lpthread
+ * Run:   ./perft_2048 [--depth 6] [--threads 1] [--impl grid|packed] [--verify] < board.txt
+ *        (board: 4 lines of 4 ints, as for strategy_2048)
+ *
+ * Depth counts plies the way expectimax does: ply 0 is the root max node, odd plies are chance nodes
+ * (afterstates of a legal move), even plies are max nodes (afterstate + one spawned 2 or 4).
+ * --impl grid walks the tree with do_move/rotate_cw on grid_t, --impl packed with board_move on the
+ * packed board_t. Both print a per-ply checksum of the boards visited, so the two trees can be diffed.
+ * --verify walks with board_move and re-derives every child with do_move, failing on any difference.
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "strategy_2048.c"
+#include "bench_common.h"
+
+#define PERFT_MAX_PLY 32
+
+typedef struct {
+    unsigned long long nodes[PERFT_MAX_PLY + 1];
+    unsigned long long checksum[PERFT_MAX_PLY + 1];
+    unsigned long long mismatches;
+} perft_counts_t;
+
+static int perft_depth = 6;
+
+static void visit(perft_counts_t *pc, int ply, board_t b) {
+    pc->nodes[ply]++;
+    pc->checksum[ply] += mix64(b + (board_t)ply);
+}
+
+/* grid_t walk: do_move + per-cell spawn, as expectimax_impl does it (minus the cap and cache). */
+static void perft_grid(perft_counts_t *pc, grid_t g, int ply, int is_max) {
+    visit(pc, ply, pack_grid(g));
+    if (ply == perft_depth) return;
+    if (is_max) {
+        for (int dir = 0; dir < 4; dir++) {
+            grid_t next;
+            grid_copy(next, g);
+            int score;
+            if (!do_move(next, dir, &score)) continue;
+            perft_grid(pc, next, ply + 1, 0);
+        }
+    } else {
+        for (int r = 0; r < N; r++)
+            for (int c = 0; c < N; c++) {
+                if (g[r][c] != 0) continue;
+                for (int val = 2; val <= 4; val += 2) {
+                    g[r][c] = val;
+                    perft_grid(pc, g, ply + 1, 1);
+                }
+                g[r][c] = 0;
+            }
+    }
+}
+
+static void perft_packed(perft_counts_t *pc, board_t b, int ply, int is_max) {
+    visit(pc, ply, b);
+    if (ply == perft_depth) return;
+    if (is_max) {
+        for (int dir = 0; dir < 4; dir++) {
+            int score;
+            board_t next = board_move(b, dir, &score);
+            if (next == b) continue;
+            perft_packed(pc, next, ply + 1, 0);
+        }
+    } else {
+        for (int shift = 4 * (N * N - 1); shift >= 0; shift -= 4) {
+            if ((b >> shift) & 15) continue;
+            perft_packed(pc, b | (1ULL << shift), ply + 1, 1);
+            perft_packed(pc, b | (2ULL << shift), ply + 1, 1);
+        }
+    }
+}
+
+static void perft_verify(perft_counts_t *pc, board_t b, int ply, int is_max) {
+    visit(pc, ply, b);
+    if (ply == perft_depth) return;
+    if (is_max) {
+        for (int dir = 0; dir < 4; dir++) {
+            int score, gscore;
+            board_t next = board_move(b, dir, &score);
+            grid_t g;
+            unpack_grid(b, g);
+            int gchanged = do_move(g, dir, &gscore);
+            if (gchanged != (next != b) || gscore != score || pack_grid(g) != next) {
+                if (pc->mismatches++ < 10)
+                    fprintf(stderr, "verify: board %016llx dir %s: board_move %016llx (%d) vs do_move %016llx (%d)\n",
+                            b, dir_name(dir), next, score, pack_grid(g), gscore);
+            }
+            if (next == b) continue;
+            perft_verify(pc, next, ply + 1, 0);
+        }
+    } else {
+        grid_t g;
+        unpack_grid(b, g);
+        if (board_count_empty(b) != count_empty(g) && pc->mismatches++ < 10)
+            fprintf(stderr, "verify: board %016llx: empty count differs\n", b);
+        for (int shift = 4 * (N * N - 1); shift >= 0; shift -= 4) {
+            if ((b >> shift) & 15) continue;
+            perft_verify(pc, b | (1ULL << shift), ply + 1, 1);
+            perft_verify(pc, b | (2ULL << shift), ply + 1, 1);
+        }
+    }
+}
+
+enum { IMPL_GRID, IMPL_PACKED, IMPL_VERIFY };
+
+/* Work is split at ply 2 (root move x spawn); threads pull subtrees from a shared counter. */
+typedef struct {
+    board_t *roots;
+    int nroots;
+    int impl;
+    int next;
+    pthread_mutex_t lock;
+} perft_queue_t;
+
+typedef struct {
+    perft_queue_t *q;
+    perft_counts_t counts;
+} perft_worker_t;
+
+static void *perft_worker(void *arg_) {
+    perft_worker_t *w = (perft_worker_t *)arg_;
+    perft_queue_t *q = w->q;
+    memset(&w->counts, 0, sizeof w->counts);
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        int i = q->next++;
+        pthread_mutex_unlock(&q->lock);
+        if (i >= q->nroots) break;
+        board_t b = q->roots[i];
+        if (q->impl == IMPL_GRID) {
+            grid_t g;
+            unpack_grid(b, g);
+            perft_grid(&w->counts, g, 2, 1);
+        } else if (q->impl == IMPL_PACKED) {
+            perft_packed(&w->counts, b, 2, 1);
+        } else {
+            perft_verify(&w->counts, b, 2, 1);
+        }
+    }
+    return NULL;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: perft_2048 [--depth D] [--threads T] [--impl grid|packed] [--verify] < board\n");
+}
+
+int main(int argc, char **argv) {
+    int nthreads = 1, impl = IMPL_GRID;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--verify") == 0) { impl = IMPL_VERIFY; continue; }
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 2; }
+        if (strcmp(a, "--depth") == 0) perft_depth = atoi(v);
+        else if (strcmp(a, "--threads") == 0) nthreads = atoi(v);
+        else if (strcmp(a, "--impl") == 0 && strcmp(v, "grid") == 0) impl = IMPL_GRID;
+        else if (strcmp(a, "--impl") == 0 && strcmp(v, "packed") == 0) impl = IMPL_PACKED;
+        else { usage(); return 2; }
+        i++;
+    }
+    if (perft_depth < 0 || perft_depth > PERFT_MAX_PLY) {
+        fprintf(stderr, "perft_2048: depth must be 0..%d\n", PERFT_MAX_PLY);
+        return 2;
+    }
+    if (nthreads < 1) nthreads = 1;
+
+    grid_t grid;
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++)
+            if (scanf("%d", &grid[r][c]) != 1)
+                grid[r][c] = 0;
+    init_move_tables();
+    board_t root = pack_grid(grid);
+
+    double t0 = now_sec();
+    perft_counts_t total;
+    memset(&total, 0, sizeof total);
+    visit(&total, 0, root);
+
+    /* Plies 0 and 1 are expanded here so the ply-2 subtrees can be handed out. */
+    board_t *roots = NULL;
+    int nroots = 0;
+    if (perft_depth >= 1) {
+        roots = (board_t *)malloc(4 * 2 * N * N * sizeof(board_t));
+        for (int dir = 0; dir < 4; dir++) {
+            int score;
+            board_t after;
+            if (impl == IMPL_GRID) {
+                grid_t g;
+                grid_copy(g, grid);
+                if (!do_move(g, dir, &score)) continue;
+                after = pack_grid(g);
+            } else {
+                after = board_move(root, dir, &score);
+                if (after == root) continue;
+            }
+            visit(&total, 1, after);
+            if (perft_depth < 2) continue;
+            for (int shift = 4 * (N * N - 1); shift >= 0; shift -= 4) {
+                if ((after >> shift) & 15) continue;
+                roots[nroots++] = after | (1ULL << shift);
+                roots[nroots++] = after | (2ULL << shift);
+            }
+        }
+    }
+
+    perft_queue_t q = { roots, nroots, impl, 0, PTHREAD_MUTEX_INITIALIZER };
+    perft_worker_t *workers = (perft_worker_t *)calloc(nthreads, sizeof(perft_worker_t));
+    pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    for (int t = 0; t < nthreads; t++) {
+        workers[t].q = &q;
+        pthread_create(&threads[t], NULL, perft_worker, &workers[t]);
+    }
+    for (int t = 0; t < nthreads; t++) {
+        pthread_join(threads[t], NULL);
+        for (int p = 0; p <= PERFT_MAX_PLY; p++) {
+            total.nodes[p] += workers[t].counts.nodes[p];
+            total.checksum[p] += workers[t].counts.checksum[p];
+        }
+        total.mismatches += workers[t].counts.mismatches;
+    }
+    double dt = now_sec() - t0;
+
+    unsigned long long sum = 0;
+    printf("ply\ttype\tnodes\tchecksum\n");
+    for (int p = 0; p <= perft_depth; p++) {
+        printf("%d\t%s\t%llu\t%016llx\n", p, p % 2 ? "chance" : "max", total.nodes[p], total.checksum[p]);
+        sum += total.nodes[p];
+    }
+    static const char *impl_names[] = { "grid", "packed", "verify" };
+    printf("# impl=%s threads=%d depth=%d nodes=%llu time=%.3fs nodes_per_sec=%.0f\n",
+           impl_names[impl], nthreads, perft_depth, sum, dt, dt > 0 ? sum / dt : 0);
+    free(roots);
+    free(workers);
+    free(threads);
+    if (impl == IMPL_VERIFY && total.mismatches) {
+        fprintf(stderr, "perft_2048: %llu move mismatches between board_move and do_move\n", total.mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,290 @@
+"""
+Pipeline stages for the bot's live play loop (bot_2048.pipelined_play_loop): capture, search and key
+injection overlap instead of running back to back with a fixed sleep.
+
+  capture thread   grab the board region → FrameRing (small, newest frames, backpressure)
+  search stage     the caller's thread: take the newest frame, classify it, wait until the board read is
+                   stable, choose a move, hand it to the input stage, hold the ring until the key is sent
+  input thread     press the key, start the engine's speculation, release the ring for frames captured
+                   after the press
+
+The ring never hands out a frame twice and drops (without classifying) every frame older than the one
+taken, and every frame captured before the last key press. Capture blocks while the ring is held
+(search and key press in progress) or full, so it does not compete with the search for the CPU.
+
+The stages record their spans into stage_trace.TRACE (grab inside the capture backends, press inside
+the caller's press function); the search stage adds settle, and the report gives moves per minute of
+wall-clock time from the first key press to the last.
+
+SettleModel learns how long this host takes from a key press to a still board (the slide / merge
+animation plus input and compositor latency) and keeps it per host in settle_profile.json. Both loops
+wait that long before they start looking at frames. The sequential loop then polls with
+wait_for_stable_frame until consecutive frames agree, instead of sleeping a fixed time.
+
+The stages take plain callables (grab, press), so they run without a screen too.
+"""
+
+import json
+import os
+import queue
+import socket
+import threading
+import time
+from collections import deque
+from typing import Any, Callable, List, NamedTuple, Optional, Tuple
+
+import numpy as np
+
+SETTLE_PROFILE_PATH = os.path.join(os.path.dirname(__file__), "settle_profile.json")
+
+
+class Frame(NamedTuple):
+    seq: int
+    t_start: float  # time.perf_counter() when the grab began
+    t_done: float
+    image: Any
+
+
+class FrameRing:
+    """The newest `capacity` frames. take() returns the newest frame not taken yet and drops every
+    older one; publish() blocks while the ring is held or `capacity` frames are waiting."""
+
+    def __init__(self, capacity: int = 2):
+        self.capacity = capacity
+        self.frames: List[Frame] = []
+        self.seq = 0
+        self.not_before = 0.0
+        self.held = False
+        self.closed = False
+        self.dropped = 0
+        self.cond = threading.Condition()
+
+    def publish(self, image: Any, t_start: float, t_done: float) -> bool:
+        """Adds a frame; False once the ring is closed."""
+        with self.cond:
+            if self.closed:
+                return False
+            self.seq += 1
+            self.frames.append(Frame(self.seq, t_start, t_done, image))
+            self.cond.notify_all()
+            return True
+
+    def wait_for_room(self) -> bool:
+        """Blocks the capture stage until a new frame is wanted (not held, not full, past the settle time
+        of the last release); False once the ring is closed."""
+        with self.cond:
+            while not self.closed:
+                if self.held or len(self.frames) >= self.capacity:
+                    self.cond.wait()
+                    continue
+                early = self.not_before - time.perf_counter()
+                if early <= 0:
+                    break
+                self.cond.wait(early)
+            return not self.closed
+
+    def take(self, timeout: float) -> Optional[Frame]:
+        """Newest frame captured at or after the last release, or None after `timeout` seconds."""
+        deadline = time.perf_counter() + timeout
+        with self.cond:
+            while True:
+                fresh = [f for f in self.frames if f.t_start >= self.not_before]
+                self.dropped += len(self.frames) - len(fresh)
+                self.frames = fresh
+                if fresh and not self.held:
+                    break
+                left = deadline - time.perf_counter()
+                if self.closed or left <= 0:
+                    return None
+                self.cond.wait(left)
+            frame = fresh[-1]
+            self.dropped += len(self.frames) - 1
+            self.frames = []
+            self.cond.notify_all()
+            return frame
+
+    def hold(self) -> None:
+        """No frames until release(): a move is being chosen and sent."""
+        with self.cond:
+            self.held = True
+
+    def release(self, not_before: float) -> None:
+        """Frames are wanted again; the ones captured before `not_before` are stale."""
+        with self.cond:
+            self.held = False
+            self.not_before = not_before
+            stale = [f for f in self.frames if f.t_start < not_before]
+            self.dropped += len(stale)
+            self.frames = [f for f in self.frames if f.t_start >= not_before]
+            self.cond.notify_all()
+
+    def close(self) -> None:
+        with self.cond:
+            self.closed = True
+            self.cond.notify_all()
+
+
+class CaptureStage(threading.Thread):
+    """Grabs frames into the ring whenever it wants one; pause() stops grabbing (e.g. while the user
+    corrects colors), resume() starts again."""
+
+    def __init__(self, grab: Callable[[], Any], ring: FrameRing):
+        super().__init__(name="capture", daemon=True)
+        self.grab = grab
+        self.ring = ring
+        self.running = threading.Event()
+        self.running.set()
+        self.error: Optional[BaseException] = None
+
+    def run(self) -> None:
+        try:
+            while self.ring.wait_for_room():
+                self.running.wait()
+                t0 = time.perf_counter()
+                image = self.grab()
+                t1 = time.perf_counter()
+                if not self.ring.publish(image, t0, t1):
+                    break
+        except BaseException as e:  # surfaced to the search stage, which stops
+            self.error = e
+            self.ring.close()
+
+    def pause(self) -> None:
+        self.running.clear()
+
+    def resume(self) -> None:
+        self.running.set()
+
+
+class InputStage(threading.Thread):
+    """Presses the keys it is sent, one at a time. After each press it calls after_press(direction, t)
+    (speculation, ring release)."""
+
+    def __init__(self, press: Callable[[str], None], after_press: Callable[[str, float], None]):
+        super().__init__(name="input", daemon=True)
+        self.press = press
+        self.after_press = after_press
+        self.pending: "queue.Queue[Optional[str]]" = queue.Queue(maxsize=1)
+        self.error: Optional[BaseException] = None
+
+    def send(self, direction: str) -> None:
+        self.pending.put(direction)
+
+    def stop(self) -> None:
+        try:
+            self.pending.put(None, timeout=1.0)
+        except queue.Full:  # the thread died with a key pending
+            pass
+
+    def run(self) -> None:
+        try:
+            while True:
+                direction = self.pending.get()
+                if direction is None:
+                    break
+                self.press(direction)
+                self.after_press(direction, time.perf_counter())
+        except BaseException as e:
+            self.error = e
+
+
+class SettleModel:
+    """Recent settle times (key press → still board, seconds) of this host, persisted per host name.
+    first_poll() is how long to wait before the first frame is worth grabbing, timeout() how long to
+    wait for a still board at most."""
+
+    def __init__(self, path: str = SETTLE_PROFILE_PATH, host: Optional[str] = None, initial: float = 0.08,
+                 keep: int = 200):
+        self.path = path
+        self.host = host or socket.gethostname()
+        self.samples: "deque[float]" = deque(maxlen=keep)
+        self.lock = threading.Lock()
+        try:
+            with open(path, "r", encoding="utf-8") as f:
+                saved = json.load(f).get(self.host, [])
+            self.samples.extend(float(ms) / 1000.0 for ms in saved if isinstance(ms, (int, float)))
+        except (OSError, ValueError, AttributeError):
+            pass
+        if not self.samples:
+            self.samples.append(initial)
+
+    def _quantile(self, q: float) -> float:
+        with self.lock:
+            v = sorted(self.samples)
+        return v[min(len(v) - 1, int(len(v) * q))]
+
+    def observe(self, seconds: float) -> None:
+        with self.lock:
+            self.samples.append(seconds)
+
+    def first_poll(self) -> float:
+        """Most boards are still later than this: 80% of the 10th percentile."""
+        return 0.8 * self._quantile(0.1)
+
+    def typical(self) -> float:
+        return self._quantile(0.5)
+
+    def timeout(self) -> float:
+        return max(0.5, 3.0 * self._quantile(0.95))
+
+    def save(self) -> None:
+        try:
+            with open(self.path, "r", encoding="utf-8") as f:
+                data = json.load(f)
+            if not isinstance(data, dict):
+                data = {}
+        except (OSError, ValueError):
+            data = {}
+        with self.lock:
+            data[self.host] = [round(s * 1000.0, 1) for s in self.samples]
+        try:
+            with open(self.path, "w", encoding="utf-8") as f:
+                json.dump(data, f)
+        except OSError as e:
+            print(f"Warning: could not save {self.path}: {e}")
+
+
+def wait_for_stable_frame(
+    grab: Callable[[], Any],
+    signature: Callable[[Any], np.ndarray],
+    before: Optional[np.ndarray],
+    pressed_at: float,
+    model: SettleModel,
+    stable_frames: int = 2,
+    tolerance: float = 3.0,
+    stale_after: float = 0.5,
+    poll: float = 0.005,
+) -> Tuple[Any, str]:
+    """Polls grab() after a key press at `pressed_at` (perf_counter) until `stable_frames` frames in a
+    row have the same signature (patch means, no channel more than `tolerance` apart), starting
+    model.first_poll() after the press. A board still equal to `before` (the one the key was pressed
+    on) only counts after `stale_after` s: the animation may not have started. Grabs are at least
+    `poll` s apart. Returns the last frame
+    and "stable", "unchanged" (stable but equal to `before`) or "timeout"; a stable board's settle time
+    (press to its first frame) is fed to the model."""
+    wait = pressed_at + model.first_poll() - time.perf_counter()
+    if wait > 0:
+        time.sleep(wait)
+    deadline = pressed_at + model.timeout()
+    run_start = 0.0
+    run_sig: Optional[np.ndarray] = None
+    streak = 0
+    while True:
+        t0 = time.perf_counter()
+        frame = grab()
+        sig = signature(frame)
+        if run_sig is not None and np.abs(sig - run_sig).max() <= tolerance:
+            streak += 1
+        else:
+            run_sig, run_start, streak = sig, t0, 1
+        if streak >= stable_frames:
+            if before is None or np.abs(sig - before).max() > tolerance:
+                model.observe(run_start - pressed_at)
+                return frame, "stable"
+            if t0 - pressed_at >= stale_after:
+                return frame, "unchanged"
+        if t0 >= deadline:
+            return frame, "timeout"
+        wait = t0 + poll - time.perf_counter()
+        if wait > 0:
+            time.sleep(wait)
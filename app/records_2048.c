@@ -0,0 +1,134 @@
+/*
+ * Reads game record files (game_record.h) straight from the mapping: replays every game, checks it
+ * (each recorded move is legal, the replayed score matches the header) and reports how fast positions
+ * come off the file. --dump prints one game position by position.
+ *
+ * Build: gcc -O3 -march=native -o records_2048 records_2048.c -lm -lpthread
+ * Run:   ./records_2048 games.rec [more.rec ...]
+ *        ./records_2048 --dump GAME games.rec
+ *
+ * Output (stdout, one line): records files= games= positions= continued= open= bad_moves= bad_scores=
+ * mean_score= max_score= positions_per_sec= seconds=
+ * (open = games a streaming writer never closed; bad_moves = recorded moves that do not change the
+ * board; bad_scores = closed games whose replayed score differs from final_score).
+ * --dump: TSV step dir value ms board, board as 16 tile values in row order (the final board has step
+ * = nsteps and no move).
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "strategy_2048.c"
+#include "bench_common.h"
+#include "game_record.h"
+
+typedef struct {
+    long games, positions, continued, open, bad_moves, bad_scores;
+    double score_sum;
+    uint32_t max_score;
+} record_stats_t;
+
+static const char *dir_names[4] = { "up", "right", "down", "left" };
+
+static void print_board_cells(board_t b) {
+    for (int i = N * N - 1; i >= 0; i--) {
+        int code = (int)((b >> (4 * i)) & 15);
+        printf("%c%d", i == N * N - 1 ? '\t' : ' ', code ? 1 << code : 0);
+    }
+}
+
+static void dump_game(const gr_game_t *g) {
+    printf("step\tdir\tvalue\tms\tboard\n");
+    board_t b = g->h.initial;
+    for (uint32_t i = 0; i < g->h.nsteps; i++) {
+        unsigned int code = gr_step_code(g, i);
+        printf("%u\t%s\t%.1f\t%.3f", i, dir_names[code & 3], gr_step_value(g, i), gr_step_ms(g, i));
+        print_board_cells(b);
+        printf("\n");
+        int gained;
+        b = gr_apply_step(b, code, &gained);
+    }
+    printf("%u\t-\t-\t-", g->h.nsteps);
+    print_board_cells(b);
+    printf("\n");
+}
+
+static void scan_file(const gr_file_t *f, record_stats_t *st) {
+    size_t off = 0;
+    gr_game_t g;
+    while (gr_next_game(f, &off, &g)) {
+        const unsigned char *raw = f->base + g.offset;
+        uint32_t nsteps_raw;
+        memcpy(&nsteps_raw, raw + offsetof(gr_game_header_t, nsteps), 4);
+        board_t b = g.h.initial;
+        uint32_t score = 0;
+        for (uint32_t i = 0; i < g.h.nsteps; i++) {
+            unsigned int code = gr_step_code(&g, i);
+            int gained;
+            st->bad_moves += board_move(b, (int)(code & 3), &gained) == b;
+            b = gr_apply_step(b, code, &gained);
+            score += (uint32_t)gained;
+        }
+        st->games++;
+        st->positions += g.h.nsteps + 1;
+        st->continued += (g.h.flags & GR_CONTINUED) != 0;
+        if (nsteps_raw == GR_OPEN) {
+            st->open++;
+        } else {
+            st->bad_scores += score != g.h.final_score;
+            st->score_sum += g.h.final_score;
+            if (g.h.final_score > st->max_score) st->max_score = g.h.final_score;
+        }
+    }
+    if (off && off < f->size)
+        fprintf(stderr, "records_2048: %zu trailing bytes after the last game\n", f->size - off);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: records_2048 FILE.rec [FILE.rec ...]\n"
+                    "       records_2048 --dump GAME FILE.rec\n");
+}
+
+int main(int argc, char **argv) {
+    int dump = -1, first = 1;
+    if (argc > 3 && strcmp(argv[1], "--dump") == 0) {
+        dump = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || argv[first][0] == '-') { usage(); return 2; }
+    init_move_tables();
+
+    if (dump >= 0) {
+        gr_file_t f;
+        if (gr_open(argv[first], &f) != 0) return 1;
+        size_t off = 0;
+        gr_game_t g;
+        int i = 0, found = 0;
+        while (!found && gr_next_game(&f, &off, &g))
+            found = i++ == dump;
+        if (!found) {
+            fprintf(stderr, "records_2048: %s has no game %d\n", argv[first], dump);
+            gr_close(&f);
+            return 1;
+        }
+        dump_game(&g);
+        gr_close(&f);
+        return 0;
+    }
+
+    record_stats_t st;
+    memset(&st, 0, sizeof st);
+    double t0 = now_sec();
+    for (int i = first; i < argc; i++) {
+        gr_file_t f;
+        if (gr_open(argv[i], &f) != 0) return 1;
+        scan_file(&f, &st);
+        gr_close(&f);
+    }
+    double elapsed = now_sec() - t0;
+    long closed = st.games - st.open;
+    printf("records files=%d games=%ld positions=%ld continued=%ld open=%ld bad_moves=%ld bad_scores=%ld"
+           " mean_score=%.1f max_score=%u positions_per_sec=%.0f seconds=%.3f\n",
+           argc - first, st.games, st.positions, st.continued, st.open, st.bad_moves, st.bad_scores,
+           closed ? st.score_sum / closed : 0.0, st.max_score, elapsed > 0 ? st.positions / elapsed : 0.0,
+           elapsed);
+    return st.bad_moves || st.bad_scores ? 1 : 0;
+}
@@ -0,0 +1,345 @@
+/*
+ * Seeded self-play with the strategy_2048 engine: plays whole games at a fixed search depth (or under the
+ * bot's depth policy), one game per thread at a time, and reports the score distribution and decision
+ * latency. Game i always sees the same spawns for a given --seed, so two weight sets, evaluators or
+ * policies can be compared on identical games.
+ *
+ * Build: gcc -O3 -march=native -o selfplay_2048 selfplay_2048.c -lm -lpthread
+ * Run:   ./selfplay_2048 [--games 100] [--depth 3] [--threads N] [--seed 1] [--samples 10]
+ *                        [--weights eval_weights.json] [--eval heuristic|ntuple:PATH] [--cache-bits 16]
+ *                        [--out games.tsv] [--record games.rec] [--export PREFIX [--shard-records 4194304]]
+ *                        [--policy depth_low depth_high serious_empty serious_max_tile max_empty_samples timeout_sec]
+ *                        [--search expectimax|mcts [--mcts-playouts 2000] [--mcts-leaf greedy|random|eval]
+ *                         [--mcts-c 3]]
+ *
+ * --policy replaces --depth/--samples with strategy_2048's positional policy: depth_high on serious boards,
+ * else depth_low, with iterative deepening from depth_low under a timeout, as search_root does.
+ * Each thread searches with search_fixed_depth on its own transposition table of 2^cache-bits entries
+ * (cleared every move, so keep it small for shallow depths). --out writes one TSV row per game:
+ * game seed score max_tile moves seconds. --record appends every game to a game record file
+ * (game_record.h) with the search value and decision time of each move. --export streams every
+ * decision (board, the four root values, move, depth) to training-data shards PREFIX-NNNNN.td
+ * (train_data.h) through a background writer thread.
+ *
+ * --search mcts plays with Monte Carlo tree search instead (mcts_decide, one tree per thread):
+ * --mcts-playouts playouts per move, or under --policy the timeout on serious boards. Exported depths
+ * are then the deepest tree ply. mean_ms is single-thread CPU time per move, so it compares strength per
+ * CPU-second against expectimax on the same seeds.
+ *
+ * Output (stdout, one line): selfplay games= depth= mean_score= median_score= sem_score= min_score=
+ * max_score= reach_2048= reach_4096= reach_8192= moves_per_sec= seconds= mean_ms= p50_ms= p99_ms= max_ms=
+ * (depth=0 under --policy or --search mcts; *_ms are per-decision search latencies, in-process, with the
+ * games running in parallel, so use no more threads than cores when comparing latency).
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "strategy_2048.c"
+#include "bench_common.h"
+#include "game_record.h"
+#include "train_data.h"
+
+typedef struct {
+    unsigned long long seed;
+    int score;
+    int max_tile;
+    int moves;
+    double seconds;
+} game_result_t;
+
+static int games = 100, depth = 3;
+static int use_policy = 0, timeout_sec = 0;
+static unsigned long long base_seed = 1;
+static game_result_t *results;
+static int next_game = 0; /* atomic */
+static FILE *record_file = NULL;
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static td_writer_t *export_writer = NULL;
+static __thread mcts_tree_t *player_tree; /* --search mcts */
+
+/* Per-decision latencies of one player thread (ms), merged after the run. */
+typedef struct {
+    double *ms;
+    size_t n, cap;
+} latency_log_t;
+
+static void latency_add(latency_log_t *log, double ms) {
+    if (log->n == log->cap) {
+        log->cap = log->cap ? 2 * log->cap : 65536;
+        log->ms = (double *)realloc(log->ms, log->cap * sizeof(double));
+        if (!log->ms) {
+            fprintf(stderr, "selfplay_2048: out of memory\n");
+            exit(1);
+        }
+    }
+    log->ms[log->n++] = ms;
+}
+
+/* search_fixed_depth, keeping the four root values. */
+static int search_values(const grid_t g, int d, double values[4]) {
+    cache_clear();
+    search_move_values(g, d, values);
+    int best_dir = -1;
+    for (int dir = 0; dir < 4; dir++)
+        if (values[dir] > -1e299 && (best_dir < 0 || values[dir] > values[best_dir]))
+            best_dir = dir;
+    return best_dir;
+}
+
+/* search_root's decision on the calling thread: policy depth, iterative deepening under a timeout.
+ * values[] and *depth_out come from the search that made the decision. */
+static int choose_move(const grid_t g, double values[4], int *depth_out) {
+    if (search_mode == SEARCH_MCTS) {
+        int serious = 0;
+        if (use_policy) policy_depth(g, &serious);
+        double deadline = use_policy && timeout_sec > 0 && serious ? now_sec() + timeout_sec : 0;
+        return mcts_decide(player_tree, g, mcts_playouts, deadline, values, depth_out);
+    }
+    if (!use_policy) {
+        *depth_out = depth;
+        return search_values(g, depth, values);
+    }
+    int serious;
+    int d = policy_depth(g, &serious);
+    if (!(timeout_sec > 0 && serious)) {
+        *depth_out = d;
+        return search_values(g, d, values);
+    }
+    /* Like search_root, the best value over all iterations wins, whatever the depth. */
+    double deadline = now_sec() + timeout_sec;
+    int best_dir = -1;
+    *depth_out = 0;
+    for (int dir = 0; dir < 4; dir++) values[dir] = -1e300;
+    for (int it = depth_low; it <= d && now_sec() < deadline; it++) {
+        double v[4];
+        int dir = search_values(g, it, v);
+        if (dir >= 0 && (best_dir < 0 || v[dir] > values[best_dir])) {
+            memcpy(values, v, sizeof v);
+            best_dir = dir;
+            *depth_out = it;
+        }
+    }
+    return best_dir;
+}
+
+static unsigned long long game_seed(int game) {
+    unsigned long long s = mix64(base_seed * 0x9e3779b97f4a7c15ULL + (unsigned long long)game);
+    return s ? s : 1;
+}
+
+static void play_game(int game, game_result_t *res, latency_log_t *log, gr_game_buf_t *rec, td_buf_t *export) {
+    double t0 = now_sec();
+    unsigned long long rng = game_seed(game);
+    board_t b = board_spawn(board_spawn(0, &rng), &rng);
+    if (record_file)
+        gr_buf_begin(rec, b, game_seed(game), GR_HAS_VALUE | GR_HAS_TIME);
+    int score = 0, moves = 0;
+    for (;;) {
+        grid_t g;
+        unpack_grid(b, g);
+        double t = now_sec(), values[4];
+        int used_depth;
+        int dir = choose_move(g, values, &used_depth);
+        double ms = (now_sec() - t) * 1000.0;
+        latency_add(log, ms);
+        if (dir < 0) break;
+        if (export_writer) {
+            td_record_t r;
+            td_fill(&r, b, values, dir, used_depth, TD_FROM_SELFPLAY, (uint32_t)game);
+            td_add(export_writer, export, &r);
+        }
+        int gained, spawn_value = 0;
+        board_t after = board_move(b, dir, &gained);
+        b = board_spawn(after, &rng);
+        if (record_file) {
+            int cell = gr_find_spawn(after, b, &spawn_value);
+            gr_buf_step(rec, gr_encode_step(dir, cell, spawn_value), (float)values[dir], (float)ms);
+        }
+        score += gained;
+        moves++;
+    }
+    if (record_file) {
+        pthread_mutex_lock(&record_lock);
+        if (gr_append_game(record_file, rec, (uint32_t)score) != 0)
+            fprintf(stderr, "selfplay_2048: failed to write game record\n");
+        pthread_mutex_unlock(&record_lock);
+    }
+    res->seed = game_seed(game);
+    res->score = score;
+    res->max_tile = 1 << board_max_code(b);
+    res->moves = moves;
+    res->seconds = now_sec() - t0;
+}
+
+typedef struct {
+    cache_entry_t *cache;
+    mcts_tree_t tree;
+    latency_log_t latency;
+    gr_game_buf_t record;
+    td_buf_t export;
+} player_arg_t;
+
+static void *player(void *arg_) {
+    player_arg_t *arg = (player_arg_t *)arg_;
+    current_cache = arg->cache;
+    player_tree = &arg->tree;
+    for (;;) {
+        int game = __atomic_fetch_add(&next_game, 1, __ATOMIC_RELAXED);
+        if (game >= games) break;
+        play_game(game, &results[game], &arg->latency, &arg->record, &arg->export);
+    }
+    if (export_writer) td_flush(export_writer, &arg->export);
+    return NULL;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: selfplay_2048 [--games N] [--depth D] [--threads N] [--seed S] [--samples N]\n"
+            "                     [--weights PATH] [--eval heuristic|ntuple:PATH] [--cache-bits B] [--out FILE]\n"
+            "                     [--record FILE] [--export PREFIX [--shard-records N]]\n"
+            "                     [--policy depth_low depth_high serious_empty serious_max_tile max_empty_samples timeout_sec]\n"
+            "                     [--search expectimax|mcts [--mcts-playouts N] [--mcts-leaf greedy|random|eval] [--mcts-c C]]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL;
+    const char *export_prefix = NULL;
+    int cache_bits = 16;
+    unsigned long long shard_records = 1ULL << 22;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--policy") == 0 && i + 6 < argc) {
+            depth_low = atoi(argv[++i]);
+            depth_high = atoi(argv[++i]);
+            serious_empty = atoi(argv[++i]);
+            serious_max_tile = atoi(argv[++i]);
+            max_empty_samples = atoi(argv[++i]);
+            timeout_sec = atoi(argv[++i]);
+            use_policy = 1;
+            continue;
+        }
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 2; }
+        int r = search_option(a, v);
+        if (r < 0) return 1;
+        if (r > 0) { i++; continue; }
+        if (strcmp(a, "--games") == 0) games = atoi(v);
+        else if (strcmp(a, "--depth") == 0) depth = atoi(v);
+        else if (strcmp(a, "--threads") == 0) nthreads = atoi(v);
+        else if (strcmp(a, "--seed") == 0) base_seed = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--samples") == 0) max_empty_samples = atoi(v);
+        else if (strcmp(a, "--cache-bits") == 0) cache_bits = atoi(v);
+        else if (strcmp(a, "--out") == 0) out_path = v;
+        else if (strcmp(a, "--export") == 0) export_prefix = v;
+        else if (strcmp(a, "--shard-records") == 0) shard_records = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--record") == 0) { if (!(record_file = gr_append_open(v))) return 1; }
+        else if (strcmp(a, "--weights") == 0) { if (eval_weights_load(v, &eval_w) != 0) return 1; }
+        else if (strcmp(a, "--eval") == 0) { if (eval_select(v) != 0) return 1; }
+        else { usage(); return 2; }
+        i++;
+    }
+    if (games < 1 || depth < 1 || cache_bits < 10 || cache_bits > 28) { usage(); return 2; }
+    if (use_policy && (depth_low < 1 || depth_high < 1)) { usage(); return 2; }
+    if (nthreads <= 0) nthreads = default_thread_count();
+    if (export_prefix && !(export_writer = td_writer_open(export_prefix, shard_records))) return 1;
+    if (nthreads > games) nthreads = games;
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+
+    init_move_tables();
+    cache_size = 1ULL << cache_bits;
+    results = (game_result_t *)calloc(games, sizeof(game_result_t));
+    for (int i = 0; i < nthreads; i++)
+        if (!(caches[i] = (cache_entry_t *)calloc(cache_size, sizeof(cache_entry_t)))) {
+            fprintf(stderr, "selfplay_2048: failed to allocate cache\n");
+            return 1;
+        }
+    player_arg_t args[MAX_THREADS];
+    unsigned int tree_cap = MCTS_NODES / nthreads < (1 << 16) ? 1 << 16 : MCTS_NODES / nthreads;
+    for (int i = 0; i < nthreads && search_mode == SEARCH_MCTS; i++)
+        if (mcts_tree_init(&args[i].tree, tree_cap, 0) != 0) {
+            fprintf(stderr, "selfplay_2048: failed to allocate the MCTS tree\n");
+            return 1;
+        }
+
+    if (search_mode == SEARCH_MCTS)
+        fprintf(stderr, "selfplay_2048: %d games, MCTS %ld playouts, %s leaves, %d threads, seed %llu\n", games,
+                mcts_playouts,
+                mcts_leaf == MCTS_LEAF_EVAL ? "eval" : mcts_leaf == MCTS_LEAF_RANDOM ? "random" : "greedy",
+                nthreads, base_seed);
+    else if (use_policy)
+        fprintf(stderr, "selfplay_2048: %d games, policy %d %d %d %d %d %d, %d threads, seed %llu\n", games,
+                depth_low, depth_high, serious_empty, serious_max_tile, max_empty_samples, timeout_sec, nthreads,
+                base_seed);
+    else
+        fprintf(stderr, "selfplay_2048: %d games, depth %d, %d threads, seed %llu\n", games, depth, nthreads,
+                base_seed);
+    double t0 = now_sec();
+    pthread_t threads[MAX_THREADS];
+    for (int i = 0; i < nthreads; i++) {
+        args[i].cache = caches[i];
+        memset(&args[i].latency, 0, sizeof args[i].latency);
+        memset(&args[i].record, 0, sizeof args[i].record);
+        memset(&args[i].export, 0, sizeof args[i].export);
+        pthread_create(&threads[i], NULL, player, &args[i]);
+    }
+    size_t ndecisions = 0;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        ndecisions += args[i].latency.n;
+    }
+    double elapsed = now_sec() - t0;
+    if (export_writer) {
+        long long n = td_writer_close(export_writer);
+        if (n < 0) return 1;
+        fprintf(stderr, "selfplay_2048: exported %lld decisions to %s-*.td\n", n, export_prefix);
+    }
+
+    double *lat = (double *)malloc((ndecisions ? ndecisions : 1) * sizeof(double));
+    double lat_sum = 0;
+    size_t k = 0;
+    for (int i = 0; i < nthreads; i++) {
+        for (size_t j = 0; j < args[i].latency.n; j++) {
+            lat[k++] = args[i].latency.ms[j];
+            lat_sum += args[i].latency.ms[j];
+        }
+        free(args[i].latency.ms);
+        free(args[i].record.steps);
+        if (search_mode == SEARCH_MCTS) mcts_tree_free(&args[i].tree);
+    }
+    if (record_file) fclose(record_file);
+
+    FILE *out = out_path ? fopen(out_path, "w") : NULL;
+    if (out) fprintf(out, "game\tseed\tscore\tmax_tile\tmoves\tseconds\n");
+    double *scores = (double *)malloc(games * sizeof(double));
+    double sum = 0, sum2 = 0;
+    long total_moves = 0;
+    int reach[3] = { 0, 0, 0 };
+    for (int i = 0; i < games; i++) {
+        const game_result_t *r = &results[i];
+        if (out)
+            fprintf(out, "%d\t%llu\t%d\t%d\t%d\t%.3f\n", i, r->seed, r->score, r->max_tile, r->moves, r->seconds);
+        scores[i] = r->score;
+        sum += r->score;
+        sum2 += (double)r->score * r->score;
+        total_moves += r->moves;
+        for (int k = 0; k < 3; k++)
+            reach[k] += r->max_tile >= (2048 << k);
+    }
+    if (out) fclose(out);
+
+    double mean = sum / games;
+    double var = games > 1 ? (sum2 - games * mean * mean) / (games - 1) : 0;
+    printf("selfplay games=%d depth=%d mean_score=%.1f median_score=%.0f sem_score=%.1f min_score=%.0f"
+           " max_score=%.0f reach_2048=%.3f reach_4096=%.3f reach_8192=%.3f moves_per_sec=%.0f seconds=%.2f"
+           " mean_ms=%.3f p50_ms=%.3f p99_ms=%.3f max_ms=%.3f\n",
+           games, use_policy || search_mode == SEARCH_MCTS ? 0 : depth, mean, percentile(scores, games, 50), var > 0 ? sqrt(var / games) : 0.0,
+           percentile(scores, games, 0), percentile(scores, games, 100), (double)reach[0] / games,
+           (double)reach[1] / games, (double)reach[2] / games, elapsed > 0 ? total_moves / elapsed : 0.0, elapsed,
+           ndecisions ? lat_sum / ndecisions : 0.0, percentile(lat, (int)ndecisions, 50),
+           percentile(lat, (int)ndecisions, 99), percentile(lat, (int)ndecisions, 100));
+
+    free(lat);
+    free(scores);
+    free(results);
+    for (int i = 0; i < nthreads; i++) free(caches[i]);
+    return 0;
+}
@@ -0,0 +1,176 @@
+"""
+Per-stage latencies for the live bot: where a step's time goes between the screen grab, the 16 color
+matches, terminal printing, the engine and the wait for the animation, plus the throughput.
+
+StageStats is the one recorder for both play loops. Every traced stage is one span: (stage, thread,
+start, end) in time.perf_counter_ns(). Its duration goes into the stage's count, sum and max and into a
+deque of the newest `samples` durations, which p50/p99 are taken from, so memory stays bounded however
+long the bot plays. The span itself goes into a fixed-size ring (the newest `capacity` spans, older ones
+are overwritten) that is only read for the Chrome trace dump. Recording a span costs under 3 us, so the
+spans stay on in normal play.
+
+  from stage_trace import TRACE
+  with TRACE.span("grab"):
+      img = grab_board_image(region)
+  TRACE.add("settle", t0_ns, t1_ns)        # a span measured by the caller
+  TRACE.move_sent(t_ns)                     # a key press: the cycle stage and moves per minute
+
+  print(TRACE.report())                     # n / mean / p50 / p99 / max ms per stage since the last report
+  TRACE.export_chrome("trace.json")         # Chrome trace / Perfetto (chrome://tracing, ui.perfetto.dev)
+
+Stages recorded by the bot: grab (board_vision, capture_x11), classify and classify.incremental
+(board_vision), print, search, press, speculate, sleep and step (play_loop), settle (both loops),
+cycle (key press to key press), engine.search, engine.one_shot and engine.speculate (CStrategy, the
+engine round trip including the pipe).
+"""
+
+import json
+import os
+import threading
+import time
+from collections import defaultdict, deque
+from itertools import islice
+from typing import Deque, Dict, List, Optional, Tuple
+
+CAPACITY = 1 << 16
+SAMPLES = 1 << 13  # newest durations kept per stage for the percentiles
+
+Span = Tuple[str, int, int, int]  # stage, thread (native id), start ns, end ns
+
+
+class _Span:
+    __slots__ = ("stats", "stage", "t0")
+
+    def __init__(self, stats: "StageStats", stage: str):
+        self.stats = stats
+        self.stage = stage
+
+    def __enter__(self):
+        self.t0 = time.perf_counter_ns()
+        return self
+
+    def __exit__(self, *exc):
+        self.stats.add(self.stage, self.t0, time.perf_counter_ns())
+        return False
+
+
+class StageStats:
+    """Per-stage durations in ms (count, sum and max since the start and since the last report, the
+    newest `samples` of them for the percentiles), the newest `capacity` spans for the Chrome dump
+    (0: none) and key presses for moves per minute. add() is safe from any thread."""
+
+    def __init__(self, capacity: int = CAPACITY, samples: int = SAMPLES):
+        self.samples: Dict[str, Deque[float]] = defaultdict(lambda: deque(maxlen=samples))
+        self.totals: Dict[str, List[float]] = {}  # stage -> [n, sum, max] since the start
+        self.pending: Dict[str, List[float]] = {}  # stage -> [n, sum, max] since the last report()
+        self.capacity = capacity
+        self.spans: List[Optional[Span]] = [None] * capacity
+        self.count = 0  # spans ever added; slot = count % capacity
+        self.threads: Dict[int, str] = {}
+        self.origin = time.perf_counter_ns()
+        self.first_move: Optional[int] = None
+        self.last_move: Optional[int] = None
+        self.moves = 0
+        self.lock = threading.Lock()
+
+    def span(self, stage: str) -> _Span:
+        return _Span(self, stage)
+
+    def add(self, stage: str, t0_ns: int, t1_ns: int) -> None:
+        ms = (t1_ns - t0_ns) / 1e6
+        with self.lock:
+            self.samples[stage].append(ms)
+            for acc in (self.totals, self.pending):
+                a = acc.get(stage)
+                if a is None:
+                    acc[stage] = [1, ms, ms]
+                else:
+                    a[0] += 1
+                    a[1] += ms
+                    if ms > a[2]:
+                        a[2] = ms
+            if self.capacity:
+                tid = threading.get_native_id()
+                if tid not in self.threads:
+                    self.threads[tid] = threading.current_thread().name
+                self.spans[self.count % self.capacity] = (stage, tid, t0_ns, t1_ns)
+                self.count += 1
+
+    def move_sent(self, t_ns: int) -> None:
+        """A key press at t_ns: the time since the previous one is a cycle span."""
+        if self.last_move is not None:
+            self.add("cycle", self.last_move, t_ns)
+        with self.lock:
+            if self.first_move is None:
+                self.first_move = t_ns
+            self.last_move = t_ns
+            self.moves += 1
+
+    def moves_per_minute(self) -> float:
+        with self.lock:
+            if self.moves < 2:
+                return 0.0
+            return (self.moves - 1) * 60e9 / (self.last_move - self.first_move)
+
+    def recent(self) -> List[Span]:
+        """The spans still in the ring, oldest first."""
+        with self.lock:
+            first = max(0, self.count - self.capacity)
+            return [self.spans[i % self.capacity] for i in range(first, self.count)]
+
+    def percentiles(self, everything: bool = False) -> Dict[str, Tuple[int, float, float, float, float]]:
+        """stage -> (n, mean, p50, p99, max) in ms over the spans since the last report (everything: since
+        the start); marks them reported. p50 and p99 are taken over the newest of those spans still in
+        the stage's samples."""
+        out = {}
+        with self.lock:
+            for stage, recent in self.samples.items():
+                acc = self.totals.get(stage) if everything else self.pending.get(stage)
+                if acc is None:
+                    continue
+                n, total, mx = acc
+                v = sorted(islice(recent, max(0, len(recent) - n), None))
+                out[stage] = (n, total / n, v[len(v) // 2], v[min(len(v) - 1, int(len(v) * 0.99))], mx)
+            self.pending.clear()
+        return out
+
+    def report(self, everything: bool = False, dropped: Optional[int] = None) -> str:
+        """Table of stage, count, mean/p50/p99/max ms over the spans since the last report (everything:
+        since the start), busiest stage first, then the throughput line once a key was pressed
+        (`dropped`: frames the pipelined loop dropped unread)."""
+        rows = sorted(self.percentiles(everything).items(), key=lambda kv: -kv[1][0] * kv[1][1])
+        lines = [f"{'stage':<20} {'n':>6} {'mean':>8} {'p50':>8} {'p99':>8} {'max':>8}"]
+        for stage, (n, mean, p50, p99, mx) in rows:
+            lines.append(f"{stage:<20} {n:>6} {mean:>8.2f} {p50:>8.2f} {p99:>8.2f} {mx:>8.2f}")
+        if self.moves:
+            line = f"moves={self.moves} moves_per_min={self.moves_per_minute():.1f}"
+            if dropped is not None:
+                line += f" frames_dropped={dropped}"
+            lines.append(line)
+        return "\n".join(lines)
+
+    def export_chrome(self, path: str) -> int:
+        """Writes the ring as Chrome trace events (complete events, microseconds, one track per thread);
+        returns the number of spans written."""
+        spans = self.recent()
+        pid = os.getpid()
+        events = [
+            {"name": "thread_name", "ph": "M", "pid": pid, "tid": tid, "args": {"name": name}}
+            for tid, name in self.threads.items()
+        ]
+        for stage, tid, t0, t1 in spans:
+            events.append({
+                "name": stage,
+                "cat": stage.split(".")[0],
+                "ph": "X",
+                "pid": pid,
+                "tid": tid,
+                "ts": (t0 - self.origin) / 1000.0,
+                "dur": (t1 - t0) / 1000.0,
+            })
+        with open(path, "w", encoding="utf-8") as f:
+            json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+        return len(spans)
+
+
+TRACE = StageStats()
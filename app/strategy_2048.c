@@ -5,10 +5,36 @@
  *
  * Build: gcc -O3 -march=native -o strategy_2048 strategy_2048.c -lm -lpthread
  * Args:  [depth_low] [depth_high] [serious_empty] [serious_max_tile] [max_empty_samples] [search_timeout_sec]
+ *        [--threads N] [--eval heuristic|ntuple:PATH] [--weights PATH] [--perf] [--profile]
+ *        [--tree-dump PATH [--tree-limit N] [--tree-sample P]] [--book PATH [--book-append]]
+ *        [--search expectimax|mcts [--mcts-leaf greedy|random|eval] [--mcts-playouts N]
+ *         [--mcts-parallel root|tree] [--mcts-c C]] [--serve]
  * Defaults: 4 9 5 512 10 0  (timeout>0 => iterative deepening within that many seconds)
+ *           threads: CPUs in our affinity mask, capped by the cgroup CPU quota
+ * --eval:   leaf evaluator: the hand-weighted heuristic (default) or an n-tuple net mmap'd from PATH.
+ * --weights: heuristic weights and gamma from a JSON file (see eval_weights_t), e.g. eval_weights.json.
+ * --perf:   count cycles, instructions, LLC/dTLB/branch misses (perf_event_open) around the search
+ *           and print them per depth iteration and per decision on stderr; stdout is unchanged.
+ * --profile: per-ply search tree shape (nodes, TT hits, eval leaves, moves / spawn cells expanded,
+ *           cells cut by the sampling cap, time) per depth iteration on stderr.
+ * --tree-dump: write a bounded sample of the last iteration's tree to PATH (format: see tree_record_t).
+ * --book:   answer from a position book (see book_t) when it has the board at the policy depth or deeper,
+ *           without searching; --book-append stores every search result in it.
+ * --search: expectimax (default) or Monte Carlo tree search (see mcts_node_t). MCTS runs for the
+ *           timeout on serious boards when one is given, else --mcts-playouts playouts (default 2000);
+ *           leaves are valued by greedy (default) or random rollouts or by leaf_eval, threads grow one
+ *           tree each (root, default) or share one (tree); --mcts-c is the UCT exploration constant
+ *           (default 3).
+ * --serve:  keep running and answer search requests from stdin, speculatively searching the possible
+ *           spawns after each move we play (see serve()).
+ *
+ * Tools (bench_2048.c, ...) #include this file with STRATEGY_2048_NO_MAIN defined to reuse the engine;
+ * helpers only tools call are compiled under the same guard, so the bot builds warning-clean, and
+ * the entry points tools share are marked TOOL_API so a tool that skips some stays -Wall clean.
  *
  * Further performance ideas: -O3 -march=native; larger CACHE_SIZE; move ordering at max nodes;
- * parallel chance nodes (harder); iterative deepening (done when timeout>0).
+ * parallel chance nodes below the root (the root's are split across threads); iterative deepening
+ * (done when timeout>0).
  */
 
 #define _GNU_SOURCE
@@ -18,28 +44,51 @@
 #include <math.h>
 #include <pthread.h>
 #include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #define N 4
-#define CACHE_SIZE (1 << 23)  /* 8M entries per thread */
+#define CACHE_SIZE (1 << 23)  /* 8M entries; caches_alloc splits 4 * CACHE_SIZE across the worker threads */
 #define MAX_EMPTY_SAMPLES 10
 #define GAMMA 0.95
-#define NTHREADS 4
+#define MAX_THREADS 256
+#define TOOL_API static __attribute__((unused))
 
 typedef int grid_t[N][N];
 
 typedef struct {
     unsigned long long key_lo;
     unsigned long long key_hi;
-    double value;
+    unsigned long long value_bits; /* the double's bits, so it can be loaded and stored atomically */
     int used;
 } cache_entry_t;
 
 /* Per-thread cache; each root worker uses its own. */
 static __thread cache_entry_t *current_cache = NULL;
-static cache_entry_t *caches[NTHREADS];
+static __thread unsigned long long node_count = 0; /* expectimax_impl calls on this thread */
+static cache_entry_t *caches[MAX_THREADS];
+static cache_entry_t *shared_cache = NULL;          /* --serve: one table for every worker, kept across searches */
+static int search_abort = 0;                        /* atomic; set to stop a running search early (--serve) */
+static int nthreads = 0;                            /* 0 => default_thread_count() in caches_alloc */
+static unsigned long long cache_size = CACHE_SIZE;  /* entries per thread cache, power of two */
 static int depth_low = 4, depth_high = 9, serious_empty = 5, serious_max_tile = 512;
 static int max_empty_samples = MAX_EMPTY_SAMPLES;
 
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 static void grid_copy(grid_t dst, const grid_t src) {
     for (int r = 0; r < N; r++)
         for (int c = 0; c < N; c++)
@@ -55,13 +104,15 @@ static void rotate_cw(grid_t g) {
     grid_copy(g, t);
 }
 
-/* Move row left: merge equal adjacent, shift. Returns score gained and whether changed. */
+/* Move row left: slide, merging equal neighbours once. Returns whether changed; score gained in *score_out. */
 static int move_row_left(int row[N], int *score_out) {
-    int out[N], n = 0, score = 0, i = 0;
-    while (i < N) {
-        if (row[i] == 0) { i++; continue; }
-        int v = row[i];
-        if (i + 1 < N && row[i + 1] == v) {
+    int tiles[N], k = 0, out[N], n = 0, score = 0, i = 0;
+    for (int j = 0; j < N; j++)
+        if (row[j]) tiles[k++] = row[j];
+    /* Tiles merge with the next tile in the row, empty cells between them or not; each tile at most once. */
+    while (i < k) {
+        int v = tiles[i];
+        if (i + 1 < k && tiles[i + 1] == v) {
             out[n++] = v * 2;
             score += v * 2;
             i += 2;
@@ -106,6 +157,147 @@ static int do_move(grid_t g, int dir, int *score_out) {
     return ch;
 }
 
+/*
+ * Packed board: 16 nibbles, one per cell, holding log2(value) (0 = empty, 1 = 2, ..., 15 = 32768).
+ * Cell (r, c) lives at bits 4 * (15 - (r * N + c)), so row 0 is the top 16 bits and column 0 the high
+ * nibble of each row (same order as grid_to_key). Moves use 64K-entry row tables built from
+ * move_row_left, so they reproduce do_move exactly; call init_move_tables() once before board_move.
+ */
+typedef unsigned long long board_t;
+
+static unsigned short row_left_table[65536], row_right_table[65536];
+static int row_score_table[65536]; /* same for left and right: equal runs merge pairwise either way */
+static int move_tables_ready = 0;
+
+static int tile_code(int v) {
+    int c = 0;
+    while (v > 1) { v >>= 1; c++; }
+    return c;
+}
+
+static board_t pack_grid(const grid_t g) {
+    board_t b = 0;
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++)
+            b = (b << 4) | (board_t)(tile_code(g[r][c]) & 15);
+    return b;
+}
+
+static void unpack_grid(board_t b, grid_t g) {
+    for (int i = N * N - 1; i >= 0; i--) {
+        int code = (int)(b & 15);
+        g[i / N][i % N] = code ? 1 << code : 0;
+        b >>= 4;
+    }
+}
+
+static unsigned short reverse_row(unsigned short row) {
+    return (unsigned short)((row >> 12) | ((row >> 4) & 0x00f0) | ((row << 4) & 0x0f00) | (row << 12));
+}
+
+static void init_move_tables(void) {
+    if (move_tables_ready) return;
+    for (int row = 0; row < 65536; row++) {
+        int line[N], score;
+        for (int c = 0; c < N; c++) {
+            int code = (row >> (4 * (N - 1 - c))) & 15;
+            line[c] = code ? 1 << code : 0;
+        }
+        move_row_left(line, &score);
+        unsigned short out = 0;
+        for (int c = 0; c < N; c++) {
+            int code = tile_code(line[c]);
+            out = (unsigned short)((out << 4) | (code > 15 ? 15 : code)); /* 32768+32768 saturates */
+        }
+        row_left_table[row] = out;
+        row_score_table[row] = score;
+    }
+    for (int row = 0; row < 65536; row++)
+        row_right_table[row] = reverse_row(row_left_table[reverse_row((unsigned short)row)]);
+    move_tables_ready = 1;
+}
+
+static board_t transpose_board(board_t x) {
+    board_t a1 = x & 0xF0F00F0FF0F00F0FULL;
+    board_t a2 = x & 0x0000F0F00000F0F0ULL;
+    board_t a3 = x & 0x0F0F00000F0F0000ULL;
+    board_t a = a1 | (a2 << 12) | (a3 >> 12);
+    board_t b1 = a & 0xFF00FF0000FF00FFULL;
+    board_t b2 = a & 0x00FF00FF00000000ULL;
+    board_t b3 = a & 0x00000000FF00FF00ULL;
+    return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+static board_t move_rows(board_t b, const unsigned short *table, int *score_out) {
+    board_t out = 0;
+    int score = 0;
+    for (int r = 0; r < N; r++) {
+        int shift = 16 * (N - 1 - r);
+        unsigned short row = (unsigned short)(b >> shift);
+        out |= (board_t)table[row] << shift;
+        score += row_score_table[row];
+    }
+    *score_out = score;
+    return out;
+}
+
+/* Same semantics as do_move (0=up, 1=right, 2=down, 3=left); the board changed iff result != b. */
+static board_t board_move(board_t b, int dir, int *score_out) {
+    switch (dir) {
+        case 0: return transpose_board(move_rows(transpose_board(b), row_left_table, score_out));
+        case 1: return move_rows(b, row_right_table, score_out);
+        case 2: return transpose_board(move_rows(transpose_board(b), row_right_table, score_out));
+        default: return move_rows(b, row_left_table, score_out);
+    }
+}
+
+static int board_count_empty(board_t b) {
+    int n = 0;
+    for (int i = 0; i < N * N; i++, b >>= 4)
+        n += (b & 15) == 0;
+    return n;
+}
+
+#ifdef STRATEGY_2048_NO_MAIN /* tools only */
+TOOL_API int board_max_code(board_t b) {
+    int m = 0;
+    for (int i = 0; i < N * N; i++, b >>= 4)
+        if ((int)(b & 15) > m) m = (int)(b & 15);
+    return m;
+}
+#endif
+
+/* 64-bit finalizer (murmur3 fmix64): board checksums, seeds from game numbers. */
+static unsigned long long mix64(unsigned long long x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* xorshift64* for self-play tools; the state must be non-zero. */
+static unsigned long long rng_next(unsigned long long *state) {
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+/* Spawns a tile the way the game does: uniform empty cell, 2 with p = 0.9, else 4. Full boards are returned as is. */
+static board_t board_spawn(board_t b, unsigned long long *rng) {
+    int empty[N * N], n = 0;
+    for (int i = 0; i < N * N; i++)
+        if (((b >> (4 * i)) & 15) == 0) empty[n++] = i;
+    if (n == 0) return b;
+    int cell = empty[rng_next(rng) % n];
+    board_t tile = rng_next(rng) % 10 == 0 ? 2 : 1;
+    return b | (tile << (4 * cell));
+}
+
 static int count_empty(const grid_t g) {
     int n = 0;
     for (int r = 0; r < N; r++)
@@ -168,13 +360,436 @@ static double smoothness(const grid_t g) {
     return -penalty;
 }
 
+/*
+ * Heuristic weights and the search discount. Defaults are the original hand-picked values; --weights PATH
+ * loads them from a flat JSON object (eval_weights.json: "empties", "corner", "mono", "smooth", "max_tile",
+ * "gamma"), the same file ExpectimaxStrategy._eval in bot_2048.py reads. Missing keys keep the default.
+ */
+typedef struct {
+    double empties, corner, mono, smooth, max_tile, gamma;
+} eval_weights_t;
+
+static eval_weights_t eval_w = { 15.0, 2.5, 4.0, 0.1, 0.01, GAMMA };
+
+/* Returns 0, or -1 (message on stderr) when the file is unreadable or has none of the keys. */
+TOOL_API int eval_weights_load(const char *path, eval_weights_t *w) {
+    static const char *keys[] = { "empties", "corner", "mono", "smooth", "max_tile", "gamma" };
+    double *fields[] = { &w->empties, &w->corner, &w->mono, &w->smooth, &w->max_tile, &w->gamma };
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open weights %s\n", path);
+        return -1;
+    }
+    char buf[4096];
+    size_t n = fread(buf, 1, sizeof buf - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    int found = 0;
+    for (int k = 0; k < (int)(sizeof keys / sizeof keys[0]); k++) {
+        char quoted[32];
+        snprintf(quoted, sizeof quoted, "\"%s\"", keys[k]);
+        const char *p = strstr(buf, quoted);
+        if (!p) continue;
+        p += strlen(quoted);
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+        if (*p != ':') continue;
+        char *end;
+        double v = strtod(p + 1, &end);
+        if (end == p + 1) continue;
+        *fields[k] = v;
+        found++;
+    }
+    if (!found) {
+        fprintf(stderr, "%s: no eval weights found\n", path);
+        return -1;
+    }
+    return 0;
+}
+
 static double eval_grid(const grid_t g) {
     int empties = count_empty(g);
     int corner = corner_score(g);
     int mono = monotonicity(g);
     double smooth = smoothness(g);
     int mx = max_tile(g);
-    return empties * 15.0 + corner * 2.5 + mono * 4.0 + smooth * 0.1 + mx * 0.01;
+    return empties * eval_w.empties + corner * eval_w.corner + mono * eval_w.mono + smooth * eval_w.smooth +
+           mx * eval_w.max_tile;
+}
+
+/*
+ * N-tuple network evaluator (--eval ntuple:PATH). A net is a list of tuples of 1-6 cells (cell = r * N + c);
+ * each tuple owns a table of 16^len float weights indexed by the tile codes of the packed board under its
+ * cells. A board's value is the sum over tuples and over the 8 symmetries of the board, which is done by
+ * mapping the tuple's cells rather than the board. Nets are trained on afterstates (see train_ntuple.c).
+ *
+ * Weight file, little-endian: ntuple_file_header_t, then the tables in tuple order. Every table is a
+ * multiple of 64 bytes, so each starts cache-line aligned in the mapping.
+ */
+#define NTUPLE_MAGIC "T2048NTW"
+#define NTUPLE_MAX 16
+#define NTUPLE_MAX_LEN 6
+#define NTUPLE_SYMS 8
+
+typedef struct {
+    char magic[8];
+    unsigned int version;                             /* 1 */
+    unsigned int ntuples;
+    unsigned char len[NTUPLE_MAX];
+    unsigned char cells[NTUPLE_MAX][NTUPLE_MAX_LEN];
+    unsigned long long games;                         /* training games behind the weights (informational) */
+    unsigned char reserved[56];                       /* pads the header to 192 bytes */
+} ntuple_file_header_t;
+
+typedef struct {
+    int ntuples;
+    int len[NTUPLE_MAX];
+    unsigned char cells[NTUPLE_MAX][NTUPLE_MAX_LEN];
+    unsigned char shift[NTUPLE_MAX][NTUPLE_SYMS][NTUPLE_MAX_LEN]; /* bit offset of each cell in board_t */
+    float *w[NTUPLE_MAX];
+    void *map;                                        /* mmap'd file, NULL when the weights live elsewhere */
+    size_t map_size;
+    unsigned long long games;
+} ntuple_net_t;
+
+static size_t ntuple_table_size(int len) {
+    return (size_t)1 << (4 * len);
+}
+
+/* Fills ntuples / len / shift from a header; the weight pointers are the caller's business. */
+static int ntuple_set_layout(ntuple_net_t *net, const ntuple_file_header_t *h) {
+    if (h->ntuples < 1 || h->ntuples > NTUPLE_MAX) return -1;
+    memset(net, 0, sizeof *net);
+    net->ntuples = (int)h->ntuples;
+    net->games = h->games;
+    for (int t = 0; t < net->ntuples; t++) {
+        int len = h->len[t];
+        if (len < 1 || len > NTUPLE_MAX_LEN) return -1;
+        net->len[t] = len;
+        for (int k = 0; k < len; k++) {
+            if (h->cells[t][k] >= N * N) return -1;
+            net->cells[t][k] = h->cells[t][k];
+            int r = h->cells[t][k] / N, c = h->cells[t][k] % N;
+            for (int s = 0; s < NTUPLE_SYMS; s++) {
+                int rr = r, cc = c;
+                for (int q = 0; q < (s & 3); q++) { int t2 = rr; rr = cc; cc = N - 1 - t2; } /* rotate cw */
+                if (s >= 4) cc = N - 1 - cc;                                               /* mirror */
+                net->shift[t][s][k] = (unsigned char)(4 * (N * N - 1 - (rr * N + cc)));
+            }
+        }
+    }
+    return 0;
+}
+
+static inline unsigned int ntuple_index(const ntuple_net_t *net, int t, int s, board_t b) {
+    const unsigned char *sh = net->shift[t][s];
+    unsigned int idx = 0;
+    for (int k = 0; k < net->len[t]; k++)
+        idx = (idx << 4) | (unsigned int)((b >> sh[k]) & 15);
+    return idx;
+}
+
+static double ntuple_eval_board(const ntuple_net_t *net, board_t b) {
+    float v = 0;
+    for (int t = 0; t < net->ntuples; t++) {
+        const float *w = net->w[t];
+        for (int s = 0; s < NTUPLE_SYMS; s++)
+            v += w[ntuple_index(net, t, s, b)];
+    }
+    return v;
+}
+
+/* Maps a weight file read-only. Returns 0, or -1 with a message on stderr. */
+static int ntuple_load(const char *path, ntuple_net_t *net) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ntuple: cannot open %s\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ntuple_file_header_t)) {
+        fprintf(stderr, "ntuple: %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ntuple: cannot map %s\n", path);
+        return -1;
+    }
+    const ntuple_file_header_t *h = (const ntuple_file_header_t *)map;
+    size_t size = sizeof *h;
+    int ok = memcmp(h->magic, NTUPLE_MAGIC, 8) == 0 && h->version == 1 && ntuple_set_layout(net, h) == 0;
+    for (int t = 0; ok && t < net->ntuples; t++) {
+        net->w[t] = (float *)((char *)map + size);
+        size += ntuple_table_size(net->len[t]) * sizeof(float);
+    }
+    if (!ok || size != (size_t)st.st_size) {
+        fprintf(stderr, "ntuple: %s is not a valid weight file\n", path);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    madvise(map, size, MADV_WILLNEED);
+    net->map = map;
+    net->map_size = size;
+    return 0;
+}
+
+#ifdef STRATEGY_2048_NO_MAIN /* tools only */
+/* Writes PATH.tmp and renames it over PATH, so a process mapping the old file never sees a partial one. */
+TOOL_API int ntuple_save(const char *path, const ntuple_net_t *net) {
+    char tmp[4096];
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    ntuple_file_header_t h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, NTUPLE_MAGIC, 8);
+    h.version = 1;
+    h.ntuples = (unsigned int)net->ntuples;
+    h.games = net->games;
+    for (int t = 0; t < net->ntuples; t++) {
+        h.len[t] = (unsigned char)net->len[t];
+        memcpy(h.cells[t], net->cells[t], NTUPLE_MAX_LEN);
+    }
+    int ok = fwrite(&h, sizeof h, 1, f) == 1;
+    for (int t = 0; ok && t < net->ntuples; t++) {
+        size_t n = ntuple_table_size(net->len[t]);
+        ok = fwrite(net->w[t], sizeof(float), n, f) == n;
+    }
+    if (fclose(f) != 0 || !ok) {
+        remove(tmp);
+        return -1;
+    }
+    return rename(tmp, path);
+}
+#endif
+
+TOOL_API void ntuple_unload(ntuple_net_t *net) {
+    if (net->map) munmap(net->map, net->map_size);
+    memset(net, 0, sizeof *net);
+}
+
+/* Leaf evaluator used by the search: eval_grid by default, or a loaded n-tuple net (eval_select). */
+static ntuple_net_t eval_net;
+static double eval_ntuple(const grid_t g) {
+    return ntuple_eval_board(&eval_net, pack_grid(g));
+}
+static double (*leaf_eval)(const grid_t g) = eval_grid;
+
+/* spec: "heuristic" or "ntuple:PATH". Returns 0, or -1 (message on stderr) leaving the heuristic. */
+TOOL_API int eval_select(const char *spec) {
+    if (strcmp(spec, "heuristic") == 0) {
+        leaf_eval = eval_grid;
+        return 0;
+    }
+    if (strncmp(spec, "ntuple:", 7) == 0 && ntuple_load(spec + 7, &eval_net) == 0) {
+        leaf_eval = eval_ntuple;
+        return 0;
+    }
+    if (strncmp(spec, "ntuple:", 7) != 0)
+        fprintf(stderr, "unknown evaluator '%s' (heuristic, ntuple:PATH)\n", spec);
+    return -1;
+}
+
+/*
+ * Position book (--book PATH): an mmap'd open-addressing table from canonical packed boards (the least
+ * of the 8 symmetric copies) to the best move, value and depth of a finished search. main checks it
+ * before allocating caches or searching and, with --book-append, stores every search it runs. Filled
+ * offline by book_2048. A book remembers which evaluator, weights and sampling cap produced it
+ * (book_eval_id) and is ignored under any other. Chance nodes trim the upper rows first, so a value is
+ * exact for the board that was searched and a close estimate for its mirror images.
+ *
+ * File, little-endian: book_header_t (64 bytes), then 2^slot_bits book_entry_t slots of 16 bytes. An
+ * entry's key is written last, so a reader never sees a key with a half-written entry; one writer at
+ * a time (the bot runs one engine at a time).
+ */
+#define BOOK_MAGIC "T2048BOK"
+#define BOOK_MAX_PROBE 32
+
+typedef struct {
+    char magic[8];
+    unsigned int version;                             /* 1 */
+    unsigned int slot_bits;
+    unsigned long long eval_id;                       /* book_eval_id() when the book was created */
+    unsigned long long count;                         /* used slots */
+    unsigned char reserved[32];                       /* pads the header to 64 bytes */
+} book_header_t;
+
+typedef struct {
+    unsigned long long key;                           /* canonical board, 0 = empty slot */
+    float value;
+    unsigned char move;                               /* best move on the canonical board */
+    unsigned char depth;
+    unsigned short reserved;
+} book_entry_t;
+
+typedef struct {
+    book_header_t *h;
+    book_entry_t *slots;
+    unsigned long long mask;
+    size_t size;
+    int writable;
+} book_t;
+
+static unsigned long long book_eval_id(void) {
+    unsigned long long w[sizeof(eval_weights_t) / 8], h = mix64((unsigned long long)max_empty_samples + 1);
+    memcpy(w, &eval_w, sizeof w);
+    for (size_t i = 0; i < sizeof w / 8; i++)
+        h = mix64(h ^ w[i]);
+    if (leaf_eval == eval_ntuple)
+        h = mix64(h ^ 0x6e74 ^ mix64(eval_net.games) ^ mix64(eval_net.map_size));
+    return h ? h : 1;
+}
+
+/* Symmetry k (0..7) of a board: mirror the rows left-right if k & 1, then top-bottom if k & 4, then
+ * transpose if k & 2. book_sym_dir maps a move on b to the same move on book_sym(b, k). */
+static board_t book_sym(board_t b, int k) {
+    if (k & 1)
+        b = (board_t)reverse_row((unsigned short)(b >> 48)) << 48 |
+            (board_t)reverse_row((unsigned short)(b >> 32)) << 32 |
+            (board_t)reverse_row((unsigned short)(b >> 16)) << 16 | reverse_row((unsigned short)b);
+    if (k & 4)
+        b = (b >> 48) | ((b >> 16) & 0xffff0000ULL) | ((b << 16) & 0xffff00000000ULL) | (b << 48);
+    if (k & 2)
+        b = transpose_board(b);
+    return b;
+}
+
+static int book_sym_dir(int dir, int k, int inverse) {
+    static const int mirror_lr[4] = { 0, 3, 2, 1 }, mirror_tb[4] = { 2, 1, 0, 3 }, transpose[4] = { 3, 2, 1, 0 };
+    if (!inverse) {
+        if (k & 1) dir = mirror_lr[dir];
+        if (k & 4) dir = mirror_tb[dir];
+        if (k & 2) dir = transpose[dir];
+    } else {
+        if (k & 2) dir = transpose[dir];
+        if (k & 4) dir = mirror_tb[dir];
+        if (k & 1) dir = mirror_lr[dir];
+    }
+    return dir;
+}
+
+static board_t book_canonical(board_t b, int *sym_out) {
+    board_t best = b;
+    *sym_out = 0;
+    for (int k = 1; k < 8; k++) {
+        board_t s = book_sym(b, k);
+        if (s < best) {
+            best = s;
+            *sym_out = k;
+        }
+    }
+    return best;
+}
+
+#ifdef STRATEGY_2048_NO_MAIN /* tools only */
+/* Creates an empty book of 2^slot_bits slots for the current evaluator. Returns 0, or -1 with a message. */
+TOOL_API int book_create(const char *path, int slot_bits) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "book: cannot create %s\n", path);
+        return -1;
+    }
+    book_header_t h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, BOOK_MAGIC, 8);
+    h.version = 1;
+    h.slot_bits = (unsigned int)slot_bits;
+    h.eval_id = book_eval_id();
+    int ok = fwrite(&h, sizeof h, 1, f) == 1 &&
+             ftruncate(fileno(f), (off_t)(sizeof h + (sizeof(book_entry_t) << slot_bits))) == 0;
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "book: cannot write %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+/* Maps a book (read-write when writable). Returns 0, or -1 with a message on stderr. */
+TOOL_API int book_open(const char *path, int writable, book_t *book) {
+    memset(book, 0, sizeof *book);
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "book: cannot open %s\n", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(book_header_t)) {
+        fprintf(stderr, "book: %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "book: cannot map %s\n", path);
+        return -1;
+    }
+    book_header_t *h = (book_header_t *)map;
+    if (memcmp(h->magic, BOOK_MAGIC, 8) != 0 || h->version != 1 || h->slot_bits > 40 ||
+        (size_t)st.st_size != sizeof *h + (sizeof(book_entry_t) << h->slot_bits)) {
+        fprintf(stderr, "book: %s is not a valid book\n", path);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    if (h->eval_id != book_eval_id()) {
+        fprintf(stderr, "book: %s was built with another evaluator, weights or sampling cap; ignored\n", path);
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    book->h = h;
+    book->slots = (book_entry_t *)(h + 1);
+    book->mask = (1ULL << h->slot_bits) - 1;
+    book->size = (size_t)st.st_size;
+    book->writable = writable;
+    return 0;
+}
+
+TOOL_API void book_close(book_t *book) {
+    if (book->h) munmap(book->h, book->size);
+    memset(book, 0, sizeof *book);
+}
+
+static book_entry_t *book_find(const book_t *book, board_t key, int for_insert) {
+    for (unsigned long long i = 0; i < BOOK_MAX_PROBE && i <= book->mask; i++) {
+        book_entry_t *e = &book->slots[(mix64(key) + i) & book->mask];
+        unsigned long long k = __atomic_load_n(&e->key, __ATOMIC_ACQUIRE);
+        if (k == key) return e;
+        if (k == 0) return for_insert ? e : NULL;
+    }
+    return NULL;
+}
+
+/* Looks board up. Returns 1 with the move (for board itself), value and depth on a hit, else 0. */
+TOOL_API int book_probe(const book_t *book, board_t board, int *dir_out, double *value_out, int *depth_out) {
+    int k;
+    board_t key = book_canonical(board, &k);
+    const book_entry_t *e = key ? book_find(book, key, 0) : NULL;
+    if (!e) return 0;
+    *dir_out = book_sym_dir(e->move, k, 1);
+    *value_out = e->value;
+    *depth_out = e->depth;
+    return 1;
+}
+
+/* Stores a search result unless the book already has the board at least as deep. Returns 0, or -1 when
+ * the book is read-only or its probe window is full. */
+TOOL_API int book_store(book_t *book, board_t board, int dir, double value, int depth) {
+    if (!book->writable || dir < 0) return -1;
+    int k;
+    board_t key = book_canonical(board, &k);
+    book_entry_t *e = key ? book_find(book, key, 1) : NULL;
+    if (!e) return -1;
+    if (e->key == key && e->depth >= depth) return 0;
+    int is_new = e->key == 0;
+    e->value = (float)value;
+    e->move = (unsigned char)book_sym_dir(dir, k, 0);
+    e->depth = (unsigned char)depth;
+    __atomic_store_n(&e->key, key, __ATOMIC_RELEASE);
+    if (is_new) book->h->count++;
+    return 0;
 }
 
 /* Encode cell value 0,2,4,...,2048 as 0..12 for cache key (4 bits per cell) */
@@ -197,15 +812,40 @@ static unsigned long long hash_key(unsigned long long klo, unsigned long long kh
     return (klo * 0x9e3779b97f4a7c15ULL) ^ (khi * 0x9e3779b9ULL);
 }
 
+/*
+ * Open addressing with linear probing, at most CACHE_MAX_PROBE slots per lookup (a value is a pure
+ * function of its key, so an entry that does not fit is just recomputed). key_lo is stored xored with
+ * key_hi and the value's bits, so several threads can share one table without locks (analyze_2048, the
+ * shared-table worker pool): a read that races a write of another position, or of the same board at
+ * another depth or node type, fails the key check instead of returning a torn value. Every field is
+ * loaded and stored with relaxed atomics, so the race is defined behaviour and the check is all it needs.
+ */
+#define CACHE_MAX_PROBE 64
+
+static unsigned long long cache_value_bits(double v) {
+    unsigned long long bits;
+    memcpy(&bits, &v, sizeof bits);
+    return bits;
+}
+
+static double cache_bits_value(unsigned long long bits) {
+    double v;
+    memcpy(&v, &bits, sizeof v);
+    return v;
+}
+
 static double cache_get(unsigned long long klo, unsigned long long khi) {
     cache_entry_t *cache = current_cache;
     if (!cache) return -1e300;
-    unsigned long long h = hash_key(klo, khi) % CACHE_SIZE;
-    for (int i = 0; i < CACHE_SIZE; i++) {
-        int idx = (h + i) % CACHE_SIZE;
-        if (!cache[idx].used) return -1e300;
-        if (cache[idx].key_lo == klo && cache[idx].key_hi == khi)
-            return cache[idx].value;
+    unsigned long long h = hash_key(klo, khi) & (cache_size - 1);
+    for (unsigned long long i = 0; i < cache_size && i < CACHE_MAX_PROBE; i++) {
+        cache_entry_t *e = &cache[(h + i) & (cache_size - 1)];
+        if (!__atomic_load_n(&e->used, __ATOMIC_RELAXED)) return -1e300;
+        unsigned long long vbits = __atomic_load_n(&e->value_bits, __ATOMIC_RELAXED);
+        unsigned long long hi = __atomic_load_n(&e->key_hi, __ATOMIC_RELAXED);
+        unsigned long long check = __atomic_load_n(&e->key_lo, __ATOMIC_RELAXED);
+        if ((check ^ hi ^ vbits) == klo && hi == khi)
+            return cache_bits_value(vbits);
     }
     return -1e300;
 }
@@ -213,18 +853,18 @@ static double cache_get(unsigned long long klo, unsigned long long khi) {
 static void cache_put(unsigned long long klo, unsigned long long khi, double value) {
     cache_entry_t *cache = current_cache;
     if (!cache) return;
-    unsigned long long h = hash_key(klo, khi) % CACHE_SIZE;
-    for (int i = 0; i < CACHE_SIZE; i++) {
-        int idx = (h + i) % CACHE_SIZE;
-        if (!cache[idx].used) {
-            cache[idx].key_lo = klo;
-            cache[idx].key_hi = khi;
-            cache[idx].value = value;
-            cache[idx].used = 1;
-            return;
-        }
-        if (cache[idx].key_lo == klo && cache[idx].key_hi == khi) {
-            cache[idx].value = value;
+    unsigned long long h = hash_key(klo, khi) & (cache_size - 1);
+    for (unsigned long long i = 0; i < cache_size && i < CACHE_MAX_PROBE; i++) {
+        cache_entry_t *e = &cache[(h + i) & (cache_size - 1)];
+        int used = __atomic_load_n(&e->used, __ATOMIC_RELAXED);
+        unsigned long long hi = __atomic_load_n(&e->key_hi, __ATOMIC_RELAXED);
+        if (!used || ((__atomic_load_n(&e->key_lo, __ATOMIC_RELAXED) ^ hi ^
+                       __atomic_load_n(&e->value_bits, __ATOMIC_RELAXED)) == klo && hi == khi)) {
+            unsigned long long vbits = cache_value_bits(value);
+            __atomic_store_n(&e->key_lo, klo ^ khi ^ vbits, __ATOMIC_RELAXED);
+            __atomic_store_n(&e->key_hi, khi, __ATOMIC_RELAXED);
+            __atomic_store_n(&e->value_bits, vbits, __ATOMIC_RELAXED);
+            __atomic_store_n(&e->used, 1, __ATOMIC_RELAXED);
             return;
         }
     }
@@ -232,30 +872,198 @@ static void cache_put(unsigned long long klo, unsigned long long khi, double val
 
 static void cache_clear(void) {
     if (current_cache)
-        memset(current_cache, 0, CACHE_SIZE * sizeof(cache_entry_t));
+        memset(current_cache, 0, cache_size * sizeof(cache_entry_t));
+}
+
+/*
+ * Search-tree profiler (--profile). Counters are thread-local, indexed by remaining depth, and folded
+ * into the iteration stats by the workers; with the iteration depth that gives per-ply numbers.
+ * Time is inclusive (node plus subtree), taken with the TSC where available; self time is derived.
+ */
+#define PROFILE_MAX_DEPTH 32
+
+typedef struct {
+    unsigned long long nodes;          /* expectimax calls at this depth */
+    unsigned long long tt_hits;
+    unsigned long long leaves;         /* static evals: depth 0, full board, or no legal move */
+    unsigned long long expanded;       /* nodes that generated children */
+    unsigned long long moves;          /* legal moves generated at expanded max nodes */
+    unsigned long long cells;          /* spawn cells searched at expanded chance nodes */
+    unsigned long long cells_avail;    /* empty cells before the max_empty_samples / depth >= 7 cap */
+    unsigned long long ticks;          /* inclusive */
+} profile_ply_t;
+
+enum { NODE_TT_HIT, NODE_LEAF, NODE_EXPANDED };
+
+static int profile_enabled = 0;
+static double profile_ticks_per_ns = 1.0;
+static __thread profile_ply_t tl_profile[PROFILE_MAX_DEPTH];
+static __thread int tl_node_kind;      /* how the innermost finished expectimax_impl call ended */
+
+static unsigned long long profile_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (unsigned long long)(now_sec() * 1e9);
+#endif
 }
 
+TOOL_API void profile_calibrate(void) {
+    double t0 = now_sec();
+    unsigned long long k0 = profile_ticks();
+    while (now_sec() - t0 < 0.01) { }
+    double dt = now_sec() - t0;
+    profile_ticks_per_ns = (profile_ticks() - k0) / (dt * 1e9);
+    if (profile_ticks_per_ns <= 0) profile_ticks_per_ns = 1.0;
+}
+
+static void profile_add(profile_ply_t *dst, const profile_ply_t *src) {
+    for (int d = 0; d < PROFILE_MAX_DEPTH; d++) {
+        dst[d].nodes += src[d].nodes;
+        dst[d].tt_hits += src[d].tt_hits;
+        dst[d].leaves += src[d].leaves;
+        dst[d].expanded += src[d].expanded;
+        dst[d].moves += src[d].moves;
+        dst[d].cells += src[d].cells;
+        dst[d].cells_avail += src[d].cells_avail;
+        dst[d].ticks += src[d].ticks;
+    }
+}
+
+static int profile_slot(int depth) {
+    return depth < 0 ? 0 : depth >= PROFILE_MAX_DEPTH ? PROFILE_MAX_DEPTH - 1 : depth;
+}
+
+/*
+ * Tree dump (--tree-dump). Nodes are appended in pre-order by all workers into one bounded buffer
+ * (--tree-limit records). Plies 0-2 are always kept; each ply-3 subtree is kept whole with probability
+ * --tree-sample (deterministic hash of the board). File: tree_dump_header_t, then `count`
+ * tree_record_t, little-endian; children follow their parent and point back at it.
+ */
+#define TREE_DUMP_MAGIC "T2048TRE"
+#define TREE_NO_PARENT 0xffffffffu
+
+typedef struct {
+    char magic[8];
+    unsigned int version;        /* 1 */
+    unsigned int record_size;    /* sizeof(tree_record_t) */
+    unsigned long long count;
+    unsigned int iter_depth;
+    unsigned int reserved;
+} tree_dump_header_t;
+
+typedef struct {
+    board_t board;               /* packed (see pack_grid) */
+    unsigned int parent;         /* record index of the parent, TREE_NO_PARENT for the root */
+    float value;                 /* expectimax value of the node */
+    unsigned char ply;
+    unsigned char is_max;
+    unsigned char kind;          /* NODE_TT_HIT / NODE_LEAF / NODE_EXPANDED */
+    unsigned char depth;         /* remaining depth */
+} tree_record_t;
+
+static const char *tree_dump_path = NULL;
+static unsigned long long tree_limit = 1000000;
+static double tree_sample = 0.1;
+static tree_record_t *tree_records = NULL;
+static unsigned long long tree_count = 0;   /* atomic */
+static int tree_iter_depth = 0;
+static __thread unsigned int tl_tree_parent = TREE_NO_PARENT;
+
+/* Reserve a record for a node at `ply`; returns TREE_NO_PARENT when it is not sampled. */
+static unsigned int tree_record_begin(const grid_t g, int depth, int is_max, int ply) {
+    if (!tree_records || tl_tree_parent == TREE_NO_PARENT) return TREE_NO_PARENT;
+    board_t b = pack_grid(g);
+    if (ply == 3) {
+        unsigned long long h = (b ^ ((unsigned long long)tl_tree_parent << 20) ^ (unsigned long long)ply)
+                               * 0x9e3779b97f4a7c15ULL;
+        if ((h >> 11) * (1.0 / 9007199254740992.0) >= tree_sample) return TREE_NO_PARENT;
+    }
+    unsigned long long id = __atomic_fetch_add(&tree_count, 1, __ATOMIC_RELAXED);
+    if (id >= tree_limit) return TREE_NO_PARENT;
+    tree_record_t *r = &tree_records[id];
+    r->board = b;
+    r->parent = tl_tree_parent;
+    r->value = 0;
+    r->ply = (unsigned char)ply;
+    r->is_max = (unsigned char)is_max;
+    r->kind = NODE_EXPANDED;
+    r->depth = (unsigned char)depth;
+    return (unsigned int)id;
+}
+
+TOOL_API int tree_dump_write(void) {
+    FILE *f = fopen(tree_dump_path, "wb");
+    if (!f) return -1;
+    tree_dump_header_t h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, TREE_DUMP_MAGIC, 8);
+    h.version = 1;
+    h.record_size = sizeof(tree_record_t);
+    h.count = tree_count < tree_limit ? tree_count : tree_limit;
+    h.iter_depth = (unsigned int)tree_iter_depth;
+    int ok = fwrite(&h, sizeof h, 1, f) == 1 &&
+             fwrite(tree_records, sizeof(tree_record_t), h.count, f) == h.count;
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+static __thread int tl_iter_depth; /* depth of the running iteration, for ply = tl_iter_depth - depth */
+
 static double expectimax(grid_t g, int depth, int is_max);
 
+/* Chance node: sample empty cells. Use smaller cap at high depth to keep depth 9 feasible. */
+static int chance_cells(const grid_t g, int depth, int cells[16][2]) {
+    int cap = (depth >= 7 && max_empty_samples > 6) ? 6 : max_empty_samples;
+    int nc = 0;
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++)
+            if (g[r][c] == 0) {
+                cells[nc][0] = r;
+                cells[nc][1] = c;
+                nc++;
+            }
+    /* Prefer lower rows (higher r) when trimming */
+    if (nc > cap) {
+        for (int i = 0; i < nc - 1; i++)
+            for (int j = i + 1; j < nc; j++)
+                if (cells[j][0] > cells[i][0]) {
+                    int t0 = cells[i][0], t1 = cells[i][1];
+                    cells[i][0] = cells[j][0]; cells[i][1] = cells[j][1];
+                    cells[j][0] = t0; cells[j][1] = t1;
+                }
+        nc = cap;
+    }
+    return nc;
+}
+
 static double expectimax_impl(grid_t g, int depth, int is_max) {
+    node_count++;
     unsigned long long klo, khi;
     grid_to_key(g, depth, is_max, &klo, &khi);
     double cached = cache_get(klo, khi);
-    if (cached > -1e299) return cached;
+    if (cached > -1e299) {
+        tl_node_kind = NODE_TT_HIT;
+        return cached;
+    }
 
     if (depth == 0) {
-        double v = eval_grid(g);
+        double v = leaf_eval(g);
         cache_put(klo, khi, v);
+        tl_node_kind = NODE_LEAF;
         return v;
     }
 
     int empties = count_empty(g);
     if (empties == 0) {
-        double v = eval_grid(g);
+        double v = leaf_eval(g);
         cache_put(klo, khi, v);
+        tl_node_kind = NODE_LEAF;
         return v;
     }
 
+    int kind = NODE_EXPANDED;
+    profile_ply_t *prof = profile_enabled ? &tl_profile[profile_slot(depth)] : NULL;
+
     double result;
     if (is_max) {
         double best = -1e300;
@@ -267,34 +1075,23 @@ static double expectimax_impl(grid_t g, int depth, int is_max) {
             int score;
             if (!do_move(next, dirs[di], &score)) continue;
             any = 1;
-            double here = eval_grid(next) + score * 0.1;
+            double here = leaf_eval(next) + score * 0.1;
             double future = expectimax(next, depth - 1, 0);
-            double total = here + GAMMA * future;
+            double total = here + eval_w.gamma * future;
             if (total > best) best = total;
+            if (prof) prof->moves++;
+        }
+        if (!any) {
+            best = leaf_eval(g);
+            kind = NODE_LEAF;
         }
-        if (!any) best = eval_grid(g);
         result = best;
     } else {
-        /* Chance node: sample empty cells. Use smaller cap at high depth to keep depth 9 feasible. */
-        int cap = (depth >= 7 && max_empty_samples > 6) ? 6 : max_empty_samples;
-        int cells[16][2], nc = 0;
-        for (int r = 0; r < N; r++)
-            for (int c = 0; c < N; c++)
-                if (g[r][c] == 0) {
-                    cells[nc][0] = r;
-                    cells[nc][1] = c;
-                    nc++;
-                }
-        /* Prefer lower rows (higher r) when trimming */
-        if (nc > cap) {
-            for (int i = 0; i < nc - 1; i++)
-                for (int j = i + 1; j < nc; j++)
-                    if (cells[j][0] > cells[i][0]) {
-                        int t0 = cells[i][0], t1 = cells[i][1];
-                        cells[i][0] = cells[j][0]; cells[i][1] = cells[j][1];
-                        cells[j][0] = t0; cells[j][1] = t1;
-                    }
-            nc = cap;
+        int cells[16][2];
+        int nc = chance_cells(g, depth, cells);
+        if (prof) {
+            prof->cells += nc;
+            prof->cells_avail += empties;
         }
         double expected = 0, total_prob = 0;
         for (int i = 0; i < nc; i++) {
@@ -308,16 +1105,47 @@ static double expectimax_impl(grid_t g, int depth, int is_max) {
                 total_prob += prob;
             }
         }
-        if (total_prob < 1e-9)
-            result = eval_grid(g);
-        else
+        if (total_prob < 1e-9) {
+            result = leaf_eval(g);
+            kind = NODE_LEAF;
+        } else {
             result = expected / total_prob;
+        }
     }
     cache_put(klo, khi, result);
+    tl_node_kind = kind;
     return result;
 }
 
+/* Instrumented path for --profile / --tree-dump; the plain search goes straight to expectimax_impl. */
+static double expectimax_traced(grid_t g, int depth, int is_max) {
+    unsigned int id = tree_record_begin(g, depth, is_max, tl_iter_depth - depth);
+    unsigned int saved_parent = tl_tree_parent;
+    tl_tree_parent = id;
+    unsigned long long t0 = profile_enabled ? profile_ticks() : 0;
+
+    double v = expectimax_impl(g, depth, is_max);
+
+    int kind = tl_node_kind;
+    tl_tree_parent = saved_parent;
+    if (profile_enabled) {
+        profile_ply_t *p = &tl_profile[profile_slot(depth)];
+        p->nodes++;
+        p->tt_hits += kind == NODE_TT_HIT;
+        p->leaves += kind == NODE_LEAF;
+        p->expanded += kind == NODE_EXPANDED;
+        p->ticks += profile_ticks() - t0;
+    }
+    if (id != TREE_NO_PARENT) {
+        tree_records[id].value = (float)v;
+        tree_records[id].kind = (unsigned char)kind;
+    }
+    return v;
+}
+
 static double expectimax(grid_t g, int depth, int is_max) {
+    if (profile_enabled || tree_records)
+        return expectimax_traced(g, depth, is_max);
     return expectimax_impl(g, depth, is_max);
 }
 
@@ -331,121 +1159,1303 @@ static const char *dir_name(int dir) {
     }
 }
 
+/*
+ * Optional hardware counters (--perf). Each worker opens its own per-thread counters (user space only)
+ * around its share of an iteration and adds the readings to the iteration totals. Counters the kernel
+ * or VM does not provide are reported as n/a; task_clock is a software counter and nearly always works.
+ */
+enum { PC_CYCLES, PC_INSTRUCTIONS, PC_LLC_MISSES, PC_DTLB_MISSES, PC_BRANCH_MISSES, PC_TASK_CLOCK, PC_COUNT };
+
+static const char *perf_counter_names[PC_COUNT] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses", "task_clock_ns"
+};
+
+typedef struct {
+    double v[PC_COUNT]; /* scaled by time_enabled / time_running when the PMU multiplexes */
+} perf_counts_t;
+
+static int perf_enabled = 0;
+static int perf_available[PC_COUNT];
+
+static int perf_open_counter(int which) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (which) {
+        case PC_CYCLES:        attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case PC_INSTRUCTIONS:  attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case PC_BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+        case PC_LLC_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PC_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_TASK_CLOCK;
+            break;
+    }
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Checks which counters open on this host; turns --perf off (with a note) when none do. */
+TOOL_API void perf_probe(void) {
+    int any = 0;
+    for (int i = 0; i < PC_COUNT; i++) {
+        int fd = perf_open_counter(i);
+        perf_available[i] = fd >= 0;
+        if (fd >= 0) {
+            close(fd);
+            any = 1;
+        }
+    }
+    if (!any) {
+        fprintf(stderr, "strategy_2048: perf counters unavailable (perf_event_open failed), --perf ignored\n");
+        perf_enabled = 0;
+    }
+}
+
+static void perf_start(int fds[PC_COUNT]) {
+    for (int i = 0; i < PC_COUNT; i++) {
+        fds[i] = (perf_enabled && perf_available[i]) ? perf_open_counter(i) : -1;
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void perf_stop(int fds[PC_COUNT], perf_counts_t *acc) {
+    for (int i = 0; i < PC_COUNT; i++) {
+        if (fds[i] < 0) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        unsigned long long buf[3]; /* value, time_enabled, time_running */
+        if (read(fds[i], buf, sizeof buf) == (ssize_t)sizeof buf && buf[2] > 0)
+            acc->v[i] += (double)buf[0] * ((double)buf[1] / buf[2]);
+        close(fds[i]);
+    }
+}
+
+static void perf_add(perf_counts_t *dst, const perf_counts_t *src) {
+    for (int i = 0; i < PC_COUNT; i++)
+        dst->v[i] += src->v[i];
+}
+
+/* key=value pairs for one measurement: raw counters, then ipc and per-node rates. */
+static void perf_print(FILE *f, const perf_counts_t *pc, unsigned long long nodes) {
+    for (int i = 0; i < PC_COUNT; i++) {
+        if (perf_available[i]) fprintf(f, " %s=%.0f", perf_counter_names[i], pc->v[i]);
+        else fprintf(f, " %s=n/a", perf_counter_names[i]);
+    }
+    if (perf_available[PC_CYCLES] && perf_available[PC_INSTRUCTIONS] && pc->v[PC_CYCLES] > 0)
+        fprintf(f, " ipc=%.2f", pc->v[PC_INSTRUCTIONS] / pc->v[PC_CYCLES]);
+    for (int i = 0; i < PC_COUNT; i++)
+        if (perf_available[i] && nodes > 0 && i != PC_INSTRUCTIONS)
+            fprintf(f, " %s_per_node=%.3f", perf_counter_names[i], pc->v[i] / nodes);
+}
+
+/* One unit of root work: a subtree below a root move, searched by whichever worker picks it up. */
 typedef struct {
     grid_t grid;
-    int dir;
     int depth;
+    int is_max;
+    double prob;   /* spawn probability when this is a root spawn child, else 1 */
+    double value;
+    unsigned int tree_parent; /* --tree-dump record of the parent node */
+} search_task_t;
+
+typedef struct {
+    search_task_t *tasks;
+    int ntasks;
+    int next;
+    pthread_mutex_t lock;
+    int iter_depth;
+} task_queue_t;
+
+typedef struct {
+    task_queue_t *queue;
     int thread_id;
-    double result;
-    int valid;
+    unsigned long long nodes;
+    perf_counts_t perf;
+    profile_ply_t profile[PROFILE_MAX_DEPTH];
 } worker_arg_t;
 
 static void *worker(void *arg_) {
     worker_arg_t *arg = (worker_arg_t *)arg_;
-    grid_t next;
-    grid_copy(next, arg->grid);
-    int score;
-    if (!do_move(next, arg->dir, &score)) {
-        arg->valid = 0;
-        return NULL;
+    task_queue_t *q = arg->queue;
+    current_cache = shared_cache ? shared_cache : caches[arg->thread_id];
+    node_count = 0;
+    tl_iter_depth = q->iter_depth;
+    if (profile_enabled)
+        memset(tl_profile, 0, sizeof tl_profile);
+    int cleared = 0;
+    int perf_fds[PC_COUNT];
+    perf_start(perf_fds);
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        int i = q->next++;
+        pthread_mutex_unlock(&q->lock);
+        if (i >= q->ntasks || __atomic_load_n(&search_abort, __ATOMIC_RELAXED)) break;
+        if (!cleared && !shared_cache) {
+            cache_clear();
+            cleared = 1;
+        }
+        search_task_t *t = &q->tasks[i];
+        tl_tree_parent = t->tree_parent;
+        t->value = expectimax(t->grid, t->depth, t->is_max);
     }
-    current_cache = caches[arg->thread_id];
-    cache_clear();
-    double here = eval_grid(next) + score * 0.1;
-    double future = expectimax(next, arg->depth - 1, 0);
-    arg->result = here + GAMMA * future;
-    arg->valid = 1;
+    perf_stop(perf_fds, &arg->perf);
+    if (profile_enabled)
+        memcpy(arg->profile, tl_profile, sizeof tl_profile);
+    arg->nodes = node_count;
     return NULL;
 }
 
-int main(int argc, char **argv) {
-    int timeout_sec = 0;
-    if (argc >= 5) {
-        depth_low    = atoi(argv[1]);
-        depth_high   = atoi(argv[2]);
-        serious_empty = atoi(argv[3]);
-        serious_max_tile = atoi(argv[4]);
-    }
-    if (argc >= 6)
-        max_empty_samples = atoi(argv[5]);
-    if (argc >= 7)
-        timeout_sec = atoi(argv[6]);
+/* CPU quota of our cgroup in CPUs (v2 cpu.max, else v1 cfs quota/period); 0 when unlimited or unknown. */
+static double cgroup_cpu_quota(void) {
+    long long quota = -1, period = 0;
+    FILE *f = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (f) {
+        char q[32];
+        if (fscanf(f, "%31s %lld", q, &period) == 2 && strcmp(q, "max") != 0)
+            quota = atoll(q);
+        fclose(f);
+    } else if ((f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r"))) {
+        if (fscanf(f, "%lld", &quota) != 1) quota = -1;
+        fclose(f);
+        if ((f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r"))) {
+            if (fscanf(f, "%lld", &period) != 1) period = 0;
+            fclose(f);
+        }
+    }
+    return (quota > 0 && period > 0) ? (double)quota / period : 0;
+}
 
-    grid_t grid;
-    for (int r = 0; r < N; r++)
-        for (int c = 0; c < N; c++)
-            if (scanf("%d", &grid[r][c]) != 1)
-                grid[r][c] = 0;
+/* CPUs we may run on: the affinity mask, capped by the cgroup quota (rounded up). */
+static int default_thread_count(void) {
+    int n = 0;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) == 0)
+        n = CPU_COUNT(&set);
+    if (n <= 0)
+        n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double quota = cgroup_cpu_quota();
+    if (quota > 0 && (int)ceil(quota) < n)
+        n = (int)ceil(quota);
+    if (n < 1) n = 1;
+    if (n > MAX_THREADS) n = MAX_THREADS;
+    return n;
+}
 
-    for (int i = 0; i < NTHREADS; i++) {
-        caches[i] = (cache_entry_t *)calloc(CACHE_SIZE, sizeof(cache_entry_t));
+/* One cache per worker thread, sized so the total stays within 4 * CACHE_SIZE (the old 4-thread footprint);
+ * the floor, 4 * CACHE_SIZE / MAX_THREADS, is only reached at MAX_THREADS. */
+TOOL_API int caches_alloc(void) {
+    if (nthreads <= 0) nthreads = default_thread_count();
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    cache_size = 4ULL * CACHE_SIZE;
+    while (cache_size > 4ULL * CACHE_SIZE / MAX_THREADS && cache_size * nthreads > 4ULL * CACHE_SIZE)
+        cache_size >>= 1;
+    for (int i = 0; i < nthreads; i++) {
+        caches[i] = (cache_entry_t *)calloc(cache_size, sizeof(cache_entry_t));
         if (!caches[i]) {
             for (int j = 0; j < i; j++) free(caches[j]);
-            fprintf(stderr, "strategy_2048: failed to allocate cache\n");
-            return 1;
+            return -1;
         }
     }
+    return 0;
+}
 
-    int empties = count_empty(grid);
-    int mx = max_tile(grid);
-    int serious = (empties <= serious_empty || mx >= serious_max_tile);
-    int depth = serious ? depth_high : depth_low;
+TOOL_API void caches_free(void) {
+    for (int i = 0; i < nthreads; i++) {
+        free(caches[i]);
+        caches[i] = NULL;
+    }
+}
 
-    const int dirs[] = {0, 1, 2, 3};
-    int best_dir = -1;
-    double best_score = -1e300;
-    time_t start = time(NULL);
-
-    if (timeout_sec > 0 && serious) {
-        /* Iterative deepening: try depth_low..depth_high, stop when time runs out */
-        for (int d = depth_low; d <= depth && (timeout_sec <= 0 || (time(NULL) - start) < timeout_sec); d++) {
-            worker_arg_t args[NTHREADS];
-            pthread_t threads[NTHREADS];
-            for (int i = 0; i < NTHREADS; i++) {
-                grid_copy(args[i].grid, grid);
-                args[i].dir = dirs[i];
-                args[i].depth = d;
-                args[i].thread_id = i;
-                args[i].valid = 0;
-                pthread_create(&threads[i], NULL, worker, &args[i]);
+#define MAX_ITERATIONS 32
+
+typedef struct {
+    int depth;
+    unsigned long long nodes;
+    double seconds;
+    perf_counts_t perf;       /* with --perf */
+    profile_ply_t profile[PROFILE_MAX_DEPTH]; /* with --profile, indexed by remaining depth */
+} search_iter_stats_t;
+
+typedef struct {
+    int dir;                  /* best root move, -1 if none is legal */
+    double value;
+    int depth;                /* deepest iteration that ran (the policy depth without a timeout) */
+    unsigned long long nodes; /* expectimax_impl calls summed over all iterations and workers (MCTS: playouts) */
+    perf_counts_t perf;       /* summed over iterations (with --perf) */
+    int niters;
+    search_iter_stats_t iters[MAX_ITERATIONS];
+} search_result_t;
+
+/* Depth policy: depth_high when the board is "serious" (few empties or a big tile), else depth_low. */
+static int policy_depth(const grid_t grid, int *serious_out) {
+    int serious = (count_empty(grid) <= serious_empty || max_tile(grid) >= serious_max_tile);
+    if (serious_out) *serious_out = serious;
+    return serious ? depth_high : depth_low;
+}
+
+/*
+ * One root iteration. The root's chance children (move x spawn cell x value) are queued as tasks for
+ * nthreads workers, then folded back per move exactly as expectimax_impl would, so the result does not
+ * depend on the thread count. Keeps the best result seen across calls.
+ */
+static void search_iteration(const grid_t grid, int depth, search_result_t *res) {
+    double t0 = now_sec();
+    search_iter_stats_t it;
+    memset(&it, 0, sizeof it);
+    it.depth = depth;
+    search_task_t tasks[4 * 2 * N * N];
+    int first[4], count[4];
+    double here[4];
+    unsigned int chance_rec[4];
+    int nt = 0;
+
+    /* --tree-dump keeps the last iteration only: restart the buffer with this root. */
+    unsigned int root_rec = TREE_NO_PARENT;
+    if (tree_records) {
+        tree_count = 0;
+        tree_iter_depth = depth;
+        tl_tree_parent = 0; /* any kept value: lets the root itself be recorded */
+        root_rec = tree_record_begin(grid, depth, 1, 0);
+        tree_records[root_rec].parent = TREE_NO_PARENT;
+    }
+    profile_ply_t *root_prof = profile_enabled ? &it.profile[profile_slot(depth)] : NULL;
+    profile_ply_t *chance_prof = profile_enabled ? &it.profile[profile_slot(depth - 1)] : NULL;
+    if (root_prof) {
+        root_prof->nodes++;
+        root_prof->expanded++;
+    }
+
+    for (int dir = 0; dir < 4; dir++) {
+        grid_t next;
+        grid_copy(next, grid);
+        int score;
+        first[dir] = nt;
+        count[dir] = 0;
+        chance_rec[dir] = TREE_NO_PARENT;
+        if (!do_move(next, dir, &score)) continue;
+        here[dir] = leaf_eval(next) + score * 0.1;
+        if (root_prof) root_prof->moves++;
+        if (depth < 2) {
+            grid_copy(tasks[nt].grid, next);
+            tasks[nt].depth = depth - 1;
+            tasks[nt].is_max = 0;
+            tasks[nt].prob = 1.0;
+            tasks[nt].tree_parent = root_rec;
+            nt++;
+        } else {
+            int cells[16][2];
+            int nc = chance_cells(next, depth - 1, cells);
+            if (tree_records) {
+                tl_tree_parent = root_rec;
+                chance_rec[dir] = tree_record_begin(next, depth - 1, 0, 1);
             }
-            for (int i = 0; i < NTHREADS; i++)
-                pthread_join(threads[i], NULL);
-            for (int i = 0; i < NTHREADS; i++) {
-                if (args[i].valid && args[i].result > best_score) {
-                    best_score = args[i].result;
-                    best_dir = args[i].dir;
+            if (chance_prof) {
+                chance_prof->nodes++;
+                chance_prof->expanded++;
+                chance_prof->cells += nc;
+                chance_prof->cells_avail += count_empty(next);
+            }
+            for (int i = 0; i < nc; i++)
+                for (int val = 2; val <= 4; val += 2) {
+                    grid_copy(tasks[nt].grid, next);
+                    tasks[nt].grid[cells[i][0]][cells[i][1]] = val;
+                    tasks[nt].depth = depth - 2;
+                    tasks[nt].is_max = 1;
+                    tasks[nt].prob = (val == 2) ? 0.9 : 0.1;
+                    tasks[nt].tree_parent = chance_rec[dir];
+                    nt++;
                 }
+        }
+        count[dir] = nt - first[dir];
+    }
+    tl_tree_parent = TREE_NO_PARENT;
+
+    task_queue_t q = { tasks, nt, 0, PTHREAD_MUTEX_INITIALIZER, depth };
+    worker_arg_t args[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    int nworkers = nthreads < nt ? nthreads : nt;
+    for (int i = 0; i < nworkers; i++) {
+        args[i].queue = &q;
+        args[i].thread_id = i;
+        args[i].nodes = 0;
+        memset(&args[i].perf, 0, sizeof args[i].perf);
+        pthread_create(&threads[i], NULL, worker, &args[i]);
+    }
+    for (int i = 0; i < nworkers; i++) {
+        pthread_join(threads[i], NULL);
+        it.nodes += args[i].nodes;
+        perf_add(&it.perf, &args[i].perf);
+        if (profile_enabled)
+            profile_add(it.profile, args[i].profile);
+    }
+    if (profile_enabled) {
+        /* The root plies only coordinate; their inclusive time is the workers' time below them. */
+        unsigned long long below = it.profile[profile_slot(depth < 2 ? depth - 1 : depth - 2)].ticks;
+        root_prof->ticks = below;
+        if (depth >= 2) chance_prof->ticks = below;
+    }
+
+    for (int dir = 0; dir < 4; dir++) {
+        if (count[dir] == 0) continue;
+        double future;
+        if (depth < 2) {
+            future = tasks[first[dir]].value;
+        } else {
+            double expected = 0, total_prob = 0;
+            for (int i = first[dir]; i < first[dir] + count[dir]; i++) {
+                expected += tasks[i].prob * tasks[i].value;
+                total_prob += tasks[i].prob;
             }
+            future = expected / total_prob;
+            it.nodes++; /* the root chance node itself */
+            if (chance_rec[dir] != TREE_NO_PARENT)
+                tree_records[chance_rec[dir]].value = (float)future;
         }
+        double result = here[dir] + eval_w.gamma * future;
+        if (result > res->value) {
+            res->value = result;
+            res->dir = dir;
+        }
+    }
+    res->depth = depth;
+    if (root_rec != TREE_NO_PARENT)
+        tree_records[root_rec].value = (float)res->value;
+    it.seconds = now_sec() - t0;
+    res->nodes += it.nodes;
+    perf_add(&res->perf, &it.perf);
+    if (res->niters < MAX_ITERATIONS)
+        res->iters[res->niters++] = it;
+}
+
+/*
+ * Monte Carlo tree search (--search mcts), the alternative to the fixed-depth expectimax above. Decision
+ * nodes hold positions and chance nodes the board after a move; a chance node's children are the spawns
+ * sampled so far. Progressive widening keeps at most 1 + sqrt(visits) of them, and a sample that matches
+ * none once the limit is reached goes to an existing child, drawn by spawn probability. A chance node is
+ * valued as the probability-weighted mean of its children rather than the mean of the returns that went
+ * through it, so a 4 spawn weighs 10% however often it was drawn. Moves are picked by UCT on the moves'
+ * values rescaled to [0, 1] (min-max over the node's moves), since leaf_eval and rollout scores have no
+ * common scale.
+ *
+ * A new leaf is valued by a greedy (most merge score, then most empty cells) or random rollout to the end
+ * of the game, with merge scores as rewards, undiscounted. --mcts-leaf eval uses leaf_eval instead: move
+ * rewards and discount as in expectimax, and the leaf as leaf_eval / (1 - gamma), the value of earning
+ * its evaluation every move from then on. The heuristic is tuned to rank boards at equal depth, not to
+ * compare them across depths, and plays clearly weaker that way than greedy rollouts.
+ *
+ * Threads either each grow their own tree and add up the root visits (--mcts-parallel root), or share one
+ * tree (tree): descent, expansion and backup under a lock, the leaf valued outside it, and visits counted
+ * on the way down so that concurrent descents spread out (virtual loss). Tree parallelism only pays off
+ * when rollouts dominate. The move played is the most visited one.
+ */
+enum { SEARCH_EXPECTIMAX, SEARCH_MCTS };
+enum { MCTS_LEAF_EVAL, MCTS_LEAF_RANDOM, MCTS_LEAF_GREEDY };
+#define MCTS_NODES (1 << 22)      /* node arena, split across the trees under root parallelism */
+#define MCTS_MAX_PLY 512
+#define MCTS_ROLLOUT_MOVES 10000
+
+static int search_mode = SEARCH_EXPECTIMAX;
+static int mcts_leaf = MCTS_LEAF_GREEDY;
+static int mcts_tree_parallel = 0;
+static long mcts_playouts = 2000;   /* per decision when no time budget applies */
+static double mcts_c = 3.0;         /* UCT exploration, on values rescaled to [0, 1] */
+
+typedef struct {
+    board_t board;           /* decision node: the position; chance node: the board after the move */
+    double value;            /* decision: sum of returns; chance: probability-weighted mean of the children */
+    unsigned int visits;
+    unsigned int child, sibling; /* first child, next sibling; 0 = none (node 0 is the root) */
+    float reward;            /* chance node: reward of the move into it */
+    float prob;              /* decision node below a chance node: probability of its spawn */
+    unsigned char dir;       /* chance node: the move */
+    unsigned char expanded;  /* decision node: its moves have been added */
+} mcts_node_t;
+
+typedef struct {
+    mcts_node_t *nodes;
+    unsigned int count, cap;
+    int shared;              /* tree parallelism: lock held except while valuing a leaf */
+    pthread_mutex_t lock;
+    int max_ply;             /* deepest decision node reached, in moves from the root */
+    unsigned long long playouts;
+} mcts_tree_t;
+
+static int mcts_tree_init(mcts_tree_t *t, unsigned int cap, int shared) {
+    memset(t, 0, sizeof *t);
+    if (!(t->nodes = (mcts_node_t *)malloc((size_t)cap * sizeof(mcts_node_t)))) return -1;
+    t->cap = cap;
+    t->shared = shared;
+    pthread_mutex_init(&t->lock, NULL);
+    return 0;
+}
+
+static void mcts_tree_free(mcts_tree_t *t) {
+    free(t->nodes);
+    pthread_mutex_destroy(&t->lock);
+    t->nodes = NULL;
+}
+
+static unsigned int mcts_new_node(mcts_tree_t *t, board_t b) {
+    mcts_node_t *n = &t->nodes[t->count];
+    memset(n, 0, sizeof *n);
+    n->board = b;
+    return t->count++;
+}
+
+/* Empties the tree down to a root for board b. */
+static void mcts_tree_reset(mcts_tree_t *t, board_t b) {
+    t->count = 0;
+    t->max_ply = 0;
+    t->playouts = 0;
+    mcts_new_node(t, b);
+}
+
+static double mcts_gamma(void) {
+    return mcts_leaf == MCTS_LEAF_EVAL ? eval_w.gamma : 1.0;
+}
+
+/* Adds a decision node's moves as chance children. 0 when the arena has no room for them. */
+static int mcts_expand(mcts_tree_t *t, unsigned int d) {
+    if (t->cap - t->count < 4) return 0;
+    board_t b = t->nodes[d].board;
+    unsigned int *link = &t->nodes[d].child;
+    for (int dir = 0; dir < 4; dir++) {
+        int score;
+        board_t after = board_move(b, dir, &score);
+        if (after == b) continue;
+        unsigned int c = mcts_new_node(t, after);
+        mcts_node_t *cn = &t->nodes[c];
+        cn->dir = (unsigned char)dir;
+        if (mcts_leaf == MCTS_LEAF_EVAL) {
+            grid_t g;
+            unpack_grid(after, g);
+            cn->reward = (float)(leaf_eval(g) + score * 0.1);
+        } else {
+            cn->reward = (float)score;
+        }
+        *link = c;
+        link = &cn->sibling;
+    }
+    t->nodes[d].expanded = 1;
+    return 1;
+}
+
+/* UCT over a decision node's moves; values are scaled to [0, 1] by the spread of the moves' values. */
+static unsigned int mcts_select(const mcts_tree_t *t, unsigned int d) {
+    const mcts_node_t *dn = &t->nodes[d];
+    double q[4], lo = 1e300, hi = -1e300, gamma = mcts_gamma();
+    unsigned int ids[4];
+    int n = 0;
+    for (unsigned int c = dn->child; c; c = t->nodes[c].sibling) {
+        const mcts_node_t *cn = &t->nodes[c];
+        if (!cn->visits) return c;
+        ids[n] = c;
+        q[n] = cn->reward + gamma * cn->value;
+        if (q[n] < lo) lo = q[n];
+        if (q[n] > hi) hi = q[n];
+        n++;
+    }
+    double range = hi > lo ? hi - lo : 1.0, logn = log((double)dn->visits), best = -1e300;
+    unsigned int best_c = dn->child;
+    for (int i = 0; i < n; i++) {
+        double u = (q[i] - lo) / range + mcts_c * sqrt(logn / t->nodes[ids[i]].visits);
+        if (u > best) {
+            best = u;
+            best_c = ids[i];
+        }
+    }
+    return best_c;
+}
+
+/* Samples a spawn below chance node c: an existing child, a new one (progressive widening), or 0 when c
+ * has no child and the arena is full. */
+static unsigned int mcts_spawn_child(mcts_tree_t *t, unsigned int c, unsigned long long *rng) {
+    board_t after = t->nodes[c].board, s = board_spawn(after, rng);
+    unsigned int nkids = 0;
+    double psum = 0;
+    for (unsigned int k = t->nodes[c].child; k; k = t->nodes[k].sibling) {
+        if (t->nodes[k].board == s) return k;
+        nkids++;
+        psum += t->nodes[k].prob;
+    }
+    if (nkids < 1 + (unsigned int)sqrt((double)t->nodes[c].visits) && t->count < t->cap) {
+        unsigned int k = mcts_new_node(t, s);
+        int four = ((s ^ after) & 0x2222222222222222ULL) != 0;
+        t->nodes[k].prob = (float)((four ? 0.1 : 0.9) / board_count_empty(after));
+        t->nodes[k].sibling = t->nodes[c].child;
+        t->nodes[c].child = k;
+        return k;
+    }
+    unsigned int k = t->nodes[c].child, last = k;
+    double r = (rng_next(rng) >> 11) * 0x1.0p-53 * psum;
+    for (; k; k = t->nodes[k].sibling) {
+        last = k;
+        if ((r -= t->nodes[k].prob) <= 0) break;
+    }
+    return last;
+}
+
+/* Plays greedy or random moves to the end of the game, at most MCTS_ROLLOUT_MOVES of them. Returns the
+ * score gained. */
+static double mcts_rollout(board_t b, unsigned long long *rng) {
+    double total = 0;
+    for (int m = 0; m < MCTS_ROLLOUT_MOVES; m++) {
+        board_t moves[4];
+        int scores[4], n = 0, pick = 0;
+        for (int dir = 0; dir < 4; dir++) {
+            board_t a = board_move(b, dir, &scores[n]);
+            if (a == b) continue;
+            moves[n++] = a;
+        }
+        if (!n) break;
+        if (mcts_leaf == MCTS_LEAF_GREEDY) {
+            int best = -1;
+            for (int i = 0; i < n; i++) {
+                int key = scores[i] * 16 + board_count_empty(moves[i]);
+                if (key > best) {
+                    best = key;
+                    pick = i;
+                }
+            }
+        } else {
+            pick = (int)(rng_next(rng) % (unsigned long long)n);
+        }
+        total += scores[pick];
+        b = board_spawn(moves[pick], rng);
+    }
+    return total;
+}
+
+/* Value of a leaf: a position (is_after = 0) or the board after a move whose spawns have no node yet. */
+static double mcts_leaf_value(board_t b, int is_after, unsigned long long *rng) {
+    if (mcts_leaf != MCTS_LEAF_EVAL)
+        return mcts_rollout(is_after ? board_spawn(b, rng) : b, rng);
+    grid_t g;
+    unpack_grid(b, g);
+    double v = leaf_eval(g);
+    if (is_after) return v / (1.0 - eval_w.gamma);
+    for (int dir = 0; dir < 4; dir++) {
+        int score;
+        if (board_move(b, dir, &score) != b) return v / (1.0 - eval_w.gamma);
+    }
+    return v; /* game over: no future */
+}
+
+/* One playout from the root: select and expand down to a leaf, value it, back up. */
+static void mcts_simulate(mcts_tree_t *t, unsigned long long *rng) {
+    unsigned int path[2 * MCTS_MAX_PLY + 2]; /* decision, chance, decision, ... */
+    int n = 0;
+    if (t->shared) pthread_mutex_lock(&t->lock);
+    unsigned int d = 0;
+    int leaf_is_after = 0;
+    for (;;) {
+        path[n++] = d;
+        t->nodes[d].visits++;
+        if ((d && t->nodes[d].visits == 1) || n > 2 * MCTS_MAX_PLY) break;
+        if (!t->nodes[d].expanded && !mcts_expand(t, d)) break;
+        if (!t->nodes[d].child) break; /* no legal move */
+        unsigned int c = mcts_select(t, d);
+        path[n++] = c;
+        t->nodes[c].visits++;
+        if (!(d = mcts_spawn_child(t, c, rng))) {
+            leaf_is_after = 1;
+            break;
+        }
+    }
+    if (n / 2 > t->max_ply) t->max_ply = n / 2;
+    board_t leaf = t->nodes[path[n - 1]].board;
+    if (t->shared) pthread_mutex_unlock(&t->lock);
+
+    double g = mcts_leaf_value(leaf, leaf_is_after, rng), gamma = mcts_gamma();
+
+    if (t->shared) pthread_mutex_lock(&t->lock);
+    for (int i = n - 1; i >= 0; i--) {
+        mcts_node_t *node = &t->nodes[path[i]];
+        if (i % 2 == 0) {
+            node->value += g;
+            continue;
+        }
+        if (!node->child) {
+            node->value += (g - node->value) / node->visits; /* no spawn node (arena full): mean return */
+        } else {
+            double sum = 0, psum = 0;
+            for (unsigned int k = node->child; k; k = t->nodes[k].sibling) {
+                const mcts_node_t *kn = &t->nodes[k];
+                if (!kn->visits) continue;
+                sum += kn->prob * kn->value / kn->visits;
+                psum += kn->prob;
+            }
+            if (psum > 0) node->value = sum / psum;
+        }
+        g = node->reward + gamma * g;
+    }
+    t->playouts++;
+    if (t->shared) pthread_mutex_unlock(&t->lock);
+}
+
+/* Runs playouts until deadline (now_sec() time) when it is > 0, else `playouts` of them. The root must be
+ * set (mcts_tree_reset). */
+static void mcts_run(mcts_tree_t *t, long playouts, double deadline, unsigned long long *rng) {
+    if (t->shared) pthread_mutex_lock(&t->lock);
+    if (!t->nodes[0].expanded) mcts_expand(t, 0);
+    if (t->shared) pthread_mutex_unlock(&t->lock);
+    if (!t->nodes[0].child) return;
+    for (long i = 0; deadline > 0 || i < playouts; i++) {
+        if ((i & 31) == 0 && ((deadline > 0 && now_sec() >= deadline) ||
+                              __atomic_load_n(&search_abort, __ATOMIC_RELAXED)))
+            break;
+        mcts_simulate(t, rng);
+    }
+}
+
+/* Root visits and values per move (values[dir] = -1e300 for an illegal move), added into visits[]/qsum[]. */
+static void mcts_root_stats(const mcts_tree_t *t, double visits[4], double qsum[4]) {
+    for (unsigned int c = t->nodes[0].child; c; c = t->nodes[c].sibling) {
+        const mcts_node_t *cn = &t->nodes[c];
+        visits[cn->dir] += cn->visits;
+        qsum[cn->dir] += cn->visits * (cn->reward + mcts_gamma() * cn->value);
+    }
+}
+
+/* Most visited move (ties: higher value); values[] gets each move's mean value, -1e300 if never tried. */
+static int mcts_pick(const double visits[4], const double qsum[4], double values[4]) {
+    int best = -1;
+    for (int dir = 0; dir < 4; dir++) {
+        values[dir] = visits[dir] > 0 ? qsum[dir] / visits[dir] : -1e300;
+        if (visits[dir] > 0 &&
+            (best < 0 || visits[dir] > visits[best] || (visits[dir] == visits[best] && values[dir] > values[best])))
+            best = dir;
+    }
+    return best;
+}
+
+#ifdef STRATEGY_2048_NO_MAIN /* tools only */
+/*
+ * MCTS decision on the calling thread with its own tree, for tools that run one game per thread: playouts
+ * simulations, or until deadline when it is > 0. Returns the move (-1 if none is legal); *depth_out gets
+ * the deepest ply the tree reached.
+ */
+TOOL_API int mcts_decide(mcts_tree_t *t, const grid_t grid, long playouts, double deadline, double values[4],
+                       int *depth_out) {
+    if (!move_tables_ready) init_move_tables();
+    board_t b = pack_grid(grid);
+    unsigned long long rng = mix64(b) | 1;
+    mcts_tree_reset(t, b);
+    mcts_run(t, playouts, deadline, &rng);
+    double visits[4] = { 0, 0, 0, 0 }, qsum[4] = { 0, 0, 0, 0 };
+    mcts_root_stats(t, visits, qsum);
+    if (depth_out) *depth_out = t->max_ply;
+    return mcts_pick(visits, qsum, values);
+}
+#endif
+
+typedef struct {
+    mcts_tree_t *tree;
+    long playouts;
+    double deadline;
+    unsigned long long seed;
+    perf_counts_t perf;
+} mcts_worker_arg_t;
+
+static void *mcts_worker(void *arg_) {
+    mcts_worker_arg_t *arg = (mcts_worker_arg_t *)arg_;
+    unsigned long long rng = arg->seed;
+    int perf_fds[PC_COUNT];
+    perf_start(perf_fds);
+    mcts_run(arg->tree, arg->playouts, arg->deadline, &rng);
+    perf_stop(perf_fds, &arg->perf);
+    return NULL;
+}
+
+/* --search / --mcts-* options, shared by strategy_2048 and the tools. Returns 1 if name is one of them
+ * (value taken), 0 if not, -1 with a message on stderr for a bad value. */
+TOOL_API int search_option(const char *name, const char *value) {
+    if (strcmp(name, "--search") == 0) {
+        if (strcmp(value, "expectimax") == 0) search_mode = SEARCH_EXPECTIMAX;
+        else if (strcmp(value, "mcts") == 0) search_mode = SEARCH_MCTS;
+        else { fprintf(stderr, "unknown search '%s' (expectimax, mcts)\n", value); return -1; }
+    } else if (strcmp(name, "--mcts-leaf") == 0) {
+        if (strcmp(value, "eval") == 0) mcts_leaf = MCTS_LEAF_EVAL;
+        else if (strcmp(value, "random") == 0) mcts_leaf = MCTS_LEAF_RANDOM;
+        else if (strcmp(value, "greedy") == 0) mcts_leaf = MCTS_LEAF_GREEDY;
+        else { fprintf(stderr, "unknown MCTS leaf '%s' (eval, random, greedy)\n", value); return -1; }
+    } else if (strcmp(name, "--mcts-parallel") == 0) {
+        if (strcmp(value, "root") == 0) mcts_tree_parallel = 0;
+        else if (strcmp(value, "tree") == 0) mcts_tree_parallel = 1;
+        else { fprintf(stderr, "unknown MCTS parallelism '%s' (root, tree)\n", value); return -1; }
+    } else if (strcmp(name, "--mcts-playouts") == 0) {
+        if ((mcts_playouts = atol(value)) < 1) { fprintf(stderr, "bad --mcts-playouts '%s'\n", value); return -1; }
+    } else if (strcmp(name, "--mcts-c") == 0) {
+        if ((mcts_c = atof(value)) < 0) { fprintf(stderr, "bad --mcts-c '%s'\n", value); return -1; }
     } else {
-        worker_arg_t args[NTHREADS];
-        pthread_t threads[NTHREADS];
-        for (int i = 0; i < NTHREADS; i++) {
-            grid_copy(args[i].grid, grid);
-            args[i].dir = dirs[i];
-            args[i].depth = depth;
-            args[i].thread_id = i;
-            args[i].valid = 0;
-            pthread_create(&threads[i], NULL, worker, &args[i]);
-        }
-        for (int i = 0; i < NTHREADS; i++)
-            pthread_join(threads[i], NULL);
-        for (int i = 0; i < NTHREADS; i++) {
-            if (args[i].valid && args[i].result > best_score) {
-                best_score = args[i].result;
-                best_dir = args[i].dir;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * MCTS root decision on nthreads threads: until timeout_ms runs out when it is > 0 and the board is serious
+ * (the budget expectimax deepens within), else mcts_playouts playouts split across the threads.
+ * res->nodes counts playouts and res->depth is the deepest ply reached. Returns 0, or -1 if no tree fits.
+ */
+static int mcts_search_root(const grid_t grid, int timeout_ms, int serious, search_result_t *res) {
+    if (nthreads <= 0) nthreads = default_thread_count();
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    if (!move_tables_ready) init_move_tables();
+    int ntrees = mcts_tree_parallel ? 1 : nthreads;
+    unsigned int cap = MCTS_NODES / ntrees < (1 << 16) ? 1 << 16 : MCTS_NODES / ntrees;
+    static mcts_tree_t trees[MAX_THREADS];
+    for (int i = 0; i < ntrees; i++)
+        if (mcts_tree_init(&trees[i], cap, mcts_tree_parallel) != 0) {
+            for (int j = 0; j < i; j++) mcts_tree_free(&trees[j]);
+            return -1;
+        }
+    board_t b = pack_grid(grid);
+    double t0 = now_sec();
+    mcts_worker_arg_t args[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    for (int i = 0; i < nthreads; i++) {
+        if (i < ntrees) mcts_tree_reset(&trees[i], b);
+        args[i].tree = &trees[mcts_tree_parallel ? 0 : i];
+        args[i].playouts = mcts_playouts / nthreads + (i < mcts_playouts % nthreads);
+        args[i].deadline = timeout_ms > 0 && serious ? t0 + timeout_ms / 1000.0 : 0;
+        args[i].seed = mix64(b + 0x9e3779b97f4a7c15ULL * (unsigned long long)(i + 1)) | 1;
+        memset(&args[i].perf, 0, sizeof args[i].perf);
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_create(&threads[i], NULL, mcts_worker, &args[i]);
+    search_iter_stats_t it;
+    memset(&it, 0, sizeof it);
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        perf_add(&it.perf, &args[i].perf);
+    }
+
+    double visits[4] = { 0, 0, 0, 0 }, qsum[4] = { 0, 0, 0, 0 }, values[4];
+    for (int i = 0; i < ntrees; i++) {
+        mcts_root_stats(&trees[i], visits, qsum);
+        it.nodes += trees[i].playouts;
+        if (trees[i].max_ply > it.depth) it.depth = trees[i].max_ply;
+        mcts_tree_free(&trees[i]);
+    }
+    res->dir = mcts_pick(visits, qsum, values);
+    res->value = res->dir >= 0 ? values[res->dir] : -1e300;
+    res->depth = it.depth;
+    res->nodes = it.nodes;
+    res->perf = it.perf;
+    it.seconds = now_sec() - t0;
+    res->iters[0] = it;
+    res->niters = 1;
+    return 0;
+}
+
+/* The expectimax iterations of search_root into res, from the depth after res->depth (0: none ran yet),
+ * so a result with fewer depths (a speculative search, see serve) is carried on to search_root's. On a
+ * serious board with timeout_ms > 0 it deepens up to the policy depth while the budget lasts: a new depth
+ * starts only before the monotonic-clock deadline. Otherwise it runs the policy depth alone. */
+static void search_deepen(const grid_t grid, int timeout_ms, search_result_t *res) {
+    int serious;
+    int depth = policy_depth(grid, &serious);
+    if (timeout_ms > 0 && serious) {
+        double deadline = now_sec() + timeout_ms / 1000.0;
+        for (int d = res->depth ? res->depth + 1 : depth_low; d <= depth && now_sec() < deadline; d++) {
+            search_iteration(grid, d, res);
+            if (__atomic_load_n(&search_abort, __ATOMIC_RELAXED)) break;
+        }
+    } else if (res->depth < depth) {
+        search_iteration(grid, depth, res);
+    }
+}
+
+static void search_result_init(search_result_t *res) {
+    memset(res, 0, sizeof *res);
+    res->dir = -1;
+    res->value = -1e300;
+}
+
+/* Full root decision under the depth policy (or MCTS with --search mcts); timeout_ms as in search_deepen.
+ * Caches must be allocated (caches_alloc, or shared_cache) for expectimax. Cut short when search_abort is
+ * set; callers that set it discard the result. */
+TOOL_API search_result_t search_root(const grid_t grid, int timeout_ms) {
+    search_result_t res;
+    search_result_init(&res);
+    if (search_mode == SEARCH_MCTS) {
+        int serious;
+        policy_depth(grid, &serious);
+        if (mcts_search_root(grid, timeout_ms, serious, &res) != 0)
+            fprintf(stderr, "strategy_2048: failed to allocate the MCTS tree\n");
+        return res;
+    }
+    search_deepen(grid, timeout_ms, &res);
+    return res;
+}
+
+#ifdef STRATEGY_2048_NO_MAIN /* tools only */
+/*
+ * Root values of the four moves at a fixed depth (-1e300 for an illegal move), on the calling thread's
+ * current_cache as it is: not cleared, so tools can keep one table across positions or share it.
+ */
+static void search_move_values(const grid_t grid, int depth, double values[4]) {
+    for (int dir = 0; dir < 4; dir++) {
+        grid_t next;
+        grid_copy(next, grid);
+        int score;
+        values[dir] = -1e300;
+        if (do_move(next, dir, &score))
+            values[dir] = leaf_eval(next) + score * 0.1 + eval_w.gamma * expectimax(next, depth - 1, 0);
+    }
+}
+
+/*
+ * Fixed-depth root decision on the calling thread, using its current_cache (cleared here) instead of the
+ * worker pool; for tools that run one game per thread. Same move as search_root without a timeout.
+ */
+TOOL_API int search_fixed_depth(const grid_t grid, int depth, double *value_out) {
+    cache_clear();
+    double values[4];
+    search_move_values(grid, depth, values);
+    int best_dir = -1;
+    double best = -1e300;
+    for (int dir = 0; dir < 4; dir++)
+        if (values[dir] > -1e299 && values[dir] > best) {
+            best = values[dir];
+            best_dir = dir;
+        }
+    if (value_out) *value_out = best;
+    return best_dir;
+}
+#endif
+
+/* --perf report (stderr): one line per depth iteration, then the decision total. */
+TOOL_API void print_perf_report(FILE *f, const search_result_t *res) {
+    double total = 0;
+    for (int i = 0; i < res->niters; i++) {
+        const search_iter_stats_t *it = &res->iters[i];
+        total += it->seconds;
+        fprintf(f, "perf iteration depth=%d nodes=%llu ms=%.2f", it->depth, it->nodes, it->seconds * 1000.0);
+        perf_print(f, &it->perf, it->nodes);
+        fprintf(f, "\n");
+    }
+    fprintf(f, "perf decision move=%s depth=%d nodes=%llu ms=%.2f",
+            res->dir < 0 ? "none" : dir_name(res->dir), res->depth, res->nodes, total * 1000.0);
+    perf_print(f, &res->perf, res->nodes);
+    fprintf(f, "\n");
+}
+
+/* --profile report (stderr): one table per depth iteration, ply 0 = root max node. */
+TOOL_API void print_profile_report(FILE *f, const search_result_t *res) {
+    for (int i = 0; i < res->niters; i++) {
+        const search_iter_stats_t *it = &res->iters[i];
+        /* tree_ms is worker time inside the tree; the rest of ms is mostly clearing the caches. */
+        fprintf(f, "profile iteration depth=%d nodes=%llu ms=%.2f tree_ms=%.2f\n", it->depth, it->nodes,
+                it->seconds * 1000.0, it->profile[profile_slot(it->depth)].ticks / profile_ticks_per_ns / 1e6);
+        fprintf(f, "ply\ttype\tnodes\ttt_hits\tleaves\texpanded\tavg_moves\tavg_cells\tcells_cut\tself_ms\tincl_ms\n");
+        unsigned long long cut_total = 0, avail_total = 0;
+        for (int ply = 0; ply <= it->depth; ply++) {
+            const profile_ply_t *p = &it->profile[profile_slot(it->depth - ply)];
+            const profile_ply_t *below = ply < it->depth ? &it->profile[profile_slot(it->depth - ply - 1)] : NULL;
+            int is_max = ply % 2 == 0;
+            double incl_ms = p->ticks / profile_ticks_per_ns / 1e6;
+            double self_ms = incl_ms - (below ? below->ticks / profile_ticks_per_ns / 1e6 : 0);
+            unsigned long long exp_max = is_max ? p->expanded : 0, exp_chance = is_max ? 0 : p->expanded;
+            fprintf(f, "%d\t%s\t%llu\t%llu\t%llu\t%llu\t%.2f\t%.2f\t%llu\t%.2f\t%.2f\n",
+                    ply, is_max ? "max" : "chance", p->nodes, p->tt_hits, p->leaves, p->expanded,
+                    exp_max ? (double)p->moves / exp_max : 0.0,
+                    exp_chance ? (double)p->cells / exp_chance : 0.0,
+                    p->cells_avail - p->cells, self_ms < 0 ? 0.0 : self_ms, incl_ms);
+            cut_total += p->cells_avail - p->cells;
+            avail_total += p->cells_avail;
+        }
+        if (avail_total)
+            fprintf(f, "profile cap: %llu of %llu spawn cells skipped (%.1f%%), %llu subtrees not searched\n",
+                    cut_total, avail_total, 100.0 * cut_total / avail_total, 2 * cut_total);
+    }
+}
+
+#ifndef STRATEGY_2048_NO_MAIN
+/*
+ * --serve: a long-running engine for the bot, one request per line on stdin and one reply line on stdout.
+ *
+ *   search v0 .. v15           reply "<move> <how>": how is hit (speculation had the answer ready), wait
+ *                              (its speculative search was running and was waited for), partial (it had
+ *                              searched the shallower depths, the rest were searched now), search
+ *                              (searched now) or book. <move> is none when no move is legal.
+ *   speculate v0 .. v15 MOVE   no reply. The position MOVE was just played from: the spawns on the board
+ *                              after MOVE (2s before 4s, i.e. by probability) are searched in the
+ *                              background until the next search request, one depth of the iterative
+ *                              deepening at a time in turn, so every spawn gets its shallow depths before
+ *                              any gets the deep ones. Without deepening each spawn is searched at its
+ *                              policy depth in turn; with MCTS each gets an equal share of the budget.
+ *   quit, or end of input
+ *
+ * Every search runs on one shared transposition table that is kept across moves (cleared once searches
+ * since the last clear visited half its size), so the speculative searches of sibling spawns and the next
+ * real search reuse each other's subtrees. A search request for a board speculation has not reached stops
+ * speculation between root tasks (search_abort) and searches it at once.
+ */
+#define SPEC_MAX (2 * N * N)
+enum { SPEC_PENDING, SPEC_RUNNING, SPEC_DONE };
+
+typedef struct {
+    board_t board;
+    int state;               /* SPEC_PENDING: more depths to search */
+    search_result_t res;     /* the depths searched so far; search_root's result once SPEC_DONE */
+} spec_candidate_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    spec_candidate_t cand[SPEC_MAX];
+    int ncand, next;
+    int running;             /* the speculation thread is searching a candidate */
+    int quit;
+    int timeout_ms;
+    unsigned long long nodes_since_clear;
+} spec = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+/* The next pending candidate after the last one searched, or -1. Called with spec.lock held. */
+static int spec_pick(void) {
+    for (int k = 0; k < spec.ncand; k++) {
+        int i = (spec.next + k) % spec.ncand;
+        if (spec.cand[i].state == SPEC_PENDING) {
+            spec.next = i + 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* One turn of speculation on grid, from the depths in res (see serve): returns 1 once res is search_root's
+ * result. ncand shares the budget between the candidates under MCTS. */
+static int spec_step(const grid_t grid, int ncand, search_result_t *res) {
+    if (search_mode == SEARCH_MCTS) {
+        *res = search_root(grid, spec.timeout_ms / ncand);
+        return 1;
+    }
+    int serious;
+    int depth = policy_depth(grid, &serious);
+    if (spec.timeout_ms > 0 && serious) {
+        int d = res->depth ? res->depth + 1 : depth_low;
+        search_iteration(grid, d, res);
+        return d >= depth;
+    }
+    search_iteration(grid, depth, res);
+    return 1;
+}
+
+static void *spec_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&spec.lock);
+    for (;;) {
+        int i;
+        while (!spec.quit && (i = spec_pick()) < 0)
+            pthread_cond_wait(&spec.wake, &spec.lock);
+        if (spec.quit) break;
+        spec_candidate_t *c = &spec.cand[i];
+        c->state = SPEC_RUNNING;
+        spec.running = 1;
+        search_result_t res = c->res;
+        int ncand = spec.ncand;
+        grid_t g;
+        unpack_grid(c->board, g);
+        pthread_mutex_unlock(&spec.lock);
+        unsigned long long nodes = res.nodes;
+        int complete = spec_step(g, ncand, &res);
+        pthread_mutex_lock(&spec.lock);
+        spec.running = 0;
+        spec.nodes_since_clear += res.nodes - nodes;
+        if (__atomic_load_n(&search_abort, __ATOMIC_RELAXED)) {
+            c->state = SPEC_PENDING; /* cut short: the depth is not the search's, c->res keeps the others */
+        } else {
+            c->res = res;
+            c->state = complete ? SPEC_DONE : SPEC_PENDING;
+        }
+        pthread_cond_broadcast(&spec.done);
+    }
+    pthread_mutex_unlock(&spec.lock);
+    return NULL;
+}
+
+/* Drops the queued spawns and stops a running speculative search. Called with spec.lock held. */
+static void spec_stop(void) {
+    spec.ncand = spec.next = 0;
+    if (!spec.running) return;
+    __atomic_store_n(&search_abort, 1, __ATOMIC_RELAXED);
+    while (spec.running)
+        pthread_cond_wait(&spec.done, &spec.lock);
+    __atomic_store_n(&search_abort, 0, __ATOMIC_RELAXED);
+}
+
+static void serve_speculate(const grid_t grid, int dir) {
+    grid_t after;
+    grid_copy(after, grid);
+    int score;
+    pthread_mutex_lock(&spec.lock);
+    spec_stop();
+    if (do_move(after, dir, &score)) {
+        int n = 0;
+        for (int val = 2; val <= 4; val += 2)
+            for (int r = 0; r < N; r++)
+                for (int c = 0; c < N; c++)
+                    if (after[r][c] == 0) {
+                        after[r][c] = val;
+                        spec.cand[n].board = pack_grid(after);
+                        spec.cand[n].state = SPEC_PENDING;
+                        search_result_init(&spec.cand[n].res);
+                        n++;
+                        after[r][c] = 0;
+                    }
+        spec.ncand = n;
+        pthread_cond_signal(&spec.wake);
+    }
+    pthread_mutex_unlock(&spec.lock);
+}
+
+static void serve_search(const grid_t grid, int timeout_sec, book_t *book, int book_append) {
+    board_t b = pack_grid(grid);
+    search_result_t res;
+    const char *how = NULL;
+    int dir, depth;
+    double value;
+    if (book && book_probe(book, b, &dir, &value, &depth) && depth >= policy_depth(grid, NULL)) {
+        res.dir = dir;
+        res.value = value;
+        res.depth = depth;
+        how = "book";
+    }
+    pthread_mutex_lock(&spec.lock);
+    for (int i = 0; !how && i < spec.ncand; i++) {
+        if (spec.cand[i].board != b) continue;
+        int waited = 0;
+        for (; spec.cand[i].state == SPEC_RUNNING; waited = 1)
+            pthread_cond_wait(&spec.done, &spec.lock);
+        if (spec.cand[i].state == SPEC_DONE) {
+            res = spec.cand[i].res;
+            how = waited ? "wait" : "hit";
+        } else if (spec.cand[i].res.depth > 0) {
+            res = spec.cand[i].res;
+            how = "partial";
+        }
+        break;
+    }
+    spec_stop();
+    if (spec.nodes_since_clear > cache_size / 2) {
+        memset(shared_cache, 0, cache_size * sizeof(cache_entry_t));
+        spec.nodes_since_clear = 0;
+    }
+    pthread_mutex_unlock(&spec.lock);
+    /* speculation is stopped: no other writer of nodes_since_clear */
+    if (how && strcmp(how, "partial") == 0) {
+        unsigned long long nodes = res.nodes;
+        search_deepen(grid, timeout_sec * 1000, &res);
+        spec.nodes_since_clear += res.nodes - nodes;
+    } else if (!how) {
+        res = search_root(grid, timeout_sec * 1000);
+        spec.nodes_since_clear += res.nodes;
+        how = "search";
+    }
+    if (book_append && strcmp(how, "book") != 0 && search_mode == SEARCH_EXPECTIMAX)
+        book_store(book, b, res.dir, res.value, res.depth);
+    printf("%s %s\n", res.dir < 0 ? "none" : dir_name(res.dir), how);
+    fflush(stdout);
+}
+
+static int dir_from_name(const char *name) {
+    for (int dir = 0; dir < 4; dir++)
+        if (strcmp(name, dir_name(dir)) == 0) return dir;
+    return -1;
+}
+
+static int serve(int timeout_sec, book_t *book, int book_append) {
+    if (nthreads <= 0) nthreads = default_thread_count();
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    cache_size = 4ULL * CACHE_SIZE;
+    if (search_mode == SEARCH_EXPECTIMAX &&
+        !(shared_cache = (cache_entry_t *)calloc(cache_size, sizeof(cache_entry_t)))) {
+        fprintf(stderr, "strategy_2048: failed to allocate cache\n");
+        return 1;
+    }
+    spec.timeout_ms = timeout_sec * 1000;
+    pthread_t thread;
+    pthread_create(&thread, NULL, spec_main, NULL);
+
+    char line[1024];
+    while (fgets(line, sizeof line, stdin)) {
+        char *tok[18], *save = NULL;
+        int n = 0;
+        for (char *t = strtok_r(line, " \t\r\n", &save); t && n < 18; t = strtok_r(NULL, " \t\r\n", &save))
+            tok[n++] = t;
+        if (!n) continue;
+        if (strcmp(tok[0], "quit") == 0) break;
+        grid_t grid;
+        for (int i = 0; i < N * N; i++)
+            grid[i / N][i % N] = i + 1 < n ? atoi(tok[i + 1]) : 0;
+        if (strcmp(tok[0], "search") == 0 && n == 17) {
+            serve_search(grid, timeout_sec, book, book_append);
+        } else if (strcmp(tok[0], "speculate") == 0 && n == 18 && dir_from_name(tok[17]) >= 0) {
+            serve_speculate(grid, dir_from_name(tok[17]));
+        } else {
+            fprintf(stderr, "strategy_2048: bad request '%s'\n", tok[0]);
+            if (strcmp(tok[0], "search") == 0) {
+                printf("none error\n");
+                fflush(stdout);
             }
         }
     }
 
-    for (int i = 0; i < NTHREADS; i++)
-        free(caches[i]);
+    pthread_mutex_lock(&spec.lock);
+    spec_stop();
+    spec.quit = 1;
+    pthread_cond_signal(&spec.wake);
+    pthread_mutex_unlock(&spec.lock);
+    pthread_join(thread, NULL);
+    free(shared_cache);
+    shared_cache = NULL;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int timeout_sec = 0, book_append = 0, serve_mode = 0;
+    int pos[6], npos = 0;
+    const char *book_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            nthreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--eval") == 0 && i + 1 < argc) {
+            if (eval_select(argv[++i]) != 0)
+                return 1;
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            if (eval_weights_load(argv[++i], &eval_w) != 0)
+                return 1;
+        } else if (strcmp(argv[i], "--perf") == 0)
+            perf_enabled = 1;
+        else if (strcmp(argv[i], "--profile") == 0)
+            profile_enabled = 1;
+        else if (strcmp(argv[i], "--tree-dump") == 0 && i + 1 < argc)
+            tree_dump_path = argv[++i];
+        else if (strcmp(argv[i], "--tree-limit") == 0 && i + 1 < argc)
+            tree_limit = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--tree-sample") == 0 && i + 1 < argc)
+            tree_sample = atof(argv[++i]);
+        else if (strcmp(argv[i], "--book") == 0 && i + 1 < argc)
+            book_path = argv[++i];
+        else if (strcmp(argv[i], "--book-append") == 0)
+            book_append = 1;
+        else if (strcmp(argv[i], "--serve") == 0)
+            serve_mode = 1;
+        else if (strncmp(argv[i], "--", 2) == 0 && i + 1 < argc) {
+            int r = search_option(argv[i], argv[i + 1]);
+            if (r < 0)
+                return 1;
+            if (r > 0)
+                i++;
+        } else if (npos < 6)
+            pos[npos++] = atoi(argv[i]);
+    }
+    if (npos >= 4) {
+        depth_low    = pos[0];
+        depth_high   = pos[1];
+        serious_empty = pos[2];
+        serious_max_tile = pos[3];
+    }
+    if (npos >= 5)
+        max_empty_samples = pos[4];
+    if (npos >= 6)
+        timeout_sec = pos[5];
+
+    book_t book;
+    int have_book = book_path && book_open(book_path, book_append, &book) == 0;
+    if (serve_mode) {
+        if (perf_enabled || profile_enabled || tree_dump_path)
+            fprintf(stderr, "strategy_2048: --perf, --profile and --tree-dump are ignored with --serve\n");
+        perf_enabled = profile_enabled = 0;
+        tree_dump_path = NULL;
+        int rc = serve(timeout_sec, have_book ? &book : NULL, have_book && book_append);
+        if (have_book) book_close(&book);
+        ntuple_unload(&eval_net);
+        return rc;
+    }
+
+    grid_t grid;
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++)
+            if (scanf("%d", &grid[r][c]) != 1)
+                grid[r][c] = 0;
+
+    /* Book hits skip the search (not wanted when measuring it). */
+    if (have_book && !perf_enabled && !profile_enabled && !tree_dump_path) {
+        int dir, depth;
+        double value;
+        if (book_probe(&book, pack_grid(grid), &dir, &value, &depth) && depth >= policy_depth(grid, NULL)) {
+            book_close(&book);
+            ntuple_unload(&eval_net);
+            printf("%s\n", dir_name(dir));
+            return 0;
+        }
+    }
+
+    if (search_mode == SEARCH_EXPECTIMAX && caches_alloc() != 0) {
+        fprintf(stderr, "strategy_2048: failed to allocate cache\n");
+        return 1;
+    }
+    if (search_mode == SEARCH_MCTS && (profile_enabled || tree_dump_path)) {
+        fprintf(stderr, "strategy_2048: --profile and --tree-dump trace expectimax only, ignored with --search mcts\n");
+        profile_enabled = 0;
+        tree_dump_path = NULL;
+    }
+
+    if (perf_enabled)
+        perf_probe();
+    if (profile_enabled)
+        profile_calibrate();
+    if (tree_dump_path && tree_limit > 0) {
+        if (tree_limit > TREE_NO_PARENT) tree_limit = TREE_NO_PARENT;
+        tree_records = (tree_record_t *)malloc(tree_limit * sizeof(tree_record_t));
+        if (!tree_records)
+            fprintf(stderr, "strategy_2048: cannot allocate %llu tree records, --tree-dump ignored\n", tree_limit);
+    }
+    search_result_t res = search_root(grid, timeout_sec * 1000);
+    if (perf_enabled)
+        print_perf_report(stderr, &res);
+    if (profile_enabled)
+        print_profile_report(stderr, &res);
+    if (tree_records) {
+        if (tree_dump_write() != 0)
+            fprintf(stderr, "strategy_2048: cannot write tree dump %s\n", tree_dump_path);
+        free(tree_records);
+    }
+
+    if (have_book) {
+        /* MCTS depths are tree plies, not comparable with expectimax depths: not stored. */
+        if (book_append && search_mode == SEARCH_EXPECTIMAX &&
+            book_store(&book, pack_grid(grid), res.dir, res.value, res.depth) != 0 && res.dir >= 0)
+            fprintf(stderr, "strategy_2048: book %s is full around this board, not stored\n", book_path);
+        book_close(&book);
+    }
+    caches_free();
+    ntuple_unload(&eval_net);
 
-    if (best_dir < 0) {
+    if (res.dir < 0) {
         printf("none\n");
         return 0;
     }
-    printf("%s\n", dir_name(best_dir));
+    printf("%s\n", dir_name(res.dir));
     return 0;
 }
+#endif /* STRATEGY_2048_NO_MAIN */
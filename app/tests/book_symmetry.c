@@ -0,0 +1,59 @@
+/*
+ * The position book's symmetry mapping, on random boards with empties and small tiles (so most moves
+ * merge something). For each of the eight symmetries k of a board: moving then applying k is applying k
+ * then making the mapped move (same score), book_sym_dir's inverse maps the move back, the canonical
+ * board is the same, and a result stored under one orientation is probed back with the move mapped.
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "../strategy_2048.c"
+#include "check.h"
+
+int main(void) {
+    book_t book;
+    init_move_tables();
+    char path[] = "/tmp/book_symmetry_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0, "cannot create a scratch book");
+    if (fd < 0) return check_report();
+    close(fd);
+    int opened = book_create(path, 16) == 0 && book_open(path, 1, &book) == 0;
+    CHECK(opened, "cannot open the scratch book %s", path);
+    if (!opened) {
+        unlink(path);
+        return check_report();
+    }
+    unsigned long long rng = 2048;
+    for (int i = 0; i < 5000; i++) {
+        board_t b = 0;
+        for (int c = 0; c < 16; c++) {
+            rng = mix64(rng + 1);
+            b = b << 4 | (rng % 6);
+        }
+        int kb, symmetric = 0;
+        board_t canon = book_canonical(b, &kb);
+        for (int k = 1; k < 8; k++) symmetric |= book_sym(b, k) == b;
+        int dir = i & 3, stored = b && !symmetric && book_store(&book, b, dir, i, 5) == 0;
+        for (int k = 0; k < 8; k++) {
+            board_t s = book_sym(b, k);
+            int ks;
+            CHECK(book_canonical(s, &ks) == canon, "board %016llx sym %d: canonical board differs", b, k);
+            for (int d = 0; d < 4; d++) {
+                int score, sscore, sd = book_sym_dir(d, k, 0);
+                board_t moved = book_sym(board_move(b, d, &score), k), smoved = board_move(s, sd, &sscore);
+                CHECK(moved == smoved && score == sscore && book_sym_dir(sd, k, 1) == d,
+                      "board %016llx sym %d dir %s: %016llx (%d) vs %016llx (%d)", b, k, dir_name(d), moved, score,
+                      smoved, sscore);
+            }
+            int got_dir, got_depth;
+            double got_value;
+            CHECK(!stored || (book_probe(&book, s, &got_dir, &got_value, &got_depth) &&
+                              got_dir == book_sym_dir(dir, k, 0) && got_value == i && got_depth == 5),
+                  "board %016llx sym %d: stored move %s not found as %s", b, k, dir_name(dir),
+                  dir_name(book_sym_dir(dir, k, 0)));
+        }
+    }
+    book_close(&book);
+    unlink(path);
+    return check_report();
+}
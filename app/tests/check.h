@@ -0,0 +1,27 @@
+/*
+ * Checks for the C tests in app/tests (built and run by test_c.py). CHECK(cond, fmt, ...) reports the
+ * first failures with their line; main returns check_report(), non-zero if any check failed.
+ */
+
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <stdio.h>
+
+static int check_failures;
+
+#define CHECK(cond, ...)                                                                                    \
+    do {                                                                                                    \
+        if (!(cond) && check_failures++ < 10) {                                                             \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);                                                 \
+            fprintf(stderr, __VA_ARGS__);                                                                   \
+            fputc('\n', stderr);                                                                            \
+        }                                                                                                   \
+    } while (0)
+
+static int check_report(void) {
+    if (check_failures) fprintf(stderr, "%d checks failed\n", check_failures);
+    return check_failures != 0;
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * The engine's move rule (move_row_left, through do_move in all four directions): tiles
+ * slide to the wall, a tile merges with the next tile in the row across empty cells, and each tile
+ * merges at most once per move.
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "../strategy_2048.c"
+#include "check.h"
+
+static const struct {
+    int before[N], after[N], score;
+} cases[] = {
+    { { 0, 0, 0, 2 }, { 2, 0, 0, 0 }, 0 },
+    { { 2, 0, 2, 0 }, { 4, 0, 0, 0 }, 4 },
+    { { 2, 0, 0, 2 }, { 4, 0, 0, 0 }, 4 },
+    { { 2, 2, 2, 0 }, { 4, 2, 0, 0 }, 4 },
+    { { 2, 2, 2, 2 }, { 4, 4, 0, 0 }, 8 },
+    { { 4, 2, 2, 0 }, { 4, 4, 0, 0 }, 4 },
+    { { 8, 0, 8, 8 }, { 16, 8, 0, 0 }, 16 },
+    { { 2, 4, 2, 4 }, { 2, 4, 2, 4 }, 0 },
+};
+
+/* `line` along column or row 1, starting at the wall the move `dir` slides towards. */
+static void place(grid_t g, const int line[N], int dir) {
+    memset(g, 0, sizeof(grid_t));
+    for (int k = 0; k < N; k++) {
+        if (dir == 0) g[k][1] = line[k];
+        else if (dir == 1) g[1][N - 1 - k] = line[k];
+        else if (dir == 2) g[N - 1 - k][1] = line[k];
+        else g[1][k] = line[k];
+    }
+}
+
+int main(void) {
+    for (size_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+        for (int dir = 0; dir < 4; dir++) {
+            grid_t g, want;
+            place(g, cases[i].before, dir);
+            place(want, cases[i].after, dir);
+            int score, changed = do_move(g, dir, &score);
+            int same = memcmp(cases[i].before, cases[i].after, sizeof cases[i].before) == 0;
+            CHECK(memcmp(g, want, sizeof(grid_t)) == 0 && score == cases[i].score && changed == !same,
+                  "case %zu %s: do_move gives score %d changed %d, want score %d changed %d", i, dir_name(dir),
+                  score, changed, cases[i].score, !same);
+        }
+    }
+    return check_report();
+}
@@ -0,0 +1,44 @@
+import unittest
+
+from bot_2048 import BOARD_SIZE, move
+
+# Rows before and after a left move, with the points it scores: each tile merges at most once, across
+# gaps, and the pair nearest the wall merges first.
+MOVE_LEFT_CASES = [
+    ([2, 2, 2, 2], [4, 4, 0, 0], 8),
+    ([2, 0, 2, 0], [4, 0, 0, 0], 4),
+    ([2, 2, 4, 0], [4, 4, 0, 0], 4),
+    ([4, 2, 2, 0], [4, 4, 0, 0], 4),
+    ([2, 2, 2, 0], [4, 2, 0, 0], 4),
+    ([4, 4, 8, 8], [8, 16, 0, 0], 24),
+    ([0, 0, 0, 2], [2, 0, 0, 0], 0),
+    ([2, 4, 8, 16], [2, 4, 8, 16], 0),
+]
+
+
+def place(row, direction):
+    # The row along column or row 1, the end at the wall the move slides towards first.
+    g = [[0] * BOARD_SIZE for _ in range(BOARD_SIZE)]
+    for k, v in enumerate(row):
+        if direction == "left":
+            g[1][k] = v
+        elif direction == "right":
+            g[1][BOARD_SIZE - 1 - k] = v
+        elif direction == "up":
+            g[k][1] = v
+        else:
+            g[BOARD_SIZE - 1 - k][1] = v
+    return g
+
+
+class MoveTest(unittest.TestCase):
+    def test_merge_cases(self):
+        for before, after, score in MOVE_LEFT_CASES:
+            for direction in ("left", "right", "up", "down"):
+                with self.subTest(row=before, direction=direction):
+                    self.assertEqual(move(place(before, direction), direction),
+                                     (place(after, direction), score, before != after))
+
+
+if __name__ == "__main__":
+    unittest.main()
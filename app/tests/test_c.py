@@ -0,0 +1,32 @@
+"""
+The C tests: every tests/*.c is a program that #includes the code under test and exits non-zero after
+printing its failed CHECKs (check.h). Each one is built with gcc and run.
+"""
+
+import glob
+import os
+import shutil
+import subprocess
+import tempfile
+import unittest
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+@unittest.skipUnless(shutil.which("gcc"), "needs gcc")
+class CTests(unittest.TestCase):
+    def test_programs(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            for source in sorted(glob.glob(os.path.join(TESTS_DIR, "*.c"))):
+                name = os.path.basename(source)
+                with self.subTest(name):
+                    exe = os.path.join(tmp, name[:-2])
+                    build = subprocess.run(["gcc", "-O2", "-o", exe, source, "-lm", "-lpthread"],
+                                           capture_output=True, text=True)
+                    self.assertEqual(build.returncode, 0, build.stderr)
+                    run = subprocess.run([exe], capture_output=True, text=True, timeout=300)
+                    self.assertEqual(run.returncode, 0, run.stdout + run.stderr)
+
+
+if __name__ == "__main__":
+    unittest.main()
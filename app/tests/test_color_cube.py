@@ -0,0 +1,60 @@
+import json
+import os
+import unittest
+
+import numpy as np
+
+from color_cube import ColorCube
+
+APP_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def linear_lookup(palette, rgb):
+    # The loop the cube replaces: every palette entry, nearest by squared RGB distance.
+    best_val, best_dist = 0, float("inf")
+    for value, color in palette.items():
+        dist = sum((float(a) - float(b)) ** 2 for a, b in zip(rgb, color))
+        if dist < best_dist:
+            best_val, best_dist = value, dist
+    return best_val, best_dist
+
+
+class ColorCubeTest(unittest.TestCase):
+    def test_matches_linear_search(self):
+        # From the bot's palette through learned, corrected and removed colors, on random colors and on
+        # colors near the palette and near the boundaries between two entries.
+        rng = np.random.default_rng(2048)
+        with open(os.path.join(APP_DIR, "2048_colors.json"), "r", encoding="utf-8") as f:
+            palette = {int(v): tuple(rgb) for v, rgb in json.load(f).items()}
+        cube = ColorCube()
+        for step in range(13):
+            if step == 0:
+                pass  # as loaded
+            elif step % 4 == 3 and len(palette) > 1:  # a removed color (rebuild)
+                del palette[int(rng.choice(list(palette)))]
+            elif step % 4 == 2:  # a corrected color
+                palette[int(rng.choice(list(palette)))] = tuple(int(x) for x in rng.integers(0, 256, 3))
+            else:
+                for _ in range(int(rng.integers(1, 6))):  # learned colors
+                    palette[1 << int(rng.integers(0, 17))] = tuple(int(x) for x in rng.integers(0, 256, 3))
+            cube.sync(palette)
+            colors = np.array(list(palette.values()), dtype=np.float64)
+            pairs = rng.integers(0, len(colors), (200, 2))
+            probes = np.vstack([
+                rng.uniform(-20.0, 275.0, (2000, 3)),  # anywhere, including outside 0..255
+                colors[rng.integers(0, len(colors), 500)] + rng.normal(0.0, 3.0, (500, 3)),
+                (colors[pairs[:, 0]] + colors[pairs[:, 1]]) / 2.0 + rng.normal(0.0, 1.0, (200, 3)),
+            ])
+            vals, dists = cube.lookup(probes)
+            for rgb, val, dist in zip(probes, vals, dists):
+                want_val, want_dist = linear_lookup(palette, rgb)
+                own_dist = linear_lookup({int(val): palette[int(val)]}, rgb)[1]
+                # a color equally near two entries may go to either, so the distances are compared
+                tol = 1e-6 * max(1.0, want_dist)
+                if abs(dist - want_dist) > tol or abs(own_dist - want_dist) > tol:
+                    self.fail(f"step {step} rgb {rgb.round(2)}: cube {val} ({dist:.2f}), "
+                              f"linear {want_val} ({want_dist:.2f})")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,56 @@
+import time
+import unittest
+
+from play_pipeline import CaptureStage, FrameRing
+
+
+class FrameRingTest(unittest.TestCase):
+    def test_take_and_release(self):
+        ring = FrameRing(capacity=2)
+        t = time.perf_counter()
+        for i in range(3):
+            ring.publish(i, t + i, t + i)
+        frame = ring.take(timeout=0.0)
+        # the newest frame, the older ones dropped
+        self.assertEqual((frame.image, ring.dropped), (2, 2))
+        self.assertIsNone(ring.take(timeout=0.01))  # a frame is handed out once
+        ring.publish(3, t + 3, t + 3)
+        ring.hold()
+        self.assertIsNone(ring.take(timeout=0.01))
+        ring.release(t + 4)
+        # frames from before the release are dropped, frames from after it taken
+        self.assertIsNone(ring.take(timeout=0.01))
+        self.assertEqual(ring.dropped, 3)
+        ring.publish(4, t + 4, t + 4)
+        frame = ring.take(timeout=0.0)
+        self.assertEqual((frame.image, frame.seq), (4, 5))
+
+    def test_capture_stage(self):
+        # A grab counter through the capture thread: frames come out in order, never before the release
+        # time, and capture stops while the ring is held.
+        grabs = []
+        ring = FrameRing(capacity=2)
+        capture = CaptureStage(lambda: grabs.append(time.perf_counter()) or len(grabs), ring)
+        capture.start()
+        try:
+            taken = [frame.image for frame in (ring.take(timeout=1.0) for _ in range(20)) if frame is not None]
+            self.assertEqual(len(taken), 20)
+            self.assertEqual(taken, sorted(set(taken)))
+            ring.hold()
+            time.sleep(0.02)
+            held_at = len(grabs)
+            time.sleep(0.05)
+            self.assertLessEqual(len(grabs), held_at + 1)
+            not_before = time.perf_counter() + 0.05
+            ring.release(not_before)
+            frame = ring.take(timeout=1.0)
+            self.assertGreaterEqual(frame.t_start, not_before)
+        finally:
+            ring.close()
+            capture.join(timeout=1.0)
+        self.assertFalse(capture.is_alive())
+        self.assertIsNone(capture.error)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,101 @@
+import os
+import random
+import tempfile
+import unittest
+from typing import List
+
+from game_record import (CONTINUED, DIRS, HAS_VALUE, NO_SPAWN, GameRecords, GameRecordWriter,
+                         LiveGameRecorder, engine_move, pack_grid, replay, unpack_board)
+
+Grid = List[List[int]]
+
+
+class GameRecordTest(unittest.TestCase):
+    def setUp(self):
+        self.rng = random.Random(2048)
+        tmp = tempfile.TemporaryDirectory()
+        self.addCleanup(tmp.cleanup)
+        self.path = os.path.join(tmp.name, "test.rec")
+
+    def random_board(self) -> Grid:
+        grid = [[0] * 4 for _ in range(4)]
+        for cell in self.rng.sample(range(16), 2):
+            grid[cell // 4][cell % 4] = 2
+        return grid
+
+    def test_pack_round_trip(self):
+        for _ in range(1000):
+            grid = [[self.rng.choice((0, 0, 2, 4, 8, 1024, 32768)) for _ in range(4)] for _ in range(4)]
+            self.assertEqual(unpack_board(pack_grid(grid)), grid)
+
+    def test_merge_across_gap(self):
+        grid = [[2, 0, 2, 0], [0] * 4, [0] * 4, [0] * 4]
+        after, gained, changed = engine_move(grid, "left")
+        self.assertEqual((after[0], gained, changed), ([4, 0, 0, 0], 4, True))
+
+    def test_live_game_with_a_break(self):
+        # A random game through LiveGameRecorder, with a board that does not follow at step 60 (a
+        # misread, a new game): two games come back, the second marked CONTINUED.
+        recorder = LiveGameRecorder(self.path)
+        shown: List[List[Grid]] = [[]]  # boards the recorder saw, per game it should write
+        scores = [0]
+        ends_on_board = False  # the last game ends on a board with no move (else on a pending move)
+        grid = self.random_board()
+        for step in range(300):
+            recorder.observe(grid)
+            shown[-1].append(grid)
+            legal = [d for d in DIRS if engine_move(grid, d)[2]]
+            if not legal:
+                ends_on_board = True
+                break
+            direction = self.rng.choice(legal)
+            recorder.moved(direction, float(step))
+            after, gained, _ = engine_move(grid, direction)
+            scores[-1] += gained
+            if step == 60:
+                grid = self.random_board()
+                shown.append([])
+                scores.append(0)
+                continue
+            empty = [(r, c) for r in range(4) for c in range(4) if after[r][c] == 0]
+            r, c = self.rng.choice(empty)
+            after[r][c] = 2 if self.rng.random() < 0.9 else 4
+            grid = after
+        recorder.close()
+
+        records = GameRecords(self.path)
+        try:
+            games = list(records)
+            self.assertEqual(len(games), 2)
+            for k, (game, boards) in enumerate(zip(games, shown)):
+                # a game before a break ends with the step that led to it
+                want = boards[:-1] if k == 1 and ends_on_board else boards
+                self.assertEqual([board for board, _ in replay(game)], want)
+                self.assertEqual(bool(game.flags & CONTINUED), k > 0)
+                self.assertEqual(game.final_score, scores[k])
+                self.assertFalse(game.open)
+        finally:
+            games = game = None  # the steps are views into the mapping
+            records.close()
+
+    def test_next_writer_seals_an_open_game(self):
+        codes = [0, 1 | 5 << 2, 2 | NO_SPAWN]
+        writer = GameRecordWriter(self.path)
+        writer.begin_game(self.random_board(), HAS_VALUE)
+        for code in codes:
+            writer.add_step(code, value=1.5)
+        writer.f.write(b"\x01")  # a torn step
+        writer.close()  # dies without end_game
+        GameRecordWriter(self.path).close()
+
+        records = GameRecords(self.path)
+        try:
+            last = list(records)[-1]
+            self.assertEqual((last.nsteps, last.open, last.codes().tolist()), (3, False, codes))
+        finally:
+            last = None
+            records.close()
+
+
+if __name__ == "__main__":
+    unittest.main()
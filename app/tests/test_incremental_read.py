@@ -0,0 +1,57 @@
+import unittest
+
+import numpy as np
+
+import board_vision
+from board_vision import BoardRegion
+from bot_2048 import BOARD_SIZE, _expected_after
+
+# A board, a move, the board the game shows after it before the spawn, and the spawn (row, col, value).
+CASES = [
+    ([[2, 2, 2, 2], [4, 0, 4, 8], [0, 0, 0, 0], [16, 16, 0, 2]], "left",
+     [[4, 4, 0, 0], [8, 8, 0, 0], [0, 0, 0, 0], [32, 2, 0, 0]], (2, 3, 2)),
+    ([[2, 0, 0, 2], [2, 0, 0, 4], [4, 0, 0, 4], [8, 0, 0, 4]], "down",
+     [[0, 0, 0, 0], [4, 0, 0, 2], [4, 0, 0, 4], [8, 0, 0, 8]], (0, 1, 4)),
+    ([[0, 2, 2, 4], [0, 0, 0, 0], [8, 8, 8, 0], [2, 4, 2, 4]], "right",
+     [[0, 0, 4, 4], [0, 0, 0, 0], [0, 0, 8, 16], [2, 4, 2, 4]], (1, 0, 2)),
+]
+
+REGION = BoardRegion(left=0, top=0, width=400, height=400, sample_dx=-25, sample_dy=-25, sample_box=20)
+
+
+def render(grid):
+    # A BGR board image in the layout grab_board_image returns, each cell filled with its tile color.
+    img = np.zeros((REGION.height, REGION.width, 3), dtype=np.uint8)
+    for r in range(BOARD_SIZE):
+        for c in range(BOARD_SIZE):
+            y0, x0 = int(r * REGION.cell_h), int(c * REGION.cell_w)
+            img[y0 : int((r + 1) * REGION.cell_h), x0 : int((c + 1) * REGION.cell_w)] = \
+                board_vision.TILE_COLORS[grid[r][c]][::-1]
+    return img
+
+
+def read(grid, expected):
+    img = render(grid)
+    return board_vision.classify_board_incremental(lambda cells: board_vision.patch_means(img, REGION, cells),
+                                                   expected)
+
+
+class IncrementalReadTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        board_vision.load_saved_colors()
+
+    def test_spawn_read(self):
+        for before, direction, after, (r, c, v) in CASES:
+            with self.subTest(before=before, direction=direction):
+                expected = _expected_after(before, direction)
+                self.assertEqual(expected, after)
+                shown = [row[:] for row in after]
+                shown[r][c] = v
+                self.assertEqual(read(shown, expected), shown)
+                # the board from before the move is refused
+                self.assertIsNone(read(before, expected))
+
+
+if __name__ == "__main__":
+    unittest.main()
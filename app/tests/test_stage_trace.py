@@ -0,0 +1,31 @@
+import unittest
+
+from stage_trace import StageStats
+
+
+class StageStatsTest(unittest.TestCase):
+    def test_samples_stay_bounded(self):
+        stats = StageStats(capacity=16, samples=100)
+        for i in range(1000):
+            stats.add("search", 0, (i % 10 + 1) * 1_000_000)  # 1..10 ms
+        stats.add("search", 0, 50_000_000)
+        self.assertEqual(len(stats.samples["search"]), 100)
+        self.assertEqual(len(stats.recent()), 16)
+        n, mean, p50, p99, mx = stats.percentiles()["search"]
+        self.assertEqual((n, mx), (1001, 50.0))
+        self.assertAlmostEqual(mean, (5.5 * 1000 + 50) / 1001)
+        self.assertEqual((p50, p99), (6.0, 50.0))
+
+    def test_since_last_report(self):
+        stats = StageStats(samples=100)
+        for _ in range(10):
+            stats.add("grab", 0, 2_000_000)
+        stats.percentiles()
+        stats.add("grab", 0, 4_000_000)
+        self.assertEqual(stats.percentiles()["grab"], (1, 4.0, 4.0, 4.0, 4.0))
+        self.assertNotIn("grab", stats.percentiles())
+        self.assertEqual(stats.percentiles(everything=True)["grab"][0], 11)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,52 @@
+import os
+import random
+import struct
+import tempfile
+import unittest
+
+import numpy as np
+
+from game_record import pack_grid, unpack_board
+from train_data import FROM_SELFPLAY, HEADER, MAGIC, OPEN, RECORD_DTYPE, load_shards, unpack_boards
+
+RECORD = struct.Struct("<Q4fBBBBI")  # td_record_t, packed field by field
+
+
+class TrainDataTest(unittest.TestCase):
+    def test_record_layout(self):
+        self.assertEqual(RECORD_DTYPE.itemsize, RECORD.size)
+
+    def test_read_back_shards(self):
+        # One closed shard and one still open with a torn record, laid out the way train_data.h writes them.
+        rng = random.Random(2048)
+        rows = []
+        for game in range(40):
+            grid = [[rng.choice((0, 2, 4, 64, 2048, 32768)) for _ in range(4)] for _ in range(4)]
+            values = [rng.uniform(-1e4, 1e4) for _ in range(3)] + [float("-inf")]
+            rows.append((pack_grid(grid), values, rng.randrange(4), rng.randrange(1, 12), FROM_SELFPLAY, game))
+
+        with tempfile.TemporaryDirectory() as tmp:
+            prefix = os.path.join(tmp, "test")
+            for index, (part, count) in enumerate(((rows[:25], 25), (rows[25:], OPEN))):
+                with open(f"{prefix}-{index:05d}.td", "wb") as f:
+                    f.write(HEADER.pack(MAGIC, 1, RECORD.size, count))
+                    for board, values, move, depth, source, game in part:
+                        f.write(RECORD.pack(board, *values, move, depth, source, 0, game))
+                    if count == OPEN:
+                        f.write(b"\0" * (RECORD.size // 2))  # a writer stopped mid-record
+            data = load_shards(prefix)
+            self.assertEqual(len(data), len(rows))
+            codes = unpack_boards(data["board"])
+            for i, (board, values, move, depth, source, game) in enumerate(rows):
+                got = data[i]
+                want_codes = [[v.bit_length() - 1 if v else 0 for v in row] for row in unpack_board(board)]
+                self.assertEqual(int(got["board"]), board)
+                self.assertEqual(codes[i].tolist(), want_codes)
+                np.testing.assert_array_equal(got["values"], np.array(values, dtype=np.float32))
+                self.assertEqual((got["move"], got["depth"], got["source"], got["game"]),
+                                 (move, depth, source, game))
+            del data, codes
+
+
+if __name__ == "__main__":
+    unittest.main()
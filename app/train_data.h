@@ -0,0 +1,250 @@
+/*
+ * Training-data shards: fixed-size (board, root move values, chosen move, depth) records for learned
+ * evaluators, written by selfplay_2048 --export and analyze_2048 --export through a background writer
+ * thread, and read back by mapping a shard (td_map here, train_data.py with numpy).
+ *
+ * Shard PREFIX-NNNNN.td: td_shard_header_t (64 bytes), then count records of 32 bytes, little-endian.
+ * count is TD_OPEN until the shard is closed; readers then take every whole record in the file.
+ *
+ * Producers (search threads) fill their own td_buf_t; a full buffer is handed to the writer thread in
+ * one piece, so producers only take the queue lock once per TD_CHUNK records and never wait on the
+ * disk unless the writer falls TD_QUEUE chunks behind. Include after strategy_2048.c.
+ */
+
+#ifndef TRAIN_DATA_H
+#define TRAIN_DATA_H
+
+#include <stdint.h>
+
+#define TD_MAGIC "T2048TD1"
+#define TD_OPEN 0xffffffffffffffffULL
+#define TD_CHUNK 4096
+#define TD_QUEUE 64
+
+enum {
+    TD_FROM_SELFPLAY = 1,
+    TD_FROM_REPLAY = 2,
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;      /* 1 */
+    uint32_t record_size;  /* sizeof(td_record_t) */
+    uint64_t count;        /* TD_OPEN while being written */
+    uint64_t reserved[5];
+} td_shard_header_t;
+
+typedef struct {
+    uint64_t board;        /* packed (see pack_grid), the position the move was chosen in */
+    float values[4];       /* root value of up, right, down, left; -inf for an illegal move */
+    uint8_t move;          /* move played, 0-3 */
+    uint8_t depth;         /* search depth of values */
+    uint8_t source;        /* TD_FROM_* */
+    uint8_t reserved;
+    uint32_t game;         /* game number within the producing run */
+} td_record_t;
+
+typedef struct {
+    td_record_t *recs;
+    int n;
+} td_chunk_t;
+
+typedef struct {
+    char prefix[4096];
+    uint64_t shard_records;     /* records per shard */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+    td_chunk_t queue[TD_QUEUE];
+    int head, count, stop;
+    FILE *shard;
+    int shard_index;
+    uint64_t in_shard, total;
+    int error;
+} td_writer_t;
+
+/* One producer's pending records. */
+typedef struct {
+    td_record_t *recs;
+    int n;
+} td_buf_t;
+
+static inline void td_fill(td_record_t *r, board_t board, const double values[4], int move, int depth, int source,
+                    uint32_t game) {
+    memset(r, 0, sizeof *r);
+    r->board = board;
+    for (int d = 0; d < 4; d++)
+        r->values[d] = values[d] > -1e299 ? (float)values[d] : -INFINITY;
+    r->move = (uint8_t)move;
+    r->depth = (uint8_t)depth;
+    r->source = (uint8_t)source;
+    r->game = game;
+}
+
+/* ---- writer thread ---- */
+
+static inline void td_close_shard(td_writer_t *w) {
+    if (!w->shard) return;
+    fseek(w->shard, offsetof(td_shard_header_t, count), SEEK_SET);
+    fwrite(&w->in_shard, sizeof w->in_shard, 1, w->shard);
+    if (fclose(w->shard) != 0) w->error = 1;
+    w->shard = NULL;
+}
+
+/* Opens the next free PREFIX-NNNNN.td (earlier runs' shards are kept). */
+static inline int td_open_shard(td_writer_t *w) {
+    char path[4200];
+    for (;; w->shard_index++) {
+        snprintf(path, sizeof path, "%s-%05d.td", w->prefix, w->shard_index);
+        if (access(path, F_OK) != 0) break;
+    }
+    if (!(w->shard = fopen(path, "wb"))) {
+        fprintf(stderr, "cannot write training data %s\n", path);
+        w->error = 1;
+        return -1;
+    }
+    td_shard_header_t h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, TD_MAGIC, 8);
+    h.version = 1;
+    h.record_size = sizeof(td_record_t);
+    h.count = TD_OPEN;
+    fwrite(&h, sizeof h, 1, w->shard);
+    w->in_shard = 0;
+    w->shard_index++;
+    return 0;
+}
+
+static inline void td_write_chunk(td_writer_t *w, const td_chunk_t *c) {
+    for (int done = 0; done < c->n && !w->error;) {
+        if (!w->shard && td_open_shard(w) != 0) return;
+        uint64_t room = w->shard_records - w->in_shard;
+        int n = (uint64_t)(c->n - done) < room ? c->n - done : (int)room;
+        if (fwrite(c->recs + done, sizeof(td_record_t), n, w->shard) != (size_t)n) {
+            fprintf(stderr, "training data: write failed\n");
+            w->error = 1;
+            return;
+        }
+        done += n;
+        w->in_shard += n;
+        w->total += n;
+        if (w->in_shard == w->shard_records) td_close_shard(w);
+    }
+}
+
+static inline void *td_writer_main(void *arg) {
+    td_writer_t *w = (td_writer_t *)arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->count && !w->stop) pthread_cond_wait(&w->not_empty, &w->lock);
+        if (!w->count) break;
+        td_chunk_t c = w->queue[w->head];
+        w->head = (w->head + 1) % TD_QUEUE;
+        w->count--;
+        pthread_cond_signal(&w->not_full);
+        pthread_mutex_unlock(&w->lock);
+        td_write_chunk(w, &c);
+        free(c.recs);
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    td_close_shard(w);
+    return NULL;
+}
+
+/* Starts the writer thread for PREFIX-NNNNN.td shards of shard_records records. NULL on error. */
+static inline td_writer_t *td_writer_open(const char *prefix, uint64_t shard_records) {
+    td_writer_t *w = (td_writer_t *)calloc(1, sizeof *w);
+    if (!w || strlen(prefix) >= sizeof w->prefix) {
+        fprintf(stderr, "training data: bad prefix %s\n", prefix);
+        free(w);
+        return NULL;
+    }
+    strcpy(w->prefix, prefix);
+    w->shard_records = shard_records ? shard_records : 1;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+    if (pthread_create(&w->thread, NULL, td_writer_main, w) != 0) {
+        fprintf(stderr, "training data: cannot start writer thread\n");
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+/* Hands a producer's records to the writer thread (blocks only if TD_QUEUE chunks are pending). */
+static inline void td_flush(td_writer_t *w, td_buf_t *b) {
+    if (!b->n) return;
+    pthread_mutex_lock(&w->lock);
+    while (w->count == TD_QUEUE) pthread_cond_wait(&w->not_full, &w->lock);
+    w->queue[(w->head + w->count) % TD_QUEUE] = (td_chunk_t){ b->recs, b->n };
+    w->count++;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    b->recs = NULL;
+    b->n = 0;
+}
+
+static inline void td_add(td_writer_t *w, td_buf_t *b, const td_record_t *r) {
+    if (!b->recs && !(b->recs = (td_record_t *)malloc(TD_CHUNK * sizeof(td_record_t)))) {
+        fprintf(stderr, "training data: out of memory\n");
+        exit(1);
+    }
+    b->recs[b->n++] = *r;
+    if (b->n == TD_CHUNK) td_flush(w, b);
+}
+
+/* Drains the queue, closes the last shard, frees w. Returns the records written, or -1 on a write error. */
+static inline long long td_writer_close(td_writer_t *w) {
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    long long total = w->error ? -1 : (long long)w->total;
+    free(w);
+    return total;
+}
+
+/* ---- reader ---- */
+
+typedef struct {
+    const td_record_t *recs;
+    uint64_t count;
+    void *map;
+    size_t size;
+} td_map_t;
+
+/* Maps a shard read-only. Returns 0, or -1 with a message on stderr. */
+static inline int td_map(const char *path, td_map_t *m) {
+    memset(m, 0, sizeof *m);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(td_shard_header_t)) {
+        fprintf(stderr, "cannot open training data %s\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    const td_shard_header_t *h = (const td_shard_header_t *)map;
+    if (map == MAP_FAILED || memcmp(h->magic, TD_MAGIC, 8) != 0 || h->record_size != sizeof(td_record_t)) {
+        fprintf(stderr, "%s: not a training data shard\n", path);
+        if (map != MAP_FAILED) munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    uint64_t avail = ((size_t)st.st_size - sizeof *h) / sizeof(td_record_t);
+    m->recs = (const td_record_t *)((const char *)map + sizeof *h);
+    m->count = h->count == TD_OPEN || h->count > avail ? avail : h->count;
+    m->map = map;
+    m->size = (size_t)st.st_size;
+    return 0;
+}
+
+static inline void td_unmap(td_map_t *m) {
+    if (m->map) munmap(m->map, m->size);
+    memset(m, 0, sizeof *m);
+}
+
+#endif /* TRAIN_DATA_H */
@@ -0,0 +1,63 @@
+"""
+Training-data shards (format in train_data.h, written by selfplay_2048 --export and analyze_2048
+--export) as numpy arrays mapped straight from disk.
+
+  from train_data import load_shards
+  data = load_shards("data/selfplay")        # every data/selfplay-NNNNN.td, concatenated
+  data["board"], data["values"], data["move"], data["depth"], data["source"], data["game"]
+"""
+
+import glob
+import struct
+from typing import List
+
+import numpy as np
+
+MAGIC = b"T2048TD1"
+OPEN = 0xFFFFFFFFFFFFFFFF
+HEADER = struct.Struct("<8sIIQ40x")
+FROM_SELFPLAY = 1
+FROM_REPLAY = 2
+
+RECORD_DTYPE = np.dtype([
+    ("board", "<u8"),        # packed board, cell (r, c) at bits 4 * (15 - (r * 4 + c)), log2 codes
+    ("values", "<f4", (4,)),  # root value of up, right, down, left; -inf = illegal
+    ("move", "u1"),
+    ("depth", "u1"),
+    ("source", "u1"),
+    ("reserved", "u1"),
+    ("game", "<u4"),
+])
+
+
+def open_shard(path: str) -> np.ndarray:
+    """One shard as a read-only memmap of RECORD_DTYPE records."""
+    with open(path, "rb") as f:
+        magic, version, record_size, count = HEADER.unpack(f.read(HEADER.size))
+        size = f.seek(0, 2)
+    if magic != MAGIC or record_size != RECORD_DTYPE.itemsize:
+        raise ValueError(f"{path}: not a training data shard")
+    avail = (size - HEADER.size) // record_size
+    if count == OPEN or count > avail:
+        count = avail
+    if count == 0:
+        return np.zeros(0, dtype=RECORD_DTYPE)
+    return np.memmap(path, dtype=RECORD_DTYPE, mode="r", offset=HEADER.size, shape=(count,))
+
+
+def shard_paths(prefix: str) -> List[str]:
+    return sorted(glob.glob(glob.escape(prefix) + "-[0-9][0-9][0-9][0-9][0-9].td"))
+
+
+def load_shards(prefix: str) -> np.ndarray:
+    """All shards of PREFIX; a single shard stays a memmap, several are concatenated into memory."""
+    shards = [open_shard(p) for p in shard_paths(prefix)]
+    if not shards:
+        return np.zeros(0, dtype=RECORD_DTYPE)
+    return shards[0] if len(shards) == 1 else np.concatenate(shards)
+
+
+def unpack_boards(boards: np.ndarray) -> np.ndarray:
+    """Packed boards -> (n, 4, 4) log2 tile codes."""
+    shifts = np.arange(60, -4, -4, dtype=np.uint64)
+    return ((boards[:, None] >> shifts) & np.uint64(15)).astype(np.uint8).reshape(-1, 4, 4)
@@ -0,0 +1,316 @@
+/*
+ * TD trainer for the n-tuple evaluator (strategy_2048 --eval ntuple:PATH).
+ * Plays greedy self-play games on the packed board and learns afterstate values: each move picks
+ * argmax(reward + V(afterstate)), and V is moved towards reward + V(next afterstate) (0 at game over).
+ * With --lambda 0 the update is online TD(0); with --lambda > 0 each game's afterstates are updated at
+ * game end, backwards, towards their lambda-returns.
+ *
+ * Build: gcc -O3 -march=native -o train_ntuple train_ntuple.c -lm -lpthread
+ * Run:   ./train_ntuple --out weights.bin [--init weights.bin] [--net 4x6|5x4] [--threads N]
+ *                       [--games N] [--hours H] [--alpha 0.1] [--lambda 0] [--seed 1]
+ *                       [--checkpoint-games 10000] [--report-sec 10] [--window 1000]
+ *
+ * Threads share one set of weights and update it without locks (Hogwild): tuple lookups of different
+ * games rarely collide, and a lost update only costs a little learning. --alpha is split evenly over the
+ * ntuples * 8 weights a board touches. --out is rewritten (atomically) every --checkpoint-games games
+ * and at exit; Ctrl+C stops after the running games and still saves. --games 0 and --hours 0 = no limit.
+ *
+ * Output (TSV, stdout, every --report-sec): games elapsed_s games_per_sec avg_score max_score
+ * reach_2048 reach_4096 reach_8192, where the averages and rates cover the last --window games.
+ */
+
+#define STRATEGY_2048_NO_MAIN
+#include "strategy_2048.c"
+#include <signal.h>
+
+typedef struct {
+    const char *name;
+    int ntuples;
+    unsigned char len;
+    unsigned char cells[NTUPLE_MAX][NTUPLE_MAX_LEN];
+} net_layout_t;
+
+static const net_layout_t layouts[] = {
+    /* Two 6-cell "L" shapes along the edge and two 2x3 rectangles: 256 MB of weights, the strong one. */
+    { "4x6", 4, 6, { { 0, 1, 2, 3, 4, 5 }, { 4, 5, 6, 7, 8, 9 }, { 0, 1, 2, 4, 5, 6 }, { 4, 5, 6, 8, 9, 10 } } },
+    /* Outer and inner rows plus three 2x2 squares: 1.3 MB, learns in minutes; for quick experiments. */
+    { "5x4", 5, 4, { { 0, 1, 2, 3 }, { 4, 5, 6, 7 }, { 0, 1, 4, 5 }, { 1, 2, 5, 6 }, { 5, 6, 9, 10 } } },
+};
+#define NLAYOUTS ((int)(sizeof layouts / sizeof layouts[0]))
+
+static ntuple_net_t net;
+static float alpha = 0.1f, td_lambda = 0.0f;
+static volatile sig_atomic_t stop_requested = 0;
+
+/* Shared progress; games_started hands out game numbers (and so seeds), the rest is under stats_lock. */
+static unsigned long long games_started = 0, games_done = 0, max_games = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stats_cond = PTHREAD_COND_INITIALIZER;
+static int window = 1000;
+static int *win_score, *win_max_code;
+static unsigned long long base_seed = 1;
+
+static void on_sigint(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double net_value(board_t b) {
+    return ntuple_eval_board(&net, b);
+}
+
+static void net_update(board_t b, float delta) {
+    for (int t = 0; t < net.ntuples; t++) {
+        float *w = net.w[t];
+        for (int s = 0; s < NTUPLE_SYMS; s++)
+            w[ntuple_index(&net, t, s, b)] += delta;
+    }
+}
+
+static int net_create(const net_layout_t *l) {
+    ntuple_file_header_t h;
+    memset(&h, 0, sizeof h);
+    h.ntuples = (unsigned int)l->ntuples;
+    for (int t = 0; t < l->ntuples; t++) {
+        h.len[t] = l->len;
+        memcpy(h.cells[t], l->cells[t], NTUPLE_MAX_LEN);
+    }
+    if (ntuple_set_layout(&net, &h) != 0) return -1;
+    for (int t = 0; t < net.ntuples; t++)
+        if (!(net.w[t] = (float *)calloc(ntuple_table_size(net.len[t]), sizeof(float)))) return -1;
+    return 0;
+}
+
+/* --init: copy a saved net into private, writable tables (layout comes from the file). */
+static int net_resume(const char *path) {
+    ntuple_net_t saved;
+    if (ntuple_load(path, &saved) != 0) return -1;
+    net = saved;
+    net.map = NULL;
+    for (int t = 0; t < net.ntuples; t++) {
+        size_t n = ntuple_table_size(net.len[t]);
+        if (!(net.w[t] = (float *)malloc(n * sizeof(float)))) {
+            fprintf(stderr, "train_ntuple: cannot allocate weights for %s\n", path);
+            ntuple_unload(&saved);
+            return -1;
+        }
+        memcpy(net.w[t], saved.w[t], n * sizeof(float));
+    }
+    ntuple_unload(&saved);
+    return 0;
+}
+
+/* Greedy move: best reward + V(afterstate); returns -1 when no move is legal. */
+static int choose(board_t b, board_t *after_out, int *reward_out, double *value_out) {
+    int best = -1;
+    double best_v = 0;
+    for (int dir = 0; dir < 4; dir++) {
+        int reward;
+        board_t after = board_move(b, dir, &reward);
+        if (after == b) continue;
+        double v = reward + net_value(after);
+        if (best < 0 || v > best_v) {
+            best = dir;
+            best_v = v;
+            *after_out = after;
+            *reward_out = reward;
+        }
+    }
+    if (best >= 0) *value_out = best_v - *reward_out;
+    return best;
+}
+
+typedef struct {
+    board_t *after;
+    int *reward;    /* reward[t] = reward of the move played from after[t] + spawn (0 past the last move) */
+    size_t cap;
+} episode_t;
+
+static void episode_push(episode_t *ep, size_t n, board_t after) {
+    if (n == ep->cap) {
+        ep->cap = ep->cap ? 2 * ep->cap : 4096;
+        ep->after = (board_t *)realloc(ep->after, ep->cap * sizeof(board_t));
+        ep->reward = (int *)realloc(ep->reward, ep->cap * sizeof(int));
+        if (!ep->after || !ep->reward) {
+            fprintf(stderr, "train_ntuple: out of memory\n");
+            exit(1);
+        }
+    }
+    ep->after[n] = after;
+    ep->reward[n] = 0;
+}
+
+/* Plays one game, learning as it goes; returns the score and the max tile code in *max_code. */
+static int play_game(unsigned long long seed, episode_t *ep, int *max_code) {
+    unsigned long long rng = seed ? seed : 1;
+    board_t b = board_spawn(board_spawn(0, &rng), &rng);
+    const float step = alpha / (net.ntuples * NTUPLE_SYMS);
+    int score = 0;
+    size_t n = 0;
+    board_t prev = 0;
+    int have_prev = 0;
+    for (;;) {
+        board_t after;
+        int reward;
+        double v_after;
+        if (choose(b, &after, &reward, &v_after) < 0) break;
+        score += reward;
+        if (td_lambda > 0) {
+            if (n > 0) ep->reward[n - 1] = reward;
+            episode_push(ep, n++, after);
+        } else {
+            if (have_prev) net_update(prev, step * (float)(reward + v_after - net_value(prev)));
+            prev = after;
+            have_prev = 1;
+        }
+        b = board_spawn(after, &rng);
+    }
+    if (td_lambda > 0) {
+        /* Backwards: G_t = r_{t+1} + (1 - lambda) V(s_{t+1}) + lambda G_{t+1}, and G = 0 past the end. */
+        double g = 0;
+        for (size_t t = n; t-- > 0;) {
+            double target = 0;
+            if (t + 1 < n)
+                target = ep->reward[t] + (1 - td_lambda) * net_value(ep->after[t + 1]) + td_lambda * g;
+            net_update(ep->after[t], step * (float)(target - net_value(ep->after[t])));
+            g = target;
+        }
+    } else if (have_prev) {
+        net_update(prev, step * (float)(0 - net_value(prev)));
+    }
+    *max_code = board_max_code(b);
+    return score;
+}
+
+static void *trainer(void *arg) {
+    (void)arg;
+    episode_t ep = { NULL, NULL, 0 };
+    while (!stop_requested) {
+        unsigned long long game = __atomic_fetch_add(&games_started, 1, __ATOMIC_RELAXED);
+        if (max_games && game >= max_games) break;
+        int max_code;
+        int score = play_game(mix64(base_seed * 0x9e3779b97f4a7c15ULL + game), &ep, &max_code);
+        pthread_mutex_lock(&stats_lock);
+        win_score[games_done % window] = score;
+        win_max_code[games_done % window] = max_code;
+        games_done++;
+        net.games++;
+        pthread_cond_signal(&stats_cond);
+        pthread_mutex_unlock(&stats_lock);
+    }
+    free(ep.after);
+    free(ep.reward);
+    return NULL;
+}
+
+static void report(unsigned long long done, double elapsed, double rate) {
+    int n = done < (unsigned long long)window ? (int)done : window;
+    double sum = 0;
+    int max_score = 0, reach[3] = { 0, 0, 0 };
+    for (int i = 0; i < n; i++) {
+        sum += win_score[i];
+        if (win_score[i] > max_score) max_score = win_score[i];
+        for (int k = 0; k < 3; k++)
+            reach[k] += win_max_code[i] >= 11 + k;
+    }
+    printf("%llu\t%.1f\t%.1f\t%.0f\t%d\t%.3f\t%.3f\t%.3f\n", done, elapsed, rate, n ? sum / n : 0.0, max_score,
+           n ? (double)reach[0] / n : 0.0, n ? (double)reach[1] / n : 0.0, n ? (double)reach[2] / n : 0.0);
+    fflush(stdout);
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: train_ntuple --out PATH [--init PATH] [--net 4x6|5x4] [--threads N] [--games N] [--hours H]\n"
+            "                    [--alpha A] [--lambda L] [--seed S] [--checkpoint-games N] [--report-sec S]\n"
+            "                    [--window N]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL, *init_path = NULL, *layout_name = "4x6";
+    double hours = 0, report_sec = 10;
+    unsigned long long checkpoint_games = 10000;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 2; }
+        if (strcmp(a, "--out") == 0) out_path = v;
+        else if (strcmp(a, "--init") == 0) init_path = v;
+        else if (strcmp(a, "--net") == 0) layout_name = v;
+        else if (strcmp(a, "--threads") == 0) nthreads = atoi(v);
+        else if (strcmp(a, "--games") == 0) max_games = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--hours") == 0) hours = atof(v);
+        else if (strcmp(a, "--alpha") == 0) alpha = (float)atof(v);
+        else if (strcmp(a, "--lambda") == 0) td_lambda = (float)atof(v);
+        else if (strcmp(a, "--seed") == 0) base_seed = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--checkpoint-games") == 0) checkpoint_games = strtoull(v, NULL, 10);
+        else if (strcmp(a, "--report-sec") == 0) report_sec = atof(v);
+        else if (strcmp(a, "--window") == 0) window = atoi(v);
+        else { usage(); return 2; }
+        i++;
+    }
+    if (!out_path || window < 1 || td_lambda < 0 || td_lambda >= 1) { usage(); return 2; }
+    if (nthreads <= 0) nthreads = default_thread_count();
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+
+    init_move_tables();
+    if (init_path) {
+        if (net_resume(init_path) != 0) return 1;
+    } else {
+        const net_layout_t *l = NULL;
+        for (int i = 0; i < NLAYOUTS; i++)
+            if (strcmp(layouts[i].name, layout_name) == 0) l = &layouts[i];
+        if (!l) {
+            fprintf(stderr, "train_ntuple: unknown --net %s\n", layout_name);
+            return 2;
+        }
+        if (net_create(l) != 0) {
+            fprintf(stderr, "train_ntuple: cannot allocate weights\n");
+            return 1;
+        }
+    }
+    win_score = (int *)calloc(window, sizeof(int));
+    win_max_code = (int *)calloc(window, sizeof(int));
+    signal(SIGINT, on_sigint);
+
+    fprintf(stderr, "train_ntuple: %d tuples, %d threads, alpha %.4f, lambda %.2f, %llu games already in the net\n",
+            net.ntuples, nthreads, alpha, td_lambda, net.games);
+    printf("games\telapsed_s\tgames_per_sec\tavg_score\tmax_score\treach_2048\treach_4096\treach_8192\n");
+
+    pthread_t threads[MAX_THREADS];
+    for (int i = 0; i < nthreads; i++)
+        pthread_create(&threads[i], NULL, trainer, NULL);
+
+    /* Main thread: progress lines, checkpoints and the time limit; trainers signal every finished game. */
+    double t0 = now_sec(), last_report = t0;
+    unsigned long long last_games = 0, last_checkpoint = 0;
+    pthread_mutex_lock(&stats_lock);
+    for (;;) {
+        int finished = stop_requested || (max_games && games_done >= max_games);
+        if (!finished) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 200000000;
+            if (ts.tv_nsec >= 1000000000) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+            pthread_cond_timedwait(&stats_cond, &stats_lock, &ts);
+        }
+        double now = now_sec();
+        if (hours > 0 && now - t0 >= hours * 3600) stop_requested = 1;
+        if (finished || now - last_report >= report_sec) {
+            report(games_done, now - t0, (games_done - last_games) / (now - last_report));
+            last_report = now;
+            last_games = games_done;
+        }
+        if (finished || (checkpoint_games && games_done - last_checkpoint >= checkpoint_games)) {
+            last_checkpoint = games_done;
+            pthread_mutex_unlock(&stats_lock);
+            if (finished) /* final save after the trainers are done writing */
+                for (int i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+            if (ntuple_save(out_path, &net) != 0)
+                fprintf(stderr, "train_ntuple: cannot write %s\n", out_path);
+            if (finished) break;
+            pthread_mutex_lock(&stats_lock);
+        }
+    }
+    fprintf(stderr, "train_ntuple: %llu games in the net, saved to %s\n", net.games, out_path);
+    return 0;
+}
@@ -0,0 +1,71 @@
+"""
+Press-to-frame latency of the bot's key press backends (app/key_input.py), against a board on screen,
+typically utilities/local_2048.py:
+
+  DISPLAY=:99 python3 utilities/local_2048.py --anim-ms 100 &      # prints: region 46,46,448,448,-30,-30
+  DISPLAY=:99 python3 utilities/input_latency.py --region 46,46,448,448,-30,-30 --backends pyautogui,xtest
+
+For each backend it presses --presses keys (cycling through the four directions, --gap s apart so each
+animation is over) and reports how long the press call blocks and the time from the call to the
+first captured frame that shows the board changing. Presses that changed nothing within 1 s (an
+impossible move) are counted as missed. The frame side is the same for every backend, so the
+difference between backends is the input path.
+"""
+
+import argparse
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "app"))
+
+import board_vision  # noqa: E402
+import key_input  # noqa: E402
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="Press-to-frame latency per key press backend.")
+    ap.add_argument("--region", default=os.environ.get("STRATEGY_2048_REGION", ""),
+                    help="left,top,width,height,dx,dy (as STRATEGY_2048_REGION)")
+    ap.add_argument("--backends", default="pyautogui,xtest,uinput")
+    ap.add_argument("--presses", type=int, default=40)
+    ap.add_argument("--gap", type=float, default=0.4, help="seconds between presses")
+    ap.add_argument("--capture", default="auto")
+    args = ap.parse_args()
+    if not args.region:
+        ap.error("--region or STRATEGY_2048_REGION is required")
+
+    region = board_vision.parse_region(args.region)
+    screen = board_vision.open_capture(region, args.capture)
+    print(f"Capturing the board with {screen.name}.")
+    try:
+        for backend in args.backends.split(","):
+            keys = key_input.open_keys(backend)
+            if keys.name != backend:
+                continue
+            calls, frames, missed = [], [], 0
+            try:
+                for i in range(args.presses):
+                    direction = key_input.DIRECTIONS[i % len(key_input.DIRECTIONS)]
+
+                    def timed_press(d: str) -> None:
+                        t0 = time.perf_counter()
+                        keys.press(d)
+                        calls.append(time.perf_counter() - t0)
+
+                    latency = key_input.measure_press_to_frame(timed_press, screen.grab, screen.means, direction)
+                    if latency is None:
+                        missed += 1
+                    else:
+                        frames.append(latency)
+                    time.sleep(args.gap)
+            finally:
+                keys.close()
+            print(f"{backend}: press call {key_input.latency_summary(calls)}")
+            print(f"{backend}: press to frame {key_input.latency_summary(frames)}, missed={missed}")
+    finally:
+        screen.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,235 @@
+"""
+Local 2048 window for running the bot end to end without play2048.co (and without a network), e.g.
+under Xvfb in CI.
+
+  Xvfb :99 -screen 0 1024x768x24 &
+  DISPLAY=:99 python3 utilities/local_2048.py --seed 1 --anim-ms 100 --log game.jsonl &
+  DISPLAY=:99 STRATEGY_2048_REGION=<the region line it prints> STRATEGY_2048_RECORD=run.rec python3 app/bot_2048.py
+  python3 utilities/local_bench.py --log game.jsonl --record run.rec
+
+The board is drawn with the tile colors of app/2048_colors.json (tiles it has no color for are drawn
+dark grey), numbers small in the middle so the bot's sample spot (upper left of each tile) sees flat
+color. Arrow keys move with the usual rules (a tile merges at most once per move, across gaps). Tiles
+slide for --anim-ms, then the spawn (2, or 4 with --four-prob) appears in a cell picked by a
+random.Random(--seed), so a seed always gives the same game for the same moves. Keys pressed during
+an animation are applied after it, like on the website.
+
+--log gets one JSON line per board: the start, then after every move (with its spawn), then "over"
+when no move is left. Boards are lists of rows; "t" is time.time() when the board was drawn.
+
+Once the window is on screen it prints `region left,top,width,height,dx,dy`: the board in screen
+pixels and the sample offset from each tile center, the format STRATEGY_2048_REGION takes instead of
+calibrating by hand. r restarts with the same seed, Escape quits.
+"""
+
+import argparse
+import json
+import os
+import random
+import time
+import tkinter as tk
+from typing import List, Optional, Tuple
+
+Grid = List[List[int]]
+
+APP_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "app")
+SIZE = 4
+BOARD_BG = (156, 138, 120)
+UNKNOWN_TILE = (60, 58, 50)
+KEYS = {"Left": "left", "Right": "right", "Up": "up", "Down": "down"}
+
+
+def load_colors(path: str) -> dict:
+    with open(path, "r", encoding="utf-8") as f:
+        return {int(k): tuple(v) for k, v in json.load(f).items()}
+
+
+def hex_color(rgb) -> str:
+    return "#%02x%02x%02x" % tuple(int(c) for c in rgb)
+
+
+def slide(grid: Grid, direction: str) -> Tuple[Grid, int, List[Tuple[int, int, int, int, int]]]:
+    """Board after a move, points scored and every tile's path (r0, c0, r1, c1, value before)."""
+    out = [[0] * SIZE for _ in range(SIZE)]
+    score = 0
+    paths = []
+    for i in range(SIZE):
+        # Cells of line i in the order tiles travel towards (index 0 = the wall they pile up on).
+        if direction == "left":
+            cells = [(i, j) for j in range(SIZE)]
+        elif direction == "right":
+            cells = [(i, SIZE - 1 - j) for j in range(SIZE)]
+        elif direction == "up":
+            cells = [(j, i) for j in range(SIZE)]
+        else:
+            cells = [(SIZE - 1 - j, i) for j in range(SIZE)]
+        target = 0
+        last: Optional[int] = None  # value at cells[target - 1] that may still merge
+        for r, c in cells:
+            v = grid[r][c]
+            if not v:
+                continue
+            if last == v:
+                tr, tc = cells[target - 1]
+                out[tr][tc] = 2 * v
+                score += 2 * v
+                last = None
+            else:
+                tr, tc = cells[target]
+                out[tr][tc] = v
+                target += 1
+                last = v
+            paths.append((r, c, tr, tc, v))
+    return out, score, paths
+
+
+class Game:
+    def __init__(self, args):
+        self.args = args
+        self.colors = load_colors(args.colors)
+        self.pitch = args.cell + args.gap
+        self.side = SIZE * self.pitch + args.gap
+        self.root = tk.Tk()
+        self.root.title("2048 (local)")
+        self.root.geometry(f"{self.side}x{self.side}+{args.x}+{args.y}")
+        self.root.resizable(False, False)
+        self.canvas = tk.Canvas(self.root, width=self.side, height=self.side, highlightthickness=0,
+                                bd=0, bg=hex_color(BOARD_BG))
+        self.canvas.pack()
+        self.log = open(args.log, "a", encoding="utf-8") if args.log else None
+        self.pending: List[str] = []
+        self.animating = False
+        self.root.bind("<KeyPress>", self.on_key)
+        self.root.after(200, self.announce)
+        self.new_game()
+
+    # ---- game state ----
+
+    def new_game(self) -> None:
+        self.rng = random.Random(self.args.seed)
+        self.grid = [[0] * SIZE for _ in range(SIZE)]
+        self.score = 0
+        self.moves = 0
+        self.pending.clear()
+        self.spawn()
+        self.spawn()
+        self.draw(self.grid)
+        self.write({"move": 0, "key": None, "board": self.grid, "score": 0})
+
+    def spawn(self) -> Optional[Tuple[int, int, int]]:
+        empty = [(r, c) for r in range(SIZE) for c in range(SIZE) if self.grid[r][c] == 0]
+        if not empty:
+            return None
+        r, c = empty[self.rng.randrange(len(empty))]
+        v = 4 if self.rng.random() < self.args.four_prob else 2
+        self.grid[r][c] = v
+        return r, c, v
+
+    def can_move(self) -> bool:
+        return any(slide(self.grid, d)[0] != self.grid for d in KEYS.values())
+
+    def write(self, entry: dict) -> None:
+        if self.log:
+            entry["t"] = time.time()
+            self.log.write(json.dumps(entry) + "\n")
+            self.log.flush()
+
+    # ---- drawing ----
+
+    def tile_xy(self, r: float, c: float) -> Tuple[float, float]:
+        return self.args.gap + c * self.pitch, self.args.gap + r * self.pitch
+
+    def draw_tile(self, r: float, c: float, v: int) -> None:
+        x, y = self.tile_xy(r, c)
+        cell = self.args.cell
+        fill = hex_color(self.colors.get(v, UNKNOWN_TILE))
+        self.canvas.create_rectangle(x, y, x + cell, y + cell, fill=fill, width=0)
+        if v:
+            ink = "#776e65" if v <= 4 else "#f9f6f2"
+            self.canvas.create_text(x + cell / 2, y + cell / 2, text=str(v), fill=ink,
+                                    font=("Helvetica", max(8, cell // 6), "bold"))
+
+    def draw(self, grid: Grid) -> None:
+        self.canvas.delete("all")
+        for r in range(SIZE):
+            for c in range(SIZE):
+                self.draw_tile(r, c, grid[r][c])
+
+    def announce(self) -> None:
+        # Board region the way calibrate_board infers it: 4 pitches wide, centered on the tiles.
+        self.root.update_idletasks()
+        self.root.focus_force()
+        ox, oy = self.canvas.winfo_rootx(), self.canvas.winfo_rooty()
+        half = self.args.cell / 2
+        left = ox + self.args.gap + half - self.pitch / 2
+        top = oy + self.args.gap + half - self.pitch / 2
+        dx = dy = -0.3 * self.args.cell
+        print(f"region {round(left)},{round(top)},{SIZE * self.pitch},{SIZE * self.pitch},{dx:.0f},{dy:.0f}",
+              flush=True)
+
+    # ---- moves ----
+
+    def on_key(self, event) -> None:
+        if event.keysym == "Escape":
+            self.root.destroy()
+        elif event.keysym in ("r", "R"):
+            if not self.animating:
+                self.new_game()
+        elif event.keysym in KEYS:
+            self.pending.append(KEYS[event.keysym])
+            if not self.animating:
+                self.next_move()
+
+    def next_move(self) -> None:
+        while self.pending:
+            direction = self.pending.pop(0)
+            after, gained, paths = slide(self.grid, direction)
+            if after == self.grid:
+                continue
+            self.animating = True
+            self.animate(paths, after, gained, direction, time.perf_counter())
+            return
+        self.animating = False
+
+    def animate(self, paths, after: Grid, gained: int, direction: str, t0: float) -> None:
+        duration = self.args.anim_ms / 1000.0
+        f = 1.0 if duration <= 0 else min(1.0, (time.perf_counter() - t0) / duration)
+        if f < 1.0:
+            self.canvas.delete("all")
+            for r in range(SIZE):
+                for c in range(SIZE):
+                    self.draw_tile(r, c, 0)
+            for r0, c0, r1, c1, v in paths:
+                self.draw_tile(r0 + (r1 - r0) * f, c0 + (c1 - c0) * f, v)
+            self.root.after(max(1, int(1000 / self.args.fps)), self.animate, paths, after, gained, direction, t0)
+            return
+        self.grid = after
+        self.score += gained
+        self.moves += 1
+        spawn = self.spawn()
+        self.draw(self.grid)
+        self.write({"move": self.moves, "key": direction, "board": self.grid, "score": self.score,
+                    "spawn": list(spawn) if spawn else None})
+        if not self.can_move():
+            self.write({"move": self.moves, "over": True, "score": self.score})
+        self.next_move()
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="Local 2048 window for end-to-end bot runs.")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--anim-ms", type=float, default=100.0, help="slide duration (0 = no animation)")
+    ap.add_argument("--fps", type=float, default=60.0)
+    ap.add_argument("--four-prob", type=float, default=0.1)
+    ap.add_argument("--cell", type=int, default=100, help="tile side in pixels")
+    ap.add_argument("--gap", type=int, default=12)
+    ap.add_argument("--x", type=int, default=40, help="window position on screen")
+    ap.add_argument("--y", type=int, default=40)
+    ap.add_argument("--colors", default=os.path.join(APP_DIR, "2048_colors.json"))
+    ap.add_argument("--log", default="", help="append the ground-truth boards here (JSON lines)")
+    args = ap.parse_args()
+    Game(args).root.mainloop()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,72 @@
+"""
+End-to-end numbers for a bot run against utilities/local_2048.py: moves per minute from the game's
+ground-truth log, misreads from the bot's game record.
+
+  python3 utilities/local_bench.py --log game.jsonl --record run.rec
+
+Record the run to a fresh file (STRATEGY_2048_RECORD=run.rec), since app/records/bot.rec
+(STRATEGY_2048_RECORD=1) collects every game the bot has played. Every board the bot acted on is in the record: each game's start, then
+one board per step (the engine's afterstate plus the spawn the recorder found, which equals the board
+the bot read). A board that never appeared in the log is a misread (or a frame taken mid-animation).
+Continuations (records restarted after a board that did not follow from the last one) are counted
+too.
+"""
+
+import argparse
+import json
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "app"))
+
+from game_record import CONTINUED, HAS_TIME, GameRecords, pack_grid, replay  # noqa: E402
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description="Moves/minute and misread rate of a local_2048 run.")
+    ap.add_argument("--log", required=True, help="local_2048.py --log file")
+    ap.add_argument("--record", required=True, help="the bot's game record for the same run")
+    args = ap.parse_args()
+
+    truth = set()
+    move_times = []
+    score = 0
+    with open(args.log, "r", encoding="utf-8") as f:
+        for line in f:
+            entry = json.loads(line)
+            if "board" in entry:
+                truth.add(pack_grid(entry["board"]))
+            if entry.get("key"):
+                move_times.append(entry["t"])
+            score = max(score, entry.get("score", 0))
+
+    boards = misreads = continued = 0
+    decision_ms = []
+    records = GameRecords(args.record)
+    for game in records:
+        if game.flags & CONTINUED:
+            continued += 1
+        for grid, _ in replay(game):
+            boards += 1
+            if pack_grid(grid) not in truth:
+                misreads += 1
+        if game.flags & HAS_TIME:
+            decision_ms.extend(game.steps["ms"].tolist())
+        del game  # drop the step view before unmapping
+    records.close()
+
+    moves = len(move_times)
+    minutes = (move_times[-1] - move_times[0]) / 60.0 if moves > 1 else 0.0
+    mpm = (moves - 1) / minutes if minutes > 0 else 0.0
+    print(f"moves={moves} moves_per_min={mpm:.1f} score={score}")
+    print(f"boards_acted_on={boards} misreads={misreads} misread_rate={misreads / max(1, boards):.4f} "
+          f"continuations={continued}")
+    if decision_ms:
+        decision_ms.sort()
+        print(f"decision_ms mean={sum(decision_ms) / len(decision_ms):.1f} "
+              f"p50={decision_ms[len(decision_ms) // 2]:.1f} "
+              f"p99={decision_ms[min(len(decision_ms) - 1, int(len(decision_ms) * 0.99))]:.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+"""
+Latency-vs-strength sweep over the search policy CStrategy passes to strategy_2048
+(depth_low, depth_high, serious_empty, serious_max_tile, max_empty_samples, search_timeout_sec).
+
+  gcc -O3 -march=native -o app/selfplay_2048 app/selfplay_2048.c -lm -lpthread
+  python3 utilities/sweep_policy.py --depth-low 2,3,4 --depth-high 3,4,5,6 --samples 4,6,10 --games 100
+  python3 utilities/sweep_policy.py --random 40 ... --out sweep.tsv     # random subset of the grid
+
+Every setting plays the same seeded games through selfplay_2048 --policy (games in parallel across all
+cores) and records mean / p99 decision latency (in-process search time, no process spawn or cache
+allocation) and score and reach rates. Settings with depth_high < depth_low are skipped.
+
+Prints one TSV row per setting, then the Pareto frontier: the settings no other setting beats on both
+latency (--latency mean_ms|p99_ms) and strength (--strength mean_score|reach_2048|reach_4096|...),
+sorted by latency, so a config can be picked per latency budget.
+"""
+
+import argparse
+import itertools
+import os
+import random
+import subprocess
+import sys
+from typing import Dict, List
+
+APP_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "app")
+PARAMS = ["depth_low", "depth_high", "serious_empty", "serious_max_tile", "samples", "timeout"]
+METRICS = ["mean_ms", "p99_ms", "mean_score", "median_score", "reach_2048", "reach_4096", "reach_8192"]
+
+
+def int_list(s: str) -> List[int]:
+    return [int(x) for x in s.split(",") if x]
+
+
+def run_setting(args, setting: Dict[str, int]) -> Dict[str, float]:
+    # The TT is cleared every move, so size it to the depth: 2^16 entries up to depth 3, 4x per extra ply.
+    cache_bits = min(24, 16 + 2 * max(0, setting["depth_high"] - 3))
+    argv = [args.binary, "--games", str(args.games), "--seed", str(args.seed), "--cache-bits", str(cache_bits),
+            "--policy"] + [str(setting[p]) for p in PARAMS]
+    if args.threads:
+        argv += ["--threads", str(args.threads)]
+    if args.weights:
+        argv += ["--weights", args.weights]
+    out = subprocess.run(argv, capture_output=True, text=True, check=True).stdout
+    line = next(l for l in out.splitlines() if l.startswith("selfplay "))
+    return {k: float(v) for k, v in (kv.split("=") for kv in line.split()[1:])}
+
+
+def pareto(rows: List[Dict], latency: str, strength: str) -> List[Dict]:
+    front = []
+    for r in rows:
+        dominated = any(
+            o[latency] <= r[latency] and o[strength] >= r[strength]
+            and (o[latency] < r[latency] or o[strength] > r[strength])
+            for o in rows
+        )
+        if not dominated:
+            front.append(r)
+    return sorted(front, key=lambda r: r[latency])
+
+
+def format_row(r: Dict) -> str:
+    return "\t".join([str(r[p]) for p in PARAMS] + [f"{r[m]:.3f}" if m.endswith("ms") or m.startswith("reach")
+                                                   else f"{r[m]:.0f}" for m in METRICS])
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--binary", default=os.path.join(APP_DIR, "selfplay_2048"))
+    ap.add_argument("--depth-low", type=int_list, default=[2, 3, 4])
+    ap.add_argument("--depth-high", type=int_list, default=[3, 4, 5, 6])
+    ap.add_argument("--serious-empty", type=int_list, default=[5])
+    ap.add_argument("--serious-max-tile", type=int_list, default=[512])
+    ap.add_argument("--samples", type=int_list, default=[6, 10])
+    ap.add_argument("--timeout", type=int_list, default=[0])
+    ap.add_argument("--random", type=int, default=0, help="sample this many settings instead of the full grid")
+    ap.add_argument("--games", type=int, default=100)
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--threads", type=int, default=0, help="selfplay threads (0 = all cores)")
+    ap.add_argument("--weights", default=None, help="eval_weights.json to play with")
+    ap.add_argument("--latency", choices=["mean_ms", "p99_ms"], default="p99_ms")
+    ap.add_argument("--strength", choices=METRICS[2:], default="mean_score")
+    ap.add_argument("--out", help="also write all rows (TSV) here")
+    args = ap.parse_args()
+
+    if not os.path.isfile(args.binary):
+        sys.exit(f"{args.binary} not found; build it with: gcc -O3 -march=native -o selfplay_2048 "
+                 "selfplay_2048.c -lm -lpthread")
+    grid = [dict(zip(PARAMS, combo)) for combo in itertools.product(
+        args.depth_low, args.depth_high, args.serious_empty, args.serious_max_tile, args.samples, args.timeout)]
+    grid = [s for s in grid if s["depth_high"] >= s["depth_low"]]
+    if args.random and args.random < len(grid):
+        grid = random.Random(args.seed).sample(grid, args.random)
+
+    header = "\t".join(PARAMS + METRICS)
+    out = open(args.out, "w", encoding="utf-8") if args.out else None
+    print(header)
+    if out:
+        out.write(header + "\n")
+    rows = []
+    for i, setting in enumerate(grid, 1):
+        print(f"[{i}/{len(grid)}] {' '.join(str(setting[p]) for p in PARAMS)}", file=sys.stderr)
+        row = {**setting, **run_setting(args, setting)}
+        rows.append(row)
+        print(format_row(row))
+        sys.stdout.flush()
+        if out:
+            out.write(format_row(row) + "\n")
+    if out:
+        out.close()
+
+    print(f"\n# Pareto frontier: {args.latency} vs {args.strength}")
+    print(header)
+    for r in pareto(rows, args.latency, args.strength):
+        print(format_row(r))
+
+
+if __name__ == "__main__":
+    main()
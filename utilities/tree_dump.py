@@ -0,0 +1,89 @@
+"""
+Reader for strategy_2048 --tree-dump files (sampled search trees).
+
+  python3 utilities/tree_dump.py tree.bin                 # per-ply summary
+  python3 utilities/tree_dump.py tree.bin --dot tree.dot  # Graphviz (dot -Tsvg tree.dot > tree.svg)
+  python3 utilities/tree_dump.py tree.bin --json tree.json
+
+Layout (little-endian): 32-byte header (magic "T2048TRE", version, record_size, count, iter_depth),
+then `count` records of board:u64 parent:u32 value:f32 ply:u8 is_max:u8 kind:u8 depth:u8.
+"""
+
+import argparse
+import json
+import struct
+from collections import Counter
+from typing import List, NamedTuple
+
+HEADER = struct.Struct("<8sIIQII")
+RECORD = struct.Struct("<QIfBBBB")
+NO_PARENT = 0xFFFFFFFF
+KINDS = {0: "tt_hit", 1: "leaf", 2: "expanded"}
+
+
+class Node(NamedTuple):
+    board: int
+    parent: int
+    value: float
+    ply: int
+    is_max: int
+    kind: int
+    depth: int
+
+
+def unpack_board(board: int) -> List[List[int]]:
+    cells = []
+    for i in range(16):
+        code = (board >> (4 * (15 - i))) & 15
+        cells.append(1 << code if code else 0)
+    return [cells[r * 4 : r * 4 + 4] for r in range(4)]
+
+
+def load(path: str):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, record_size, count, iter_depth, _ = HEADER.unpack_from(data, 0)
+    if magic != b"T2048TRE" or version != 1:
+        raise ValueError(f"{path}: not a strategy_2048 tree dump")
+    nodes = [
+        Node(*RECORD.unpack_from(data, HEADER.size + i * record_size))
+        for i in range(count)
+    ]
+    return iter_depth, nodes
+
+
+def write_dot(nodes: List[Node], path: str) -> None:
+    with open(path, "w", encoding="utf-8") as f:
+        f.write("digraph tree {\n  node [fontname=monospace fontsize=9];\n")
+        for i, n in enumerate(nodes):
+            rows = "\\n".join(" ".join(f"{v:4d}" for v in row) for row in unpack_board(n.board))
+            shape = "box" if n.is_max else "ellipse"
+            style = ' style=dashed' if n.kind == 0 else ""
+            f.write(f'  n{i} [shape={shape}{style} label="{rows}\\n{n.value:.1f}"];\n')
+            if n.parent != NO_PARENT:
+                f.write(f"  n{n.parent} -> n{i};\n")
+        f.write("}\n")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("dump")
+    ap.add_argument("--dot", help="write Graphviz DOT")
+    ap.add_argument("--json", help="write nodes as JSON")
+    args = ap.parse_args()
+
+    iter_depth, nodes = load(args.dump)
+    print(f"{len(nodes)} nodes sampled from a depth-{iter_depth} iteration")
+    per_ply = Counter((n.ply, KINDS.get(n.kind, "?")) for n in nodes)
+    for ply in range(iter_depth + 1):
+        parts = ", ".join(f"{k}={per_ply[(ply, k)]}" for k in KINDS.values() if per_ply[(ply, k)])
+        print(f"ply {ply}: {parts or '-'}")
+    if args.dot:
+        write_dot(nodes, args.dot)
+    if args.json:
+        with open(args.json, "w", encoding="utf-8") as f:
+            json.dump([{**n._asdict(), "grid": unpack_board(n.board)} for n in nodes], f)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,177 @@
+"""
+CMA-ES tuner for the heuristic eval weights (app/eval_weights.json), scored by seeded self-play.
+
+  gcc -O3 -march=native -o app/selfplay_2048 app/selfplay_2048.c -lm -lpthread
+  python3 utilities/tune_eval.py --generations 30 --games 200 --depth 2
+
+Every candidate plays the same --games seeded games through selfplay_2048 (all cores), so candidates
+are compared on identical spawns; fitness is the mean score. The five weights are searched in log
+space relative to the start point, gamma in logit space. After each generation the best weights so far
+are written to --checkpoint if they beat the start point. At the end the start point and the best
+weights are replayed on --validate-games fresh seeds, and only if the best weights still win there by
+more than the standard error of the difference are they written to --out (by default the weights the
+bot and the engine load), so a winner that only fits the training games never replaces them.
+"""
+
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+from typing import Dict, List, Optional
+
+import numpy as np
+
+APP_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "app")
+WEIGHT_KEYS = ["empties", "corner", "mono", "smooth", "max_tile"]
+DEFAULT_WEIGHTS = {"empties": 15.0, "corner": 2.5, "mono": 4.0, "smooth": 0.1, "max_tile": 0.01, "gamma": 0.95}
+
+
+class CMAES:
+    """Minimal (mu/mu_w, lambda)-CMA-ES (Hansen's tutorial defaults); minimizes."""
+
+    def __init__(self, x0: np.ndarray, sigma: float, popsize: Optional[int] = None, seed: int = 0):
+        n = len(x0)
+        self.n = n
+        self.mean = np.array(x0, dtype=float)
+        self.sigma = sigma
+        self.lam = popsize or 4 + int(3 * math.log(n))
+        self.mu = self.lam // 2
+        w = math.log(self.mu + 0.5) - np.log(np.arange(1, self.mu + 1))
+        self.w = w / w.sum()
+        self.mueff = 1.0 / np.sum(self.w ** 2)
+        self.cc = (4 + self.mueff / n) / (n + 4 + 2 * self.mueff / n)
+        self.cs = (self.mueff + 2) / (n + self.mueff + 5)
+        self.c1 = 2 / ((n + 1.3) ** 2 + self.mueff)
+        self.cmu = min(1 - self.c1, 2 * (self.mueff - 2 + 1 / self.mueff) / ((n + 2) ** 2 + self.mueff))
+        self.damps = 1 + 2 * max(0.0, math.sqrt((self.mueff - 1) / (n + 1)) - 1) + self.cs
+        self.chi_n = math.sqrt(n) * (1 - 1 / (4 * n) + 1 / (21 * n * n))
+        self.pc = np.zeros(n)
+        self.ps = np.zeros(n)
+        self.C = np.eye(n)
+        self.gen = 0
+        self.rng = np.random.default_rng(seed)
+
+    def ask(self) -> np.ndarray:
+        vals, self.B = np.linalg.eigh(self.C)
+        self.D = np.sqrt(np.maximum(vals, 1e-20))
+        z = self.rng.standard_normal((self.lam, self.n))
+        return self.mean + self.sigma * (z * self.D) @ self.B.T
+
+    def tell(self, xs: np.ndarray, fs: List[float]) -> None:
+        order = np.argsort(fs)
+        y = (xs[order[: self.mu]] - self.mean) / self.sigma
+        y_w = self.w @ y
+        self.mean = self.mean + self.sigma * y_w
+        c_inv_sqrt = self.B @ np.diag(1 / self.D) @ self.B.T
+        self.ps = (1 - self.cs) * self.ps + math.sqrt(self.cs * (2 - self.cs) * self.mueff) * (c_inv_sqrt @ y_w)
+        self.gen += 1
+        ps_norm = np.linalg.norm(self.ps) / math.sqrt(1 - (1 - self.cs) ** (2 * self.gen))
+        hsig = ps_norm / self.chi_n < 1.4 + 2 / (self.n + 1)
+        self.pc = (1 - self.cc) * self.pc + hsig * math.sqrt(self.cc * (2 - self.cc) * self.mueff) * y_w
+        rank_mu = (y.T * self.w) @ y
+        self.C = (
+            (1 - self.c1 - self.cmu) * self.C
+            + self.c1 * (np.outer(self.pc, self.pc) + (1 - hsig) * self.cc * (2 - self.cc) * self.C)
+            + self.cmu * rank_mu
+        )
+        self.sigma *= math.exp((self.cs / self.damps) * (np.linalg.norm(self.ps) / self.chi_n - 1))
+
+
+def to_weights(x: np.ndarray, start: Dict[str, float]) -> Dict[str, float]:
+    w = {k: start[k] * math.exp(x[i]) for i, k in enumerate(WEIGHT_KEYS)}
+    g0 = min(max(start["gamma"], 1e-6), 1 - 1e-6)
+    w["gamma"] = 1 / (1 + math.exp(-(math.log(g0 / (1 - g0)) + x[len(WEIGHT_KEYS)])))
+    return w
+
+
+def selfplay(binary: str, weights: Dict[str, float], args, seed: int, games: int) -> Dict[str, float]:
+    with tempfile.NamedTemporaryFile("w", suffix=".json", delete=False) as f:
+        json.dump(weights, f)
+        path = f.name
+    try:
+        argv = [binary, "--weights", path, "--games", str(games), "--depth", str(args.depth),
+                "--seed", str(seed), "--samples", str(args.samples)]
+        if args.threads:
+            argv += ["--threads", str(args.threads)]
+        out = subprocess.run(argv, capture_output=True, text=True, check=True).stdout
+    finally:
+        os.unlink(path)
+    line = next(l for l in out.splitlines() if l.startswith("selfplay "))
+    return {k: float(v) for k, v in (kv.split("=") for kv in line.split()[1:])}
+
+
+def write_weights(path: str, weights: Dict[str, float]) -> None:
+    with open(path, "w", encoding="utf-8") as f:
+        json.dump({k: round(v, 6) for k, v in weights.items()}, f, indent=2)
+        f.write("\n")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--binary", default=os.path.join(APP_DIR, "selfplay_2048"))
+    ap.add_argument("--start", default=os.path.join(APP_DIR, "eval_weights.json"), help="initial weights")
+    ap.add_argument("--out", default=os.path.join(APP_DIR, "eval_weights.json"),
+                    help="written only when the best weights pass validation")
+    ap.add_argument("--checkpoint", default=os.path.join(APP_DIR, "eval_weights.candidate.json"),
+                    help="best weights so far, written every generation")
+    ap.add_argument("--generations", type=int, default=30)
+    ap.add_argument("--popsize", type=int, default=0, help="0 = CMA-ES default (9 for 6 parameters)")
+    ap.add_argument("--sigma", type=float, default=0.5, help="initial step size (log scale)")
+    ap.add_argument("--games", type=int, default=200, help="self-play games per candidate")
+    ap.add_argument("--validate-games", type=int, default=500)
+    ap.add_argument("--depth", type=int, default=2)
+    ap.add_argument("--samples", type=int, default=10, help="max_empty_samples")
+    ap.add_argument("--threads", type=int, default=0, help="selfplay threads (0 = all cores)")
+    ap.add_argument("--seed", type=int, default=1, help="game seed; validation uses seed + 1000")
+    args = ap.parse_args()
+
+    if not os.path.isfile(args.binary):
+        sys.exit(f"{args.binary} not found; build it with: gcc -O3 -march=native -o selfplay_2048 "
+                 "selfplay_2048.c -lm -lpthread")
+    start = dict(DEFAULT_WEIGHTS)
+    if os.path.isfile(args.start):
+        with open(args.start, "r", encoding="utf-8") as f:
+            start.update({k: float(v) for k, v in json.load(f).items() if k in start})
+
+    base = selfplay(args.binary, start, args, args.seed, args.games)["mean_score"]
+    print(f"start: mean_score={base:.1f} {json.dumps(start)}", file=sys.stderr)
+    es = CMAES(np.zeros(len(WEIGHT_KEYS) + 1), args.sigma, args.popsize or None, seed=args.seed)
+    best_score, best_weights = base, start
+    print("gen\tevals\tgen_best\tgen_mean\tbest\tsigma")
+    for gen in range(1, args.generations + 1):
+        xs = es.ask()
+        scores = [selfplay(args.binary, to_weights(x, start), args, args.seed, args.games)["mean_score"] for x in xs]
+        es.tell(xs, [-s for s in scores])
+        i = int(np.argmax(scores))
+        if scores[i] > best_score:
+            best_score, best_weights = scores[i], to_weights(xs[i], start)
+            write_weights(args.checkpoint, best_weights)
+        print(f"{gen}\t{gen * len(xs)}\t{scores[i]:.1f}\t{np.mean(scores):.1f}\t{best_score:.1f}\t{es.sigma:.3f}")
+        sys.stdout.flush()
+
+    if best_weights is start:
+        print("no candidate beat the start point; --out not written", file=sys.stderr)
+        return
+    print(f"best: mean_score={best_score:.1f} {json.dumps(best_weights)} -> {args.checkpoint}", file=sys.stderr)
+    if args.validate_games <= 0:
+        print("no validation games; --out not written", file=sys.stderr)
+        return
+    seed = args.seed + 1000
+    v0 = selfplay(args.binary, start, args, seed, args.validate_games)
+    v1 = selfplay(args.binary, best_weights, args, seed, args.validate_games)
+    gain = v1["mean_score"] - v0["mean_score"]
+    sem = math.hypot(v0["sem_score"], v1["sem_score"])
+    print(f"validation ({args.validate_games} games): start {v0['mean_score']:.1f} +- {v0['sem_score']:.1f}, "
+          f"best {v1['mean_score']:.1f} +- {v1['sem_score']:.1f}, gain {gain:.1f} +- {sem:.1f}", file=sys.stderr)
+    if gain > sem:
+        write_weights(args.out, best_weights)
+        print(f"best weights written to {args.out}", file=sys.stderr)
+    else:
+        print(f"gain within the standard error on the validation games; {args.out} left as it was", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()